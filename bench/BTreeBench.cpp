@@ -0,0 +1,188 @@
+// BTreeBench.cpp
+// Insert and lookup throughput of the B-tree index against the node layout it replaced, where
+// every node kept its keys, values and children in separate std::vectors. Build with the headers
+// of src on the include path and run with an optional key count (1000000 by default):
+//   g++ -std=c++17 -O2 -Isrc bench/BTreeBench.cpp -o BTreeBench && ./BTreeBench 1000000
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include "BTree.h"
+
+// The previous node layout, reduced to insert and find
+namespace vectornodes {
+
+template<typename K, typename V>
+class BTreeNode {
+public:
+    bool isLeaf;
+    std::vector<K> keys;
+    std::vector<V> values;
+    std::vector<BTreeNode*> children;
+
+    explicit BTreeNode(bool leaf) : isLeaf(leaf) {}
+
+    ~BTreeNode() {
+        for (BTreeNode* child : children) {
+            delete child;
+        }
+    }
+
+    void insertNonFull(const K& key, const V& value, int t) {
+        int i = static_cast<int>(keys.size()) - 1;
+        while (i >= 0 && key < keys[i]) {
+            i--;
+        }
+        i++;
+        if (isLeaf) {
+            keys.insert(keys.begin() + i, key);
+            values.insert(values.begin() + i, value);
+        }
+        else {
+            if (children[i]->keys.size() == static_cast<size_t>(2 * t - 1)) {
+                splitChild(i, children[i], t);
+                if (keys[i] < key) {
+                    i++;
+                }
+            }
+            children[i]->insertNonFull(key, value, t);
+        }
+    }
+
+    void splitChild(int i, BTreeNode* y, int t) {
+        BTreeNode* z = new BTreeNode(y->isLeaf);
+        for (int j = 0; j < t - 1; j++) {
+            z->keys.push_back(y->keys[j + t]);
+            z->values.push_back(y->values[j + t]);
+        }
+        if (!y->isLeaf) {
+            for (int j = 0; j < t; j++) {
+                z->children.push_back(y->children[j + t]);
+            }
+            y->children.resize(t);
+        }
+        children.insert(children.begin() + i + 1, z);
+        keys.insert(keys.begin() + i, y->keys[t - 1]);
+        values.insert(values.begin() + i, y->values[t - 1]);
+        y->keys.resize(t - 1);
+        y->values.resize(t - 1);
+    }
+
+    V* find(const K& key) {
+        BTreeNode* node = this;
+        while (true) {
+            size_t i = 0;
+            while (i < node->keys.size() && node->keys[i] < key) {
+                i++;
+            }
+            if (i < node->keys.size() && node->keys[i] == key) {
+                return &node->values[i];
+            }
+            if (node->isLeaf) {
+                return nullptr;
+            }
+            node = node->children[i];
+        }
+    }
+};
+
+template<typename K, typename V>
+class BTree {
+private:
+    BTreeNode<K, V>* root;
+    int t;
+
+public:
+    explicit BTree(int _t) : root(new BTreeNode<K, V>(true)), t(_t) {}
+
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
+
+    ~BTree() {
+        delete root;
+    }
+
+    void insert(const K& key, const V& value) {
+        if (root->keys.size() == static_cast<size_t>(2 * t - 1)) {
+            BTreeNode<K, V>* s = new BTreeNode<K, V>(false);
+            s->children.push_back(root);
+            s->splitChild(0, root, t);
+            root = s;
+        }
+        root->insertNonFull(key, value, t);
+    }
+
+    V* find(const K& key) {
+        return root->find(key);
+    }
+
+    int getDegree() const {
+        return t;
+    }
+};
+
+} // namespace vectornodes
+
+// Insert every key in turn, then look every key up twice, and print both rates in millions per second
+template<typename Tree>
+void run(const std::string& name, Tree& tree, const std::vector<int>& keys) {
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(keys[i], static_cast<uint64_t>(i));
+    }
+    double insertSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    uint64_t checksum = 0;
+    for (int round = 0; round < 2; ++round) {
+        for (int key : keys) {
+            const uint64_t* value = tree.find(key);
+            if (!value) {
+                std::cerr << name << ": key " << key << " not found" << std::endl;
+                std::exit(1);
+            }
+            checksum += *value;
+        }
+    }
+    double lookupSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    double millions = keys.size() / 1e6;
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(2)
+        << " t=" << std::setw(3) << tree.getDegree()
+        << "  insert " << std::setw(6) << millions / insertSeconds << " M/s"
+        << "  lookup " << std::setw(6) << 2 * millions / lookupSeconds << " M/s"
+        << "  (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    std::vector<int> keys(count);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+    std::cout << count << " shuffled INT keys" << std::endl;
+
+    {
+        vectornodes::BTree<int, uint64_t> tree(3);
+        run("vector nodes (previous)", tree, keys);
+    }
+    {
+        BTree<int, uint64_t> tree(3);
+        run("inline nodes", tree, keys);
+    }
+    {
+        BTree<int, uint64_t> tree(8);
+        run("inline nodes", tree, keys);
+    }
+    {
+        BTree<int, uint64_t> tree;
+        run("inline nodes (page sized)", tree, keys);
+    }
+    return 0;
+}
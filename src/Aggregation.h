@@ -0,0 +1,660 @@
+// Aggregation.h
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "HashTable.h"
+#include "ParallelFor.h"
+#include "QueryEngine.h"
+
+// An aggregate of a query resolved against a table
+struct AggregateSpec {
+    AggregateFunction function;
+    size_t column; // Unused by COUNT(*)
+    DataType type;
+};
+
+// Running value of one aggregate over the rows of one group
+struct AggregateState {
+    uint64_t count = 0; // Rows seen
+    int64_t integer = 0; // INT, TIMESTAMP and BOOL sums and extremes; for STRING and BLOB, the row holding the extreme
+    double real = 0;     // FLOAT sums and extremes
+};
+
+// Name of an aggregate function as a statement writes it
+std::string aggregateName(AggregateFunction function) {
+    switch (function) {
+    case AggregateFunction::COUNT:
+        return "COUNT";
+    case AggregateFunction::SUM:
+        return "SUM";
+    case AggregateFunction::MIN:
+        return "MIN";
+    case AggregateFunction::MAX:
+        return "MAX";
+    case AggregateFunction::AVG:
+        return "AVG";
+    case AggregateFunction::NONE:
+        break;
+    }
+    return "";
+}
+
+// A FLOAT as its group key holds it: -0 groups with 0 and every NaN with the others
+uint32_t floatKey(float value) {
+    if (value == 0) {
+        value = 0;
+    }
+    else if (std::isnan(value)) {
+        value = std::nanf("");
+    }
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Append the value stored at a row to the key of its group. Fixed-width types append their
+// bytes, STRING and BLOB a length first so that two columns cannot run into each other.
+void appendGroupKey(std::string& key, const ColumnVector& data, RowId row) {
+    switch (data.getType()) {
+    case DataType::INT: {
+        int value = data.getInt(row);
+        key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        break;
+    }
+    case DataType::TIMESTAMP: {
+        std::time_t value = data.getTimestamp(row);
+        key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        break;
+    }
+    case DataType::FLOAT: {
+        uint32_t value = floatKey(data.getFloat(row));
+        key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        break;
+    }
+    case DataType::BOOL:
+        key.push_back(data.getBool(row) ? 1 : 0);
+        break;
+    case DataType::STRING:
+    case DataType::BLOB: {
+        std::string_view bytes = data.getBytes(row);
+        uint32_t length = static_cast<uint32_t>(bytes.size());
+        key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        key.append(bytes);
+        break;
+    }
+    }
+}
+
+// GroupTable class
+// Open-addressing hash table from the key of a group (its group column values packed by
+// appendGroupKey) to the group's number. Groups are numbered in the order they are added.
+// A slot is 8 bytes, the group number and the high half of its key's hash, so a probe only
+// compares keys whose hashes agree and the slots of a few thousand groups stay in cache.
+// Keys are stored back to back in one string.
+class GroupTable {
+public:
+    GroupTable() : slots(16) {}
+
+    // Number of the group with a key, added as the next group if it is new
+    uint32_t findOrAdd(std::string_view key, uint64_t hash) {
+        return probe(key, hash, [&](uint32_t group) {
+            return keyOf(group) == key;
+        });
+    }
+
+    // As above for a key packed into an integer, when every key of the table is one
+    uint32_t findOrAdd(uint64_t key) {
+        return probe(std::string_view(reinterpret_cast<const char*>(&key), sizeof(key)), mixHash(key), [&](uint32_t group) {
+            uint64_t stored;
+            std::memcpy(&stored, keys.data() + size_t(group) * sizeof(key), sizeof(key));
+            return stored == key;
+        });
+    }
+
+    size_t size() const {
+        return hashes.size();
+    }
+
+    std::string_view keyOf(uint32_t group) const {
+        return std::string_view(keys.data() + offsets[group], offsets[group + 1] - offsets[group]);
+    }
+
+    uint64_t hashOf(uint32_t group) const {
+        return hashes[group];
+    }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    struct Slot {
+        uint32_t group = EMPTY;
+        uint32_t tag = 0;
+    };
+
+    std::vector<Slot> slots; // A power of two, at most half full
+    std::vector<uint64_t> hashes;
+    std::vector<size_t> offsets{ 0 }; // Key of group g is keys[offsets[g], offsets[g + 1])
+    std::string keys;
+
+    template<typename Equals>
+    uint32_t probe(std::string_view key, uint64_t hash, Equals equals) {
+        if (hashes.size() * 2 >= slots.size()) {
+            grow();
+        }
+        uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (slot.group == EMPTY) {
+                slot.group = static_cast<uint32_t>(hashes.size());
+                slot.tag = tag;
+                hashes.push_back(hash);
+                keys.append(key);
+                offsets.push_back(keys.size());
+                return slot.group;
+            }
+            if (slot.tag == tag && equals(slot.group)) {
+                return slot.group;
+            }
+        }
+    }
+
+    // Double the slots and place every group again from its stored hash
+    void grow() {
+        slots.assign(slots.size() * 2, Slot());
+        size_t mask = slots.size() - 1;
+        for (uint32_t group = 0; group < hashes.size(); ++group) {
+            size_t i = hashes[group] & mask;
+            while (slots[i].group != EMPTY) {
+                i = (i + 1) & mask;
+            }
+            slots[i].group = group;
+            slots[i].tag = static_cast<uint32_t>(hashes[group] >> 32);
+        }
+    }
+};
+
+// GroupAggregator class
+// The groups and aggregate states of the rows of one part of a query. Each worker fills its
+// own, and they are merged afterwards, so rows are aggregated without any locking.
+// Group columns of fixed width that fit in 8 bytes together are packed into one integer per
+// row, a column at a time; a single STRING or BLOB column is its own key; anything else is
+// packed into bytes by appendGroupKey.
+class GroupAggregator {
+public:
+    GroupAggregator(const Table& table, const std::vector<size_t>& groupColumns, const std::vector<AggregateSpec>& aggregates)
+        : table(table), groupColumns(groupColumns), aggregates(aggregates) {
+        size_t width = 0;
+        for (size_t column : groupColumns) {
+            width += fixedWidth(table.columns[column].type);
+            packed = packed && fixedWidth(table.columns[column].type) > 0;
+        }
+        packed = packed && width <= sizeof(uint64_t);
+    }
+
+    // Aggregate the selected rows of a batch. The rows are first mapped to their groups, then
+    // each aggregate runs over the whole batch with the column type chosen once.
+    void add(const RowBatch& batch) {
+        const std::vector<RowId>& rows = batch.rows;
+        groupOf.resize(rows.size());
+        if (groupColumns.empty()) {
+            if (rows.empty()) {
+                return;
+            }
+            std::fill(groupOf.begin(), groupOf.end(), groupFor(rows[0]));
+        }
+        else if (packed) {
+            packKeys(rows);
+            for (size_t i = 0; i < rows.size(); ++i) {
+                groupOf[i] = addedGroup(groups.findOrAdd(packedKeys[i]), rows[i]);
+            }
+        }
+        else {
+            for (size_t i = 0; i < rows.size(); ++i) {
+                groupOf[i] = groupFor(rows[i]);
+            }
+        }
+
+        size_t stride = aggregates.size();
+        for (size_t a = 0; a < aggregates.size(); ++a) {
+            const AggregateSpec& spec = aggregates[a];
+            auto each = [&](auto&& update) {
+                if (groupColumns.empty()) {
+                    // One group, its state is kept in registers over the batch
+                    AggregateState state = states[a];
+                    for (RowId row : rows) {
+                        update(state, row);
+                        state.count++;
+                    }
+                    states[a] = state;
+                    return;
+                }
+                for (size_t i = 0; i < rows.size(); ++i) {
+                    AggregateState& state = states[groupOf[i] * stride + a];
+                    update(state, rows[i]);
+                    state.count++;
+                }
+            };
+            if (spec.function == AggregateFunction::COUNT) {
+                each([](AggregateState&, RowId) {});
+                continue;
+            }
+
+            const ColumnVector& data = table.columnData[spec.column];
+            bool isSum = spec.function == AggregateFunction::SUM || spec.function == AggregateFunction::AVG;
+            bool isMin = spec.function == AggregateFunction::MIN;
+            switch (spec.type) {
+            case DataType::INT:
+                if (isSum) {
+                    each([&](AggregateState& state, RowId row) { state.integer += data.getInt(row); });
+                }
+                else {
+                    each([&](AggregateState& state, RowId row) { keepInteger(state, data.getInt(row), isMin); });
+                }
+                break;
+            case DataType::TIMESTAMP:
+                each([&](AggregateState& state, RowId row) { keepInteger(state, data.getTimestamp(row), isMin); });
+                break;
+            case DataType::BOOL:
+                each([&](AggregateState& state, RowId row) { keepInteger(state, data.getBool(row), isMin); });
+                break;
+            case DataType::FLOAT:
+                if (isSum) {
+                    each([&](AggregateState& state, RowId row) { state.real += data.getFloat(row); });
+                }
+                else {
+                    each([&](AggregateState& state, RowId row) { keepReal(state, data.getFloat(row), isMin); });
+                }
+                break;
+            case DataType::STRING:
+            case DataType::BLOB:
+                each([&](AggregateState& state, RowId row) { keepRow(state, data, row, isMin); });
+                break;
+            }
+        }
+    }
+
+    // Fold the groups of another part in. Groups new to this one are added after its own.
+    void merge(const GroupAggregator& other) {
+        size_t stride = aggregates.size();
+        for (uint32_t theirs = 0; theirs < other.groups.size(); ++theirs) {
+            uint32_t group = groups.findOrAdd(other.groups.keyOf(theirs), other.groups.hashOf(theirs));
+            if (group == firstRows.size()) {
+                firstRows.push_back(other.firstRows[theirs]);
+                states.insert(states.end(), other.states.begin() + theirs * stride, other.states.begin() + (theirs + 1) * stride);
+                continue;
+            }
+            for (size_t a = 0; a < aggregates.size(); ++a) {
+                combine(aggregates[a], states[group * stride + a], other.states[theirs * stride + a]);
+            }
+        }
+    }
+
+    size_t groupCount() const {
+        return firstRows.size();
+    }
+
+    // The first row found of a group, it holds the group column values
+    RowId firstRow(size_t group) const {
+        return firstRows[group];
+    }
+
+    const AggregateState& state(size_t group, size_t aggregate) const {
+        return states[group * aggregates.size() + aggregate];
+    }
+
+private:
+    const Table& table;
+    const std::vector<size_t>& groupColumns;
+    const std::vector<AggregateSpec>& aggregates;
+    GroupTable groups;
+    std::vector<RowId> firstRows;
+    std::vector<AggregateState> states; // aggregates.size() per group
+    std::vector<uint32_t> groupOf;      // Group of each row of the batch being added
+    std::string key;
+    bool packed = true;                 // Whether the group columns fit one packed integer key
+    std::vector<uint64_t> packedKeys;   // Packed key of each row of the batch being added
+
+    // Bytes of a packed key a column type takes, 0 for types that are not packed
+    static size_t fixedWidth(DataType type) {
+        switch (type) {
+        case DataType::INT:
+        case DataType::FLOAT:
+            return 4;
+        case DataType::TIMESTAMP:
+            return 8;
+        case DataType::BOOL:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    // Pack the group columns of the rows into one integer each, a column at a time
+    void packKeys(const std::vector<RowId>& rows) {
+        packedKeys.assign(rows.size(), 0);
+        for (size_t column : groupColumns) {
+            const ColumnVector& data = table.columnData[column];
+            auto pack = [&](unsigned bits, auto&& read) {
+                for (size_t i = 0; i < rows.size(); ++i) {
+                    // Two shifts, a 64-bit TIMESTAMP key shifts the empty key out whole
+                    packedKeys[i] = (packedKeys[i] << (bits / 2) << (bits / 2)) | read(rows[i]);
+                }
+            };
+            switch (data.getType()) {
+            case DataType::INT:
+                pack(32, [&](RowId row) { return uint64_t(uint32_t(data.getInt(row))); });
+                break;
+            case DataType::TIMESTAMP:
+                pack(64, [&](RowId row) { return uint64_t(data.getTimestamp(row)); });
+                break;
+            case DataType::FLOAT:
+                pack(32, [&](RowId row) { return uint64_t(floatKey(data.getFloat(row))); });
+                break;
+            case DataType::BOOL:
+                pack(8, [&](RowId row) { return uint64_t(data.getBool(row)); });
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    uint32_t groupFor(RowId row) {
+        std::string_view bytes;
+        if (groupColumns.size() == 1) {
+            // A single STRING or BLOB column is its own key, read in place
+            bytes = table.columnData[groupColumns[0]].getBytes(row);
+        }
+        else {
+            key.clear();
+            for (size_t column : groupColumns) {
+                appendGroupKey(key, table.columnData[column], row);
+            }
+            bytes = key;
+        }
+        return addedGroup(groups.findOrAdd(bytes, mixHash(std::hash<std::string_view>()(bytes))), row);
+    }
+
+    // Start the states of a group the table just added
+    uint32_t addedGroup(uint32_t group, RowId row) {
+        if (group == firstRows.size()) {
+            firstRows.push_back(row);
+            states.resize(states.size() + aggregates.size());
+        }
+        return group;
+    }
+
+    static void keepInteger(AggregateState& state, int64_t value, bool isMin) {
+        if (state.count == 0 || (isMin ? value < state.integer : state.integer < value)) {
+            state.integer = value;
+        }
+    }
+
+    static void keepReal(AggregateState& state, double value, bool isMin) {
+        if (state.count == 0 || (isMin ? value < state.real : state.real < value)) {
+            state.real = value;
+        }
+    }
+
+    static void keepRow(AggregateState& state, const ColumnVector& data, RowId row, bool isMin) {
+        if (state.count == 0) {
+            state.integer = static_cast<int64_t>(row);
+            return;
+        }
+        int order = data.getBytes(row).compare(data.getBytes(static_cast<RowId>(state.integer)));
+        if (isMin ? order < 0 : order > 0) {
+            state.integer = static_cast<int64_t>(row);
+        }
+    }
+
+    void combine(const AggregateSpec& spec, AggregateState& state, const AggregateState& other) const {
+        if (other.count == 0) {
+            return;
+        }
+        bool isMin = spec.function == AggregateFunction::MIN;
+        switch (spec.function) {
+        case AggregateFunction::COUNT:
+            break;
+        case AggregateFunction::SUM:
+        case AggregateFunction::AVG:
+            state.integer += other.integer;
+            state.real += other.real;
+            break;
+        case AggregateFunction::MIN:
+        case AggregateFunction::MAX:
+            if (spec.type == DataType::FLOAT) {
+                keepReal(state, other.real, isMin);
+            }
+            else if (spec.type == DataType::STRING || spec.type == DataType::BLOB) {
+                keepRow(state, table.columnData[spec.column], static_cast<RowId>(other.integer), isMin);
+            }
+            else {
+                keepInteger(state, other.integer, isMin);
+            }
+            break;
+        case AggregateFunction::NONE:
+            break;
+        }
+        state.count += other.count;
+    }
+};
+
+// HashAggregate class
+// The end of an aggregating query. The input comes in parts, the ranges of a table scan
+// split between worker threads or a single index access path; each part is aggregated into
+// its own GroupAggregator, then the parts are merged in order, so groups come out in the
+// order their first row appears in the table. Output values are formatted as text since
+// counts, sums and averages do not fit the column types.
+class HashAggregate {
+public:
+    // One output column: a group column (index of the table column) or an aggregate (index into the aggregates)
+    struct Output {
+        bool isAggregate;
+        size_t index;
+    };
+
+    HashAggregate(std::vector<std::unique_ptr<RowOperator>> parts, const Table& table, std::vector<size_t> groupColumns,
+                  std::vector<AggregateSpec> aggregates, std::vector<Output> outputs, std::vector<std::string> names,
+                  std::optional<size_t> limit, size_t jobs)
+        : parts(std::move(parts)), table(table), groupColumns(std::move(groupColumns)), aggregates(std::move(aggregates)),
+          outputs(std::move(outputs)), names(std::move(names)), limit(limit), jobs(jobs) {}
+
+    // Text of each column of the next group, false once there are no more.
+    // The input is aggregated on the first call.
+    bool next(std::vector<std::string>& cells) {
+        if (partials.empty()) {
+            run();
+        }
+        size_t groups = partials[0].groupCount();
+        // Aggregates over no rows at all still make one row
+        bool emptyRow = groupColumns.empty() && groups == 0 && position == 0;
+        if ((position >= groups && !emptyRow) || (limit && position >= *limit)) {
+            return false;
+        }
+        cells.clear();
+        AggregateState none;
+        for (const Output& output : outputs) {
+            if (output.isAggregate) {
+                cells.push_back(formatAggregate(aggregates[output.index], emptyRow ? none : partials[0].state(position, output.index)));
+            }
+            else {
+                std::ostringstream text;
+                printValue(text, table.columnData[output.index].get(partials[0].firstRow(position)));
+                cells.push_back(text.str());
+            }
+        }
+        ++position;
+        return true;
+    }
+
+    const std::vector<std::string>& getNames() const {
+        return names;
+    }
+
+    std::string describe() const {
+        std::string text = "HashAggregate(keys " + std::to_string(groupColumns.size()) + ", aggregates " + std::to_string(aggregates.size());
+        if (parts.size() > 1) {
+            text += ", parts " + std::to_string(parts.size());
+        }
+        return text + ") <- " + parts[0]->describe();
+    }
+
+private:
+    std::vector<std::unique_ptr<RowOperator>> parts;
+    const Table& table;
+    std::vector<size_t> groupColumns;
+    std::vector<AggregateSpec> aggregates;
+    std::vector<Output> outputs;
+    std::vector<std::string> names;
+    std::optional<size_t> limit;
+    size_t jobs;
+    std::vector<GroupAggregator> partials; // One per part, merged into the first
+    size_t position = 0;
+
+    void run() {
+        partials.reserve(parts.size());
+        for (size_t i = 0; i < parts.size(); ++i) {
+            partials.emplace_back(table, groupColumns, aggregates);
+        }
+        parallelFor(parts.size(), jobs, [&](size_t part) {
+            RowBatch batch;
+            while (parts[part]->next(batch)) {
+                partials[part].add(batch);
+            }
+        });
+        for (size_t part = 1; part < partials.size(); ++part) {
+            partials[0].merge(partials[part]);
+        }
+    }
+
+    std::string formatAggregate(const AggregateSpec& spec, const AggregateState& state) const {
+        std::ostringstream text;
+        text.precision(15); // Sums and averages are doubles, a FLOAT extreme is printed as a float still
+        switch (spec.function) {
+        case AggregateFunction::COUNT:
+            text << state.count;
+            break;
+        case AggregateFunction::SUM:
+            if (spec.type == DataType::FLOAT) {
+                text << state.real;
+            }
+            else {
+                text << state.integer;
+            }
+            break;
+        case AggregateFunction::AVG:
+            if (state.count == 0) {
+                text << "NULL";
+            }
+            else {
+                text << (spec.type == DataType::FLOAT ? state.real : static_cast<double>(state.integer)) / state.count;
+            }
+            break;
+        case AggregateFunction::MIN:
+        case AggregateFunction::MAX:
+            if (state.count == 0) {
+                text << "NULL";
+                break;
+            }
+            switch (spec.type) {
+            case DataType::INT:
+                text << state.integer;
+                break;
+            case DataType::TIMESTAMP:
+                printValue(text, static_cast<std::time_t>(state.integer));
+                break;
+            case DataType::BOOL:
+                printValue(text, state.integer != 0);
+                break;
+            case DataType::FLOAT:
+                printValue(text, static_cast<float>(state.real));
+                break;
+            case DataType::STRING:
+            case DataType::BLOB:
+                printValue(text, table.columnData[spec.column].get(static_cast<RowId>(state.integer)));
+                break;
+            }
+            break;
+        case AggregateFunction::NONE:
+            break;
+        }
+        return text.str();
+    }
+};
+
+// Build the plan of a SELECT with aggregates or GROUP BY. Plain columns of the select list
+// must be grouped on, SUM and AVG take INT or FLOAT columns. Without an index to narrow the
+// rows down, the table is scanned in up to jobs ranges aggregated in parallel.
+// Throws for unknown columns, misplaced columns and values that do not convert.
+std::unique_ptr<HashAggregate> planAggregate(const Table& table, const SelectStatement& statement, size_t jobs) {
+    if (statement.items.empty()) {
+        throw std::runtime_error("SELECT * cannot be grouped");
+    }
+    std::vector<Predicate> predicates = resolvePredicates(table, statement.where);
+    std::vector<size_t> groupColumns;
+    for (const std::string& name : statement.groupBy) {
+        groupColumns.push_back(resolveColumn(table, name));
+    }
+
+    std::vector<AggregateSpec> aggregates;
+    std::vector<HashAggregate::Output> outputs;
+    std::vector<std::string> names;
+    for (const SelectItem& item : statement.items) {
+        if (item.function == AggregateFunction::NONE) {
+            size_t column = resolveColumn(table, item.column);
+            if (std::find(groupColumns.begin(), groupColumns.end(), column) == groupColumns.end()) {
+                throw std::runtime_error("Column " + item.column + " must be in GROUP BY");
+            }
+            outputs.push_back({ false, column });
+            names.push_back(item.column);
+            continue;
+        }
+        AggregateSpec spec{ item.function, 0, DataType::INT };
+        if (!item.column.empty()) {
+            spec.column = resolveColumn(table, item.column);
+            spec.type = table.columns[spec.column].type;
+        }
+        bool isSum = item.function == AggregateFunction::SUM || item.function == AggregateFunction::AVG;
+        if (isSum && spec.type != DataType::INT && spec.type != DataType::FLOAT) {
+            throw std::runtime_error(aggregateName(item.function) + " needs an INT or FLOAT column: " + item.column);
+        }
+        outputs.push_back({ true, aggregates.size() });
+        names.push_back(aggregateName(item.function) + "(" + (item.column.empty() ? "*" : item.column) + ")");
+        aggregates.push_back(spec);
+    }
+
+    std::vector<std::unique_ptr<RowOperator>> parts;
+    std::unique_ptr<RowOperator> access = planIndexAccess(table, predicates);
+    if (access) {
+        parts.push_back(std::move(access));
+    }
+    else {
+        // Ranges of whole batches, at least a few batches each
+        constexpr size_t MIN_PART_BATCHES = 16;
+        size_t batches = (table.slotCount() + RowBatch::CAPACITY - 1) / RowBatch::CAPACITY;
+        size_t count = std::max<size_t>(1, std::min(jobs == 0 ? defaultJobs() : jobs, batches / MIN_PART_BATCHES));
+        size_t partRows = (batches + count - 1) / count * RowBatch::CAPACITY;
+        for (size_t part = 0; part < count; ++part) {
+            parts.push_back(std::make_unique<TableScan>(table, part * partRows, (part + 1) * partRows));
+        }
+    }
+    if (!predicates.empty()) {
+        for (std::unique_ptr<RowOperator>& part : parts) {
+            part = std::make_unique<Filter>(std::move(part), table, predicates);
+        }
+    }
+    return std::make_unique<HashAggregate>(std::move(parts), table, std::move(groupColumns), std::move(aggregates), std::move(outputs),
+                                           std::move(names), statement.limit, jobs);
+}
@@ -0,0 +1,583 @@
+// BPlusTree.h
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include "NodeSearch.h"
+
+// BPlusTreeNode class
+// Internal nodes only route searches, every entry lives in a leaf and
+// leaves are chained in key order so ranges can be walked without the tree.
+template<typename K, typename V>
+class BPlusTreeNode {
+public:
+    bool isLeaf;
+    std::vector<K> keys;
+    std::vector<V> values;                // Leaf only
+    std::vector<BPlusTreeNode*> children; // Internal only
+    BPlusTreeNode* prev = nullptr;        // Leaf only, previous leaf in key order
+    BPlusTreeNode* next = nullptr;        // Leaf only, next leaf in key order
+
+    BPlusTreeNode(bool leaf) : isLeaf(leaf) {}
+
+    // Index of the child whose range contains key (first key greater than key)
+    size_t childIndex(const K& key) const {
+        if constexpr (std::is_same<K, bool>::value) { // std::vector<bool> has no contiguous storage
+            return std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+        }
+        else {
+            return NodeSearch<K>::upperBound(keys.data(), static_cast<int>(keys.size()), key);
+        }
+    }
+
+    // Index of the first key that is not less than key
+    size_t lowerBound(const K& key) const {
+        if constexpr (std::is_same<K, bool>::value) {
+            return std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+        }
+        else {
+            return NodeSearch<K>::lowerBound(keys.data(), static_cast<int>(keys.size()), key);
+        }
+    }
+
+    // Deep copy of the subtree rooted at this node, leaves are linked by the caller
+    BPlusTreeNode* clone() const;
+
+    // Free every node below this one
+    void destroyChildren();
+};
+
+// BPlusTree class
+// An ordered map from unique keys to values with bidirectional iterators
+template<typename K, typename V>
+class BPlusTree {
+public:
+    using Node = BPlusTreeNode<K, V>;
+
+    // Bidirectional iterator over the leaf chain
+    class iterator {
+    public:
+        iterator() = default;
+
+        // A copy for bool keys, which std::vector<bool> does not store as bools
+        typename std::vector<K>::const_reference key() const {
+            return leaf->keys[pos];
+        }
+
+        V& value() const {
+            return leaf->values[pos];
+        }
+
+        // The key is held as key() returns it, a reference to a bool key would dangle
+        std::pair<typename std::vector<K>::const_reference, V&> operator*() const {
+            return { leaf->keys[pos], leaf->values[pos] };
+        }
+
+        iterator& operator++() {
+            if (++pos >= leaf->keys.size()) {
+                leaf = leaf->next;
+                pos = 0;
+            }
+            return *this;
+        }
+
+        iterator& operator--() {
+            if (!leaf) {
+                leaf = tree->tail;
+                pos = leaf->keys.size() - 1;
+            }
+            else if (pos == 0) {
+                leaf = leaf->prev;
+                pos = leaf->keys.size() - 1;
+            }
+            else {
+                pos--;
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const {
+            return leaf == other.leaf && pos == other.pos;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class BPlusTree;
+
+        const BPlusTree* tree = nullptr;
+        Node* leaf = nullptr; // nullptr for end()
+        size_t pos = 0;
+
+        iterator(const BPlusTree* tree, Node* leaf, size_t pos) : tree(tree), leaf(leaf), pos(pos) {
+            // Positions past the last key of a leaf continue in the next leaf
+            while (this->leaf && this->pos >= this->leaf->keys.size()) {
+                this->leaf = this->leaf->next;
+                this->pos = 0;
+            }
+        }
+    };
+
+    BPlusTree() : BPlusTree(16) {}
+
+    // t is the minimum degree, nodes hold between t - 1 and 2t - 1 keys
+    BPlusTree(int _t) : t(_t < 2 ? 2 : _t), count(0) {
+        root = new Node(true);
+        head = tail = root;
+    }
+
+    BPlusTree(const BPlusTree& other) : t(other.t), count(other.count) {
+        root = other.root->clone();
+        linkLeaves();
+    }
+
+    BPlusTree& operator=(const BPlusTree& other) {
+        if (this == &other) {
+            return *this;
+        }
+        root->destroyChildren();
+        delete root;
+        t = other.t;
+        count = other.count;
+        root = other.root->clone();
+        linkLeaves();
+        return *this;
+    }
+
+    ~BPlusTree() {
+        root->destroyChildren();
+        delete root;
+    }
+
+    // Insert an entry, returns false and leaves the tree unchanged if the key exists
+    bool insert(const K& key, const V& value);
+
+    // Remove a key, returns false if it was not found
+    bool remove(const K& key);
+
+    // Replace the contents with entries, filling leaves and routing nodes bottom-up.
+    // Unsorted input is sorted first. Returns false and leaves the tree unchanged if
+    // a key appears twice.
+    bool bulkLoad(std::vector<std::pair<K, V>> entries);
+
+    // Find the value stored for a key, nullptr if the key is absent
+    V* find(const K& key) const;
+
+    bool contains(const K& key) const {
+        return find(key) != nullptr;
+    }
+
+    // First entry whose key is not less than key
+    iterator lower_bound(const K& key) const;
+
+    // First entry whose key is greater than key
+    iterator upper_bound(const K& key) const;
+
+    iterator begin() const {
+        return iterator(this, head, 0);
+    }
+
+    iterator end() const {
+        return iterator(this, nullptr, 0);
+    }
+
+    // Call fn(key, value) for every entry with low <= key <= high, in key order, until fn returns false
+    template<typename Fn>
+    void scanRange(const K& low, const K& high, Fn fn) const {
+        scanRange(&low, &high, fn);
+    }
+
+    // As above, a null bound leaves that end of the range open
+    template<typename Fn>
+    void scanRange(const K* low, const K* high, Fn fn) const {
+        for (iterator it = low ? lower_bound(*low) : begin(); it != end() && !(high && *high < it.key()); ++it) {
+            if (!fn(it.key(), it.value())) {
+                break;
+            }
+        }
+    }
+
+    void clear() {
+        root->destroyChildren();
+        root->isLeaf = true;
+        root->keys.clear();
+        root->values.clear();
+        root->prev = root->next = nullptr;
+        head = tail = root;
+        count = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    int getDegree() const {
+        return t;
+    }
+
+private:
+    Node* root;
+    Node* head; // Leftmost leaf
+    Node* tail; // Rightmost leaf
+    int t;
+    size_t count;
+
+    size_t maxKeys() const {
+        return static_cast<size_t>(2 * t - 1);
+    }
+
+    size_t minKeys() const {
+        return static_cast<size_t>(t - 1);
+    }
+
+    Node* findLeaf(const K& key) const {
+        Node* node = root;
+        while (!node->isLeaf) {
+            node = node->children[node->childIndex(key)];
+        }
+        return node;
+    }
+
+    // Recursive insert, returns the new right sibling (and its separator) when node splits
+    Node* insertInto(Node* node, const K& key, const V& value, K& separator, bool& inserted);
+
+    // Recursive remove, children that drop below the minimum are repaired on the way up
+    bool removeFrom(Node* node, const K& key);
+    void rebalanceChild(Node* parent, size_t idx);
+
+    void linkLeaves();
+};
+
+template<typename K, typename V>
+BPlusTreeNode<K, V>* BPlusTreeNode<K, V>::clone() const {
+    BPlusTreeNode* copy = new BPlusTreeNode(isLeaf);
+    copy->keys = keys;
+    copy->values = values;
+    copy->children.reserve(children.size());
+    for (const auto& child : children) {
+        copy->children.push_back(child->clone());
+    }
+    return copy;
+}
+
+template<typename K, typename V>
+void BPlusTreeNode<K, V>::destroyChildren() {
+    for (auto& child : children) {
+        child->destroyChildren();
+        delete child;
+    }
+    children.clear();
+}
+
+template<typename K, typename V>
+bool BPlusTree<K, V>::insert(const K& key, const V& value) {
+    K separator;
+    bool inserted = false;
+    Node* right = insertInto(root, key, value, separator, inserted);
+    if (right) {
+        Node* newRoot = new Node(false);
+        newRoot->keys.push_back(separator);
+        newRoot->children.push_back(root);
+        newRoot->children.push_back(right);
+        root = newRoot;
+    }
+    if (inserted) {
+        count++;
+    }
+    return inserted;
+}
+
+template<typename K, typename V>
+BPlusTreeNode<K, V>* BPlusTree<K, V>::insertInto(Node* node, const K& key, const V& value, K& separator, bool& inserted) {
+    if (node->isLeaf) {
+        size_t pos = node->lowerBound(key);
+        if (pos < node->keys.size() && node->keys[pos] == key) {
+            return nullptr;
+        }
+        node->keys.insert(node->keys.begin() + pos, key);
+        node->values.insert(node->values.begin() + pos, value);
+        inserted = true;
+        if (node->keys.size() <= maxKeys()) {
+            return nullptr;
+        }
+
+        // Split the leaf, the right half keeps the upper entries and its first key becomes the separator
+        size_t mid = node->keys.size() / 2;
+        Node* right = new Node(true);
+        right->keys.assign(node->keys.begin() + mid, node->keys.end());
+        right->values.assign(node->values.begin() + mid, node->values.end());
+        node->keys.resize(mid);
+        node->values.resize(mid);
+
+        right->next = node->next;
+        right->prev = node;
+        if (node->next) {
+            node->next->prev = right;
+        }
+        else {
+            tail = right;
+        }
+        node->next = right;
+
+        separator = right->keys.front();
+        return right;
+    }
+
+    size_t idx = node->childIndex(key);
+    K childSeparator;
+    Node* newChild = insertInto(node->children[idx], key, value, childSeparator, inserted);
+    if (!newChild) {
+        return nullptr;
+    }
+    node->keys.insert(node->keys.begin() + idx, childSeparator);
+    node->children.insert(node->children.begin() + idx + 1, newChild);
+    if (node->keys.size() <= maxKeys()) {
+        return nullptr;
+    }
+
+    // Split the internal node, the middle key moves up to the parent
+    size_t mid = node->keys.size() / 2;
+    Node* right = new Node(false);
+    separator = node->keys[mid];
+    right->keys.assign(node->keys.begin() + mid + 1, node->keys.end());
+    right->children.assign(node->children.begin() + mid + 1, node->children.end());
+    node->keys.resize(mid);
+    node->children.resize(mid + 1);
+    return right;
+}
+
+template<typename K, typename V>
+bool BPlusTree<K, V>::remove(const K& key) {
+    bool removed = removeFrom(root, key);
+    if (!root->isLeaf && root->keys.empty()) {
+        Node* oldRoot = root;
+        root = root->children.front();
+        oldRoot->children.clear();
+        delete oldRoot;
+    }
+    if (removed) {
+        count--;
+    }
+    return removed;
+}
+
+template<typename K, typename V>
+bool BPlusTree<K, V>::removeFrom(Node* node, const K& key) {
+    if (node->isLeaf) {
+        size_t pos = node->lowerBound(key);
+        if (pos == node->keys.size() || !(node->keys[pos] == key)) {
+            return false;
+        }
+        node->keys.erase(node->keys.begin() + pos);
+        node->values.erase(node->values.begin() + pos);
+        return true;
+    }
+
+    size_t idx = node->childIndex(key);
+    bool removed = removeFrom(node->children[idx], key);
+    if (removed && node->children[idx]->keys.size() < minKeys()) {
+        rebalanceChild(node, idx);
+    }
+    return removed;
+}
+
+template<typename K, typename V>
+void BPlusTree<K, V>::rebalanceChild(Node* parent, size_t idx) {
+    Node* child = parent->children[idx];
+    Node* left = idx > 0 ? parent->children[idx - 1] : nullptr;
+    Node* right = idx + 1 < parent->children.size() ? parent->children[idx + 1] : nullptr;
+
+    // Borrow from the left sibling
+    if (left && left->keys.size() > minKeys()) {
+        if (child->isLeaf) {
+            child->keys.insert(child->keys.begin(), left->keys.back());
+            child->values.insert(child->values.begin(), left->values.back());
+            left->keys.pop_back();
+            left->values.pop_back();
+            parent->keys[idx - 1] = child->keys.front();
+        }
+        else {
+            child->keys.insert(child->keys.begin(), parent->keys[idx - 1]);
+            child->children.insert(child->children.begin(), left->children.back());
+            parent->keys[idx - 1] = left->keys.back();
+            left->keys.pop_back();
+            left->children.pop_back();
+        }
+        return;
+    }
+
+    // Borrow from the right sibling
+    if (right && right->keys.size() > minKeys()) {
+        if (child->isLeaf) {
+            child->keys.push_back(right->keys.front());
+            child->values.push_back(right->values.front());
+            right->keys.erase(right->keys.begin());
+            right->values.erase(right->values.begin());
+            parent->keys[idx] = right->keys.front();
+        }
+        else {
+            child->keys.push_back(parent->keys[idx]);
+            child->children.push_back(right->children.front());
+            parent->keys[idx] = right->keys.front();
+            right->keys.erase(right->keys.begin());
+            right->children.erase(right->children.begin());
+        }
+        return;
+    }
+
+    // Merge with a sibling, always folding the right node into the left one
+    if (!right) {
+        right = child;
+        idx--;
+    }
+    Node* target = parent->children[idx];
+    if (target->isLeaf) {
+        target->keys.insert(target->keys.end(), right->keys.begin(), right->keys.end());
+        target->values.insert(target->values.end(), right->values.begin(), right->values.end());
+        target->next = right->next;
+        if (right->next) {
+            right->next->prev = target;
+        }
+        else {
+            tail = target;
+        }
+    }
+    else {
+        target->keys.push_back(parent->keys[idx]);
+        target->keys.insert(target->keys.end(), right->keys.begin(), right->keys.end());
+        target->children.insert(target->children.end(), right->children.begin(), right->children.end());
+        right->children.clear();
+    }
+    parent->keys.erase(parent->keys.begin() + idx);
+    parent->children.erase(parent->children.begin() + idx + 1);
+    delete right;
+}
+
+template<typename K, typename V>
+bool BPlusTree<K, V>::bulkLoad(std::vector<std::pair<K, V>> entries) {
+    auto byKey = [](const std::pair<K, V>& a, const std::pair<K, V>& b) { return a.first < b.first; };
+    if (!std::is_sorted(entries.begin(), entries.end(), byKey)) {
+        std::sort(entries.begin(), entries.end(), byKey);
+    }
+    for (size_t i = 1; i < entries.size(); ++i) {
+        if (!(entries[i - 1].first < entries[i].first)) {
+            return false;
+        }
+    }
+
+    root->destroyChildren();
+    delete root;
+    count = entries.size();
+
+    // Spread the entries evenly over as few leaves as possible and chain them
+    size_t leafCount = std::max<size_t>(1, (entries.size() + maxKeys() - 1) / maxKeys());
+    std::vector<Node*> level;
+    std::vector<K> lowKeys; // Smallest key below each node of the level
+    level.reserve(leafCount);
+    lowKeys.reserve(leafCount);
+    size_t entry = 0;
+    for (size_t i = 0; i < leafCount; ++i) {
+        size_t size = entries.size() / leafCount + (i < entries.size() % leafCount ? 1 : 0);
+        Node* leaf = new Node(true);
+        leaf->keys.reserve(size);
+        leaf->values.reserve(size);
+        for (size_t k = 0; k < size; ++k, ++entry) {
+            leaf->keys.push_back(std::move(entries[entry].first));
+            leaf->values.push_back(std::move(entries[entry].second));
+        }
+        if (!level.empty()) {
+            leaf->prev = level.back();
+            level.back()->next = leaf;
+        }
+        lowKeys.push_back(size > 0 ? leaf->keys.front() : K());
+        level.push_back(leaf);
+    }
+    head = level.front();
+    tail = level.back();
+
+    // Group the nodes of each level under evenly filled parents, the separator in front
+    // of every child but the first is the smallest key below that child
+    while (level.size() > 1) {
+        size_t parentCount = (level.size() + maxKeys()) / (maxKeys() + 1);
+        std::vector<Node*> parents;
+        std::vector<K> parentLowKeys;
+        parents.reserve(parentCount);
+        parentLowKeys.reserve(parentCount);
+        size_t child = 0;
+        for (size_t i = 0; i < parentCount; ++i) {
+            size_t size = level.size() / parentCount + (i < level.size() % parentCount ? 1 : 0);
+            Node* parent = new Node(false);
+            parent->keys.reserve(size - 1);
+            parent->children.assign(level.begin() + child, level.begin() + child + size);
+            for (size_t k = child + 1; k < child + size; ++k) {
+                parent->keys.push_back(lowKeys[k]);
+            }
+            parentLowKeys.push_back(lowKeys[child]);
+            parents.push_back(parent);
+            child += size;
+        }
+        level = std::move(parents);
+        lowKeys = std::move(parentLowKeys);
+    }
+    root = level.front();
+    return true;
+}
+
+template<typename K, typename V>
+V* BPlusTree<K, V>::find(const K& key) const {
+    Node* leaf = findLeaf(key);
+    size_t pos = leaf->lowerBound(key);
+    if (pos < leaf->keys.size() && leaf->keys[pos] == key) {
+        return &leaf->values[pos];
+    }
+    return nullptr;
+}
+
+template<typename K, typename V>
+typename BPlusTree<K, V>::iterator BPlusTree<K, V>::lower_bound(const K& key) const {
+    Node* leaf = findLeaf(key);
+    size_t pos = leaf->lowerBound(key);
+    return iterator(this, leaf, pos);
+}
+
+template<typename K, typename V>
+typename BPlusTree<K, V>::iterator BPlusTree<K, V>::upper_bound(const K& key) const {
+    Node* leaf = findLeaf(key);
+    size_t pos = leaf->childIndex(key);
+    return iterator(this, leaf, pos);
+}
+
+template<typename K, typename V>
+void BPlusTree<K, V>::linkLeaves() {
+    // Walk the leaves left to right with an explicit stack and rebuild the sibling chain
+    std::vector<Node*> stack = { root };
+    Node* previous = nullptr;
+    head = nullptr;
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        if (!node->isLeaf) {
+            for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+                stack.push_back(*it);
+            }
+            continue;
+        }
+        node->prev = previous;
+        node->next = nullptr;
+        if (previous) {
+            previous->next = node;
+        }
+        else {
+            head = node;
+        }
+        previous = node;
+    }
+    tail = previous;
+}
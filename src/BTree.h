@@ -1,37 +1,92 @@
-#include <vector>
+// BTree.h
+#pragma once
 #include <algorithm>
-#include <fstream>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "NodePool.h"
+#include "NodeSearch.h"
+
+// Nodes are padded to whole cache lines and by default sized to one 4 KiB page
+constexpr size_t BTREE_CACHE_LINE = 64;
+constexpr size_t BTREE_DEFAULT_NODE_BYTES = 4096;
+
+// Minimum degree that fills a node of nodeBytes with keys, values and child pointers
+template<typename K, typename V>
+int defaultBTreeDegree(size_t nodeBytes = BTREE_DEFAULT_NODE_BYTES) {
+    // One cache line is left for the node header and alignment padding
+    size_t perKey = sizeof(K) + sizeof(V) + sizeof(void*);
+    int maxKeys = static_cast<int>((nodeBytes - BTREE_CACHE_LINE) / perKey);
+    return std::max(2, (maxKeys + 1) / 2);
+}
 
 // BTreeNode class
-template<typename T>
+// Every key carries a value (for table indexes, the RowId of the row holding the key).
+// Keys, values and child pointers live in fixed-capacity arrays placed directly after
+// the node header in a single cache-line-aligned block, so a node is one block of
+// memory and the keys of a node are contiguous. Blocks come from the tree's pools.
+template<typename K, typename V>
 class BTreeNode {
 public:
     bool isLeaf;
-    std::vector<T> keys;
-    std::vector<BTreeNode*> children;
+    int n;                // Number of keys in use
+    K* keys;              // 2t - 1 slots
+    V* values;            // 2t - 1 slots
+    BTreeNode** children; // 2t slots, nullptr for leaves
+
+    // Per-tree node storage, leaves and interior nodes have different block sizes
+    struct Pools {
+        int t;
+        NodePool leaves;
+        NodePool interior;
+
+        explicit Pools(int t) : t(t), leaves(allocationSize(true, t)), interior(allocationSize(false, t)) {}
+
+        NodePool& get(bool leaf) {
+            return leaf ? leaves : interior;
+        }
+    };
 
-    BTreeNode(bool leaf) : isLeaf(leaf) {}
+    // Allocate a node with room for the keys of a tree of minimum degree pools.t
+    static BTreeNode* create(bool leaf, Pools& pools);
 
-    // Insert a new key into the B-Tree node
-    void insertNonFull(const T& key, int t);
+    // Return a node allocated with create to its pool, children are not touched
+    static void destroy(BTreeNode* node, Pools& pools);
+
+    // Bytes used by one node of a tree of minimum degree t
+    static size_t allocationSize(bool leaf, int t);
+
+    // Index of the first key that is not less than key (vectorized for integer keys)
+    int lowerBound(const K& key) const {
+        return NodeSearch<K>::lowerBound(keys, n, key);
+    }
+
+    // Insert a new entry into the B-Tree node
+    void insertNonFull(const K& key, const V& value, Pools& pools);
 
     // Split the child node
-    void splitChild(int i, BTreeNode* y, int t);
+    void splitChild(int i, BTreeNode* y, Pools& pools);
 
     // Search for a key in the B-Tree node
-    BTreeNode* search(const T& key);
+    BTreeNode* search(const K& key);
 
-    // Remove a key from the B-Tree node
-    void remove(const T& key, int t);
+    // Find the value stored for a key in this subtree
+    V* find(const K& key);
+
+    // Remove a key from the B-Tree node, returns false if it was not found
+    bool remove(const K& key, Pools& pools);
 
     // Find the predecessor of a key
-    T getPredecessor(int idx);
+    std::pair<K, V> getPredecessor(int idx);
 
     // Find the successor of a key
-    T getSuccessor(int idx);
+    std::pair<K, V> getSuccessor(int idx);
 
     // Fill the child node
-    void fill(int idx, int t);
+    void fill(int idx, Pools& pools);
 
     // Borrow a key from the previous child
     void borrowFromPrev(int idx);
@@ -40,34 +95,93 @@ public:
     void borrowFromNext(int idx);
 
     // Merge the child nodes
-    void merge(int idx);
+    void merge(int idx, Pools& pools);
+
+    // Deep copy of the subtree rooted at this node, allocated from pools
+    BTreeNode* clone(Pools& pools) const;
 
-    // Serialize the B-Tree node
-    void serialize(std::ofstream& file) const;
+    // Free every node below this one
+    void destroyChildren(Pools& pools);
 
-    // Deserialize the B-Tree node
-    void deserialize(std::ifstream& file);
+    // Call fn(key, value) for the entries of this subtree in range, in key order.
+    // Returns false once a key above high was reached or fn returned false, so the caller stops too.
+    template<typename Fn>
+    bool scanRange(const K* low, const K* high, Fn& fn) const {
+        for (int i = low ? lowerBound(*low) : 0; i < n; ++i) {
+            if (!isLeaf && !children[i]->scanRange(low, high, fn)) {
+                return false;
+            }
+            if (high && *high < keys[i]) {
+                return false;
+            }
+            if (!fn(keys[i], values[i])) {
+                return false;
+            }
+        }
+        return isLeaf || children[n]->scanRange(low, high, fn);
+    }
+
+private:
+    struct Layout {
+        size_t keysOffset;
+        size_t valuesOffset;
+        size_t childrenOffset;
+        size_t size;
+    };
+
+    static size_t alignUp(size_t offset, size_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    static Layout layout(bool leaf, int t);
+
+    BTreeNode(bool leaf) : isLeaf(leaf), n(0), keys(nullptr), values(nullptr), children(nullptr) {}
 };
 
 // BTree class
-template<typename T>
+// An ordered map from unique keys to values.
+// Nodes are allocated from per-tree pools, so dropping or copying a whole tree
+// works on a few large slabs instead of one heap block per node.
+template<typename K, typename V>
 class BTree {
 private:
-    BTreeNode<T>* root;
+    using Node = BTreeNode<K, V>;
+
+    typename Node::Pools pools;
+    Node* root;
     int t; // Minimum degree (defines the range for number of keys)
+    size_t count;
+
+    // Destroy every node and hand the slabs back, trivially destructible entries skip the walk
+    void releaseNodes() {
+        if (!std::is_trivially_destructible<K>::value || !std::is_trivially_destructible<V>::value) {
+            root->destroyChildren(pools);
+            Node::destroy(root, pools);
+        }
+        pools.leaves.release();
+        pools.interior.release();
+        root = nullptr;
+    }
+
+    // Clone the nodes of other into pools sized up front for its node count
+    void copyNodes(const BTree& other) {
+        pools.leaves.reserve(other.pools.leaves.liveBlocks());
+        pools.interior.reserve(other.pools.interior.liveBlocks());
+        root = other.root->clone(pools);
+    }
 
 public:
-    // Default constructor
-    BTree() : root(nullptr), t(0) {}
+    // Default constructor, nodes fill one page
+    BTree() : BTree(defaultBTreeDegree<K, V>()) {}
 
     // Parameterized constructor
-    BTree(int _t) : t(_t) {
-        root = new BTreeNode<T>(true);
+    BTree(int _t) : pools(std::max(2, _t)), t(std::max(2, _t)), count(0) {
+        root = Node::create(true, pools);
     }
 
     // Copy constructor
-    BTree(const BTree& other) : t(other.t) {
-        root = new BTreeNode<T>(*other.root);
+    BTree(const BTree& other) : pools(other.t), t(other.t), count(other.count) {
+        copyNodes(other);
     }
 
     // Copy assignment operator
@@ -75,84 +189,188 @@ public:
         if (this == &other) {
             return *this;
         }
+        releaseNodes();
+        if (t != other.t) {
+            pools = typename Node::Pools(other.t);
+        }
         t = other.t;
-        delete root;
-        root = new BTreeNode<T>(*other.root);
+        count = other.count;
+        copyNodes(other);
         return *this;
     }
 
+    ~BTree() {
+        releaseNodes();
+    }
+
     // Method to copy the contents of one BTree to another
     void copyTo(BTree& other) const {
-        other.t = t;
-        other.root = new BTreeNode<T>(*root);
+        other = *this;
     }
 
-    // Insert a new key into the B-Tree
-    void insert(const T& key);
+    // Insert a new entry into the B-Tree (keys are expected to be unique)
+    void insert(const K& key, const V& value);
 
     // Search for a key in the B-Tree
-    BTreeNode<T>* search(const T& key);
+    BTreeNode<K, V>* search(const K& key);
+
+    // Find the value stored for a key, nullptr if the key is absent
+    V* find(const K& key) {
+        return root->find(key);
+    }
 
-    // Remove a key from the B-Tree
-    void remove(const T& key);
+    const V* find(const K& key) const {
+        return root->find(key);
+    }
 
-    // Serialize the B-Tree
-    void serialize(std::ofstream& file) const;
+    bool contains(const K& key) const {
+        return find(key) != nullptr;
+    }
 
-    // Deserialize the B-Tree
-    void deserialize(std::ifstream& file);
+    // Call fn(key, value) for every entry with low <= key <= high, in key order, until fn
+    // returns false. A null bound leaves that end of the range open.
+    template<typename Fn>
+    void scanRange(const K* low, const K* high, Fn fn) const {
+        root->scanRange(low, high, fn);
+    }
+
+    // Remove a key from the B-Tree, returns false if it was not found
+    bool remove(const K& key);
+
+    // Replace the contents with entries, building packed nodes bottom-up instead of
+    // inserting one key at a time. Unsorted input is sorted first. Returns false and
+    // leaves the tree unchanged if a key appears twice.
+    bool bulkLoad(std::vector<std::pair<K, V>> entries);
+
+    // Remove every entry
+    void clear() {
+        releaseNodes();
+        root = Node::create(true, pools);
+        count = 0;
+    }
+
+    // Number of entries in the tree
+    size_t size() const {
+        return count;
+    }
 
     // Get the degree of the B-Tree
     int getDegree() const {
         return t;
     }
+
+    // Maximum number of children of an interior node
+    int getFanout() const {
+        return 2 * t;
+    }
+
+    // Bytes reserved for nodes, including free blocks kept for reuse
+    size_t memoryUsage() const {
+        return pools.leaves.memoryUsage() + pools.interior.memoryUsage();
+    }
 };
 
-template<typename T>
-void BTreeNode<T>::insertNonFull(const T& key, int t) {
-    int i = keys.size() - 1;
+template<typename K, typename V>
+typename BTreeNode<K, V>::Layout BTreeNode<K, V>::layout(bool leaf, int t) {
+    size_t capacity = static_cast<size_t>(2 * t - 1);
+    Layout result;
+    size_t offset = alignUp(sizeof(BTreeNode), alignof(K));
+    result.keysOffset = offset;
+    offset = alignUp(offset + capacity * sizeof(K), alignof(V));
+    result.valuesOffset = offset;
+    offset += capacity * sizeof(V);
+    result.childrenOffset = 0;
+    if (!leaf) {
+        offset = alignUp(offset, alignof(BTreeNode*));
+        result.childrenOffset = offset;
+        offset += (capacity + 1) * sizeof(BTreeNode*);
+    }
+    result.size = alignUp(offset, BTREE_CACHE_LINE);
+    return result;
+}
+
+template<typename K, typename V>
+size_t BTreeNode<K, V>::allocationSize(bool leaf, int t) {
+    return layout(leaf, t).size;
+}
+
+template<typename K, typename V>
+BTreeNode<K, V>* BTreeNode<K, V>::create(bool leaf, Pools& pools) {
+    static_assert(alignof(K) <= BTREE_CACHE_LINE && alignof(V) <= BTREE_CACHE_LINE, "Key alignment exceeds a cache line");
+    static_assert(BTREE_CACHE_LINE <= NodePool::ALIGNMENT, "Node pool blocks are not cache-line aligned");
+    Layout nodeLayout = layout(leaf, pools.t);
+    size_t capacity = static_cast<size_t>(2 * pools.t - 1);
+    char* memory = static_cast<char*>(pools.get(leaf).allocate());
+
+    BTreeNode* node = new (memory) BTreeNode(leaf);
+    node->keys = reinterpret_cast<K*>(memory + nodeLayout.keysOffset);
+    node->values = reinterpret_cast<V*>(memory + nodeLayout.valuesOffset);
+    std::uninitialized_value_construct_n(node->keys, capacity);
+    std::uninitialized_value_construct_n(node->values, capacity);
+    if (!leaf) {
+        node->children = reinterpret_cast<BTreeNode**>(memory + nodeLayout.childrenOffset);
+        std::uninitialized_fill_n(node->children, capacity + 1, nullptr);
+    }
+    return node;
+}
+
+template<typename K, typename V>
+void BTreeNode<K, V>::destroy(BTreeNode* node, Pools& pools) {
+    size_t capacity = static_cast<size_t>(2 * pools.t - 1);
+    bool leaf = node->isLeaf;
+    std::destroy_n(node->keys, capacity);
+    std::destroy_n(node->values, capacity);
+    node->~BTreeNode();
+    pools.get(leaf).deallocate(node);
+}
+
+template<typename K, typename V>
+void BTreeNode<K, V>::insertNonFull(const K& key, const V& value, Pools& pools) {
+    int t = pools.t;
+    int i = lowerBound(key);
     if (isLeaf) {
-        keys.push_back(key);
-        std::sort(keys.begin(), keys.end());
+        std::move_backward(keys + i, keys + n, keys + n + 1);
+        std::move_backward(values + i, values + n, values + n + 1);
+        keys[i] = key;
+        values[i] = value;
+        n++;
     }
     else {
-        while (i >= 0 && key < keys[i]) {
-            i--;
-        }
-        i++;
-        if (children[i]->keys.size() == 2 * t - 1) {
-            splitChild(i, children[i], t);
-            if (key > keys[i]) {
+        if (children[i]->n == 2 * t - 1) {
+            splitChild(i, children[i], pools);
+            if (keys[i] < key) {
                 i++;
             }
         }
-        children[i]->insertNonFull(key, t);
+        children[i]->insertNonFull(key, value, pools);
     }
 }
 
-template<typename T>
-void BTreeNode<T>::splitChild(int i, BTreeNode* y, int t) {
-    BTreeNode* z = new BTreeNode(y->isLeaf);
-    for (int j = 0; j < t - 1; j++) {
-        z->keys.push_back(y->keys[j + t]);
-    }
+template<typename K, typename V>
+void BTreeNode<K, V>::splitChild(int i, BTreeNode* y, Pools& pools) {
+    int t = pools.t;
+    BTreeNode* z = create(y->isLeaf, pools);
+    z->n = t - 1;
+    std::move(y->keys + t, y->keys + 2 * t - 1, z->keys);
+    std::move(y->values + t, y->values + 2 * t - 1, z->values);
     if (!y->isLeaf) {
-        for (int j = 0; j < t; j++) {
-            z->children.push_back(y->children[j + t]);
-        }
+        std::copy(y->children + t, y->children + 2 * t, z->children);
     }
-    y->keys.resize(t - 1);
-    children.insert(children.begin() + i + 1, z);
-    keys.insert(keys.begin() + i, y->keys[t - 1]);
+    y->n = t - 1;
+
+    std::copy_backward(children + i + 1, children + n + 1, children + n + 2);
+    children[i + 1] = z;
+    std::move_backward(keys + i, keys + n, keys + n + 1);
+    std::move_backward(values + i, values + n, values + n + 1);
+    keys[i] = std::move(y->keys[t - 1]);
+    values[i] = std::move(y->values[t - 1]);
+    n++;
 }
 
-template<typename T>
-BTreeNode<T>* BTreeNode<T>::search(const T& key) {
-    int i = 0;
-    while (i < keys.size() && key > keys[i]) {
-        i++;
-    }
-    if (i < keys.size() && keys[i] == key) {
+template<typename K, typename V>
+BTreeNode<K, V>* BTreeNode<K, V>::search(const K& key) {
+    int i = lowerBound(key);
+    if (i < n && keys[i] == key) {
         return this;
     }
     if (isLeaf) {
@@ -161,208 +379,266 @@ BTreeNode<T>* BTreeNode<T>::search(const T& key) {
     return children[i]->search(key);
 }
 
-template<typename T>
-void BTree<T>::insert(const T& key) {
-    if (root->keys.size() == 2 * t - 1) {
-        BTreeNode<T>* s = new BTreeNode<T>(false);
-        s->children.push_back(root);
-        s->splitChild(0, root, t);
-        root = s;
+template<typename K, typename V>
+V* BTreeNode<K, V>::find(const K& key) {
+    BTreeNode* node = this;
+    while (true) {
+        int i = node->lowerBound(key);
+        if (i < node->n && node->keys[i] == key) {
+            return &node->values[i];
+        }
+        if (node->isLeaf) {
+            return nullptr;
+        }
+        node = node->children[i];
     }
-    root->insertNonFull(key, t);
 }
 
-template<typename T>
-BTreeNode<T>* BTree<T>::search(const T& key) {
-    return root->search(key);
+template<typename K, typename V>
+void BTree<K, V>::insert(const K& key, const V& value) {
+    if (root->n == 2 * t - 1) {
+        BTreeNode<K, V>* s = BTreeNode<K, V>::create(false, pools);
+        s->children[0] = root;
+        s->splitChild(0, root, pools);
+        root = s;
+    }
+    root->insertNonFull(key, value, pools);
+    count++;
 }
 
-template<typename T>
-void BTree<T>::remove(const T& key) {
-    if (!root) {
-        return;
+template<typename K, typename V>
+bool BTree<K, V>::bulkLoad(std::vector<std::pair<K, V>> entries) {
+    auto byKey = [](const std::pair<K, V>& a, const std::pair<K, V>& b) { return a.first < b.first; };
+    if (!std::is_sorted(entries.begin(), entries.end(), byKey)) {
+        std::sort(entries.begin(), entries.end(), byKey);
     }
-    root->remove(key, t);
-    if (root->keys.size() == 0) {
-        BTreeNode<T>* tmp = root;
-        if (root->isLeaf) {
-            root = nullptr;
+    for (size_t i = 1; i < entries.size(); ++i) {
+        if (!(entries[i - 1].first < entries[i].first)) {
+            return false;
         }
-        else {
-            root = root->children[0];
-        }
-        delete tmp;
     }
-}
 
-template<typename T>
-void BTreeNode<T>::remove(const T& key, int t) {
-    int idx = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
-    if (idx < keys.size() && keys[idx] == key) {
-        if (isLeaf) {
-            keys.erase(keys.begin() + idx);
-        }
-        else {
-            if (children[idx]->keys.size() >= t) {
-                T pred = getPredecessor(idx);
-                keys[idx] = pred;
-                children[idx]->remove(pred, t);
+    releaseNodes();
+    count = entries.size();
+
+    // Each pass spreads the entries evenly over as few nodes as possible with one entry
+    // left between neighbours. Those separators and the new nodes become the entries
+    // and children of the level above, until a level fits in a single root.
+    size_t maxKeys = static_cast<size_t>(2 * t - 1);
+    std::vector<Node*> below;
+    bool leaf = true;
+    while (true) {
+        size_t nodeCount = (entries.size() + maxKeys + 1) / (maxKeys + 1);
+        size_t nodeKeys = entries.size() - (nodeCount - 1);
+        std::vector<Node*> level;
+        std::vector<std::pair<K, V>> separators;
+        level.reserve(nodeCount);
+        separators.reserve(nodeCount - 1);
+        pools.get(leaf).reserve(nodeCount);
+
+        size_t entry = 0;
+        size_t child = 0;
+        for (size_t i = 0; i < nodeCount; ++i) {
+            Node* node = Node::create(leaf, pools);
+            node->n = static_cast<int>(nodeKeys / nodeCount + (i < nodeKeys % nodeCount ? 1 : 0));
+            for (int k = 0; k < node->n; ++k, ++entry) {
+                node->keys[k] = std::move(entries[entry].first);
+                node->values[k] = std::move(entries[entry].second);
             }
-            else if (children[idx + 1]->keys.size() >= t) {
-                T succ = getSuccessor(idx);
-                keys[idx] = succ;
-                children[idx + 1]->remove(succ, t);
+            if (!leaf) {
+                std::copy(below.begin() + child, below.begin() + child + node->n + 1, node->children);
+                child += node->n + 1;
             }
-            else {
-                merge(idx);
-                children[idx]->remove(key, t);
+            level.push_back(node);
+            if (i + 1 < nodeCount) {
+                separators.push_back(std::move(entries[entry++]));
             }
         }
+
+        if (nodeCount == 1) {
+            root = level.front();
+            return true;
+        }
+        entries = std::move(separators);
+        below = std::move(level);
+        leaf = false;
     }
-    else {
+}
+
+template<typename K, typename V>
+BTreeNode<K, V>* BTree<K, V>::search(const K& key) {
+    return root->search(key);
+}
+
+template<typename K, typename V>
+bool BTree<K, V>::remove(const K& key) {
+    bool removed = root->remove(key, pools);
+    if (removed) {
+        count--;
+    }
+    // Shrink the tree when the root runs out of keys, an empty leaf stays as the root
+    if (root->n == 0 && !root->isLeaf) {
+        BTreeNode<K, V>* tmp = root;
+        root = root->children[0];
+        BTreeNode<K, V>::destroy(tmp, pools);
+    }
+    return removed;
+}
+
+template<typename K, typename V>
+bool BTreeNode<K, V>::remove(const K& key, Pools& pools) {
+    int t = pools.t;
+    int idx = lowerBound(key);
+    if (idx < n && keys[idx] == key) {
         if (isLeaf) {
-            return;
-        }
-        bool flag = (idx == keys.size());
-        if (children[idx]->keys.size() < t) {
-            fill(idx,t);
+            std::move(keys + idx + 1, keys + n, keys + idx);
+            std::move(values + idx + 1, values + n, values + idx);
+            n--;
+            return true;
         }
-        if (flag && idx > keys.size()) {
-            children[idx - 1]->remove(key, t);
+        if (children[idx]->n >= t) {
+            std::pair<K, V> pred = getPredecessor(idx);
+            keys[idx] = pred.first;
+            values[idx] = pred.second;
+            return children[idx]->remove(pred.first, pools);
         }
-        else {
-            children[idx]->remove(key, t);
+        if (children[idx + 1]->n >= t) {
+            std::pair<K, V> succ = getSuccessor(idx);
+            keys[idx] = succ.first;
+            values[idx] = succ.second;
+            return children[idx + 1]->remove(succ.first, pools);
         }
+        merge(idx, pools);
+        return children[idx]->remove(key, pools);
     }
+    if (isLeaf) {
+        return false;
+    }
+    bool flag = (idx == n);
+    if (children[idx]->n < t) {
+        fill(idx, pools);
+    }
+    if (flag && idx > n) {
+        return children[idx - 1]->remove(key, pools);
+    }
+    return children[idx]->remove(key, pools);
 }
 
-template<typename T>
-T BTreeNode<T>::getPredecessor(int idx) {
+template<typename K, typename V>
+std::pair<K, V> BTreeNode<K, V>::getPredecessor(int idx) {
     BTreeNode* cur = children[idx];
     while (!cur->isLeaf) {
-        cur = cur->children[cur->keys.size()];
+        cur = cur->children[cur->n];
     }
-    return cur->keys[cur->keys.size() - 1];
+    return { cur->keys[cur->n - 1], cur->values[cur->n - 1] };
 }
 
-template<typename T>
-T BTreeNode<T>::getSuccessor(int idx) {
+template<typename K, typename V>
+std::pair<K, V> BTreeNode<K, V>::getSuccessor(int idx) {
     BTreeNode* cur = children[idx + 1];
     while (!cur->isLeaf) {
         cur = cur->children[0];
     }
-    return cur->keys[0];
+    return { cur->keys[0], cur->values[0] };
 }
 
-template<typename T>
-void BTreeNode<T>::fill(int idx, int t) {
-    if (idx != 0 && children[idx - 1]->keys.size() >= t) {
+template<typename K, typename V>
+void BTreeNode<K, V>::fill(int idx, Pools& pools) {
+    int t = pools.t;
+    if (idx != 0 && children[idx - 1]->n >= t) {
         borrowFromPrev(idx);
     }
-    else if (idx != keys.size() && children[idx + 1]->keys.size() >= t) {
+    else if (idx != n && children[idx + 1]->n >= t) {
         borrowFromNext(idx);
     }
     else {
-        if (idx != keys.size()) {
-            merge(idx);
+        if (idx != n) {
+            merge(idx, pools);
         }
         else {
-            merge(idx - 1);
+            merge(idx - 1, pools);
         }
     }
 }
 
-template<typename T>
-void BTreeNode<T>::borrowFromPrev(int idx) {
+template<typename K, typename V>
+void BTreeNode<K, V>::borrowFromPrev(int idx) {
     BTreeNode* child = children[idx];
     BTreeNode* sibling = children[idx - 1];
-    child->keys.insert(child->keys.begin(), keys[idx - 1]);
+    std::move_backward(child->keys, child->keys + child->n, child->keys + child->n + 1);
+    std::move_backward(child->values, child->values + child->n, child->values + child->n + 1);
+    child->keys[0] = std::move(keys[idx - 1]);
+    child->values[0] = std::move(values[idx - 1]);
     if (!child->isLeaf) {
-        child->children.insert(child->children.begin(), sibling->children[sibling->keys.size()]);
-    }
-    keys[idx - 1] = sibling->keys[sibling->keys.size() - 1];
-    sibling->keys.pop_back();
-    if (!sibling->isLeaf) {
-        sibling->children.pop_back();
+        std::copy_backward(child->children, child->children + child->n + 1, child->children + child->n + 2);
+        child->children[0] = sibling->children[sibling->n];
     }
+    keys[idx - 1] = std::move(sibling->keys[sibling->n - 1]);
+    values[idx - 1] = std::move(sibling->values[sibling->n - 1]);
+    child->n++;
+    sibling->n--;
 }
 
-template<typename T>
-void BTreeNode<T>::borrowFromNext(int idx) {
+template<typename K, typename V>
+void BTreeNode<K, V>::borrowFromNext(int idx) {
     BTreeNode* child = children[idx];
     BTreeNode* sibling = children[idx + 1];
-    child->keys.push_back(keys[idx]);
+    child->keys[child->n] = std::move(keys[idx]);
+    child->values[child->n] = std::move(values[idx]);
     if (!child->isLeaf) {
-        child->children.push_back(sibling->children[0]);
-    }
-    keys[idx] = sibling->keys[0];
-    sibling->keys.erase(sibling->keys.begin());
-    if (!sibling->isLeaf) {
-        sibling->children.erase(sibling->children.begin());
-    }
+        child->children[child->n + 1] = sibling->children[0];
+        std::copy(sibling->children + 1, sibling->children + sibling->n + 1, sibling->children);
+    }
+    keys[idx] = std::move(sibling->keys[0]);
+    values[idx] = std::move(sibling->values[0]);
+    std::move(sibling->keys + 1, sibling->keys + sibling->n, sibling->keys);
+    std::move(sibling->values + 1, sibling->values + sibling->n, sibling->values);
+    child->n++;
+    sibling->n--;
 }
 
-template<typename T>
-void BTreeNode<T>::merge(int idx) {
+template<typename K, typename V>
+void BTreeNode<K, V>::merge(int idx, Pools& pools) {
     BTreeNode* child = children[idx];
     BTreeNode* sibling = children[idx + 1];
-    child->keys.push_back(keys[idx]);
-    for (int i = 0; i < sibling->keys.size(); ++i) {
-        child->keys.push_back(sibling->keys[i]);
-    }
+    child->keys[child->n] = std::move(keys[idx]);
+    child->values[child->n] = std::move(values[idx]);
+    std::move(sibling->keys, sibling->keys + sibling->n, child->keys + child->n + 1);
+    std::move(sibling->values, sibling->values + sibling->n, child->values + child->n + 1);
     if (!child->isLeaf) {
-        for (int i = 0; i < sibling->children.size(); ++i) {
-            child->children.push_back(sibling->children[i]);
-        }
+        std::copy(sibling->children, sibling->children + sibling->n + 1, child->children + child->n + 1);
     }
-    keys.erase(keys.begin() + idx);
-    children.erase(children.begin() + idx + 1);
-    delete sibling;
+    child->n += sibling->n + 1;
+
+    std::move(keys + idx + 1, keys + n, keys + idx);
+    std::move(values + idx + 1, values + n, values + idx);
+    std::copy(children + idx + 2, children + n + 1, children + idx + 1);
+    n--;
+    destroy(sibling, pools);
 }
 
-template<typename T>
-void BTreeNode<T>::serialize(std::ofstream& file) const {
-    file.write(reinterpret_cast<const char*>(&isLeaf), sizeof(isLeaf));
-    size_t keysSize = keys.size();
-    file.write(reinterpret_cast<const char*>(&keysSize), sizeof(keysSize));
-    for (const auto& key : keys) {
-        file.write(reinterpret_cast<const char*>(&key), sizeof(key));
-    }
+template<typename K, typename V>
+BTreeNode<K, V>* BTreeNode<K, V>::clone(Pools& pools) const {
+    BTreeNode* copy = create(isLeaf, pools);
+    copy->n = n;
+    std::copy(keys, keys + n, copy->keys);
+    std::copy(values, values + n, copy->values);
     if (!isLeaf) {
-        size_t childrenSize = children.size();
-        file.write(reinterpret_cast<const char*>(&childrenSize), sizeof(childrenSize));
-        for (const auto& child : children) {
-            child->serialize(file);
+        for (int i = 0; i <= n; ++i) {
+            copy->children[i] = children[i]->clone(pools);
         }
     }
+    return copy;
 }
 
-template<typename T>
-void BTreeNode<T>::deserialize(std::ifstream& file) {
-    file.read(reinterpret_cast<char*>(&isLeaf), sizeof(isLeaf));
-    size_t keysSize;
-    file.read(reinterpret_cast<char*>(&keysSize), sizeof(keysSize));
-    keys.resize(keysSize);
-    for (auto& key : keys) {
-        file.read(reinterpret_cast<char*>(&key), sizeof(key));
+template<typename K, typename V>
+void BTreeNode<K, V>::destroyChildren(Pools& pools) {
+    if (isLeaf) {
+        return;
     }
-    if (!isLeaf) {
-        size_t childrenSize;
-        file.read(reinterpret_cast<char*>(&childrenSize), sizeof(childrenSize));
-        children.resize(childrenSize);
-        for (auto& child : children) {
-            child = new BTreeNode(isLeaf);
-            child->deserialize(file);
-        }
+    for (int i = 0; i <= n; ++i) {
+        children[i]->destroyChildren(pools);
+        destroy(children[i], pools);
+        children[i] = nullptr;
     }
 }
-
-template<typename T>
-void BTree<T>::serialize(std::ofstream& file) const {
-    root->serialize(file);
-}
-
-template<typename T>
-void BTree<T>::deserialize(std::ifstream& file) {
-    root->deserialize(file);
-}
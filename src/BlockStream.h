@@ -0,0 +1,263 @@
+// BlockStream.h
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "Checksum.h"
+
+// Fixed-width little-endian encoding, independent of the host byte order and type sizes.
+// The helpers go straight to the stream buffer, a per-field sentry would dominate the cost of
+// writing small values. A short transfer sets the stream state as the stream functions would.
+void writeRaw(std::ostream& out, const void* data, size_t size) {
+    if (out.rdbuf()->sputn(static_cast<const char*>(data), static_cast<std::streamsize>(size)) != static_cast<std::streamsize>(size)) {
+        out.setstate(std::ios::badbit);
+    }
+}
+
+void readRaw(std::istream& in, void* data, size_t size) {
+    if (in.rdbuf()->sgetn(static_cast<char*>(data), static_cast<std::streamsize>(size)) != static_cast<std::streamsize>(size)) {
+        in.setstate(std::ios::eofbit | std::ios::failbit);
+    }
+}
+
+void writeU8(std::ostream& out, uint8_t value) {
+    writeRaw(out, &value, 1);
+}
+
+void writeU32(std::ostream& out, uint32_t value) {
+    char bytes[4];
+    for (int i = 0; i < 4; ++i) {
+        bytes[i] = static_cast<char>(value >> (8 * i));
+    }
+    writeRaw(out, bytes, sizeof(bytes));
+}
+
+void writeU64(std::ostream& out, uint64_t value) {
+    char bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<char>(value >> (8 * i));
+    }
+    writeRaw(out, bytes, sizeof(bytes));
+}
+
+void writeI32(std::ostream& out, int32_t value) {
+    writeU32(out, static_cast<uint32_t>(value));
+}
+
+void writeI64(std::ostream& out, int64_t value) {
+    writeU64(out, static_cast<uint64_t>(value));
+}
+
+void writeF32(std::ostream& out, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    writeU32(out, bits);
+}
+
+// Size-prefixed byte string
+void writeBytes(std::ostream& out, const void* data, size_t size) {
+    writeU64(out, size);
+    writeRaw(out, data, size);
+}
+
+uint8_t readU8(std::istream& in) {
+    uint8_t byte = 0;
+    readRaw(in, &byte, 1);
+    return byte;
+}
+
+uint32_t readU32(std::istream& in) {
+    unsigned char bytes[4] = {};
+    readRaw(in, bytes, sizeof(bytes));
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= uint32_t(bytes[i]) << (8 * i);
+    }
+    return value;
+}
+
+uint64_t readU64(std::istream& in) {
+    unsigned char bytes[8] = {};
+    readRaw(in, bytes, sizeof(bytes));
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= uint64_t(bytes[i]) << (8 * i);
+    }
+    return value;
+}
+
+int32_t readI32(std::istream& in) {
+    return static_cast<int32_t>(readU32(in));
+}
+
+int64_t readI64(std::istream& in) {
+    return static_cast<int64_t>(readU64(in));
+}
+
+float readF32(std::istream& in) {
+    uint32_t bits = readU32(in);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Size-prefixed byte string of at most maxSize bytes
+std::string readBytes(std::istream& in, size_t maxSize) {
+    uint64_t size = readU64(in);
+    if (!in || size > maxSize) {
+        throw std::runtime_error("Invalid value size.");
+    }
+    std::string bytes(static_cast<size_t>(size), '\0');
+    readRaw(in, &bytes[0], bytes.size());
+    return bytes;
+}
+
+// BlockWriteBuffer class
+// Stream buffer that collects output into large blocks and writes each one framed as
+//   uint32 payload size | uint32 CRC-32C of the payload | payload
+// to the underlying stream, so a file is written with a few big writes and every block
+// can be verified when it is read back. finish() ends the stream with an empty block.
+class BlockWriteBuffer : public std::streambuf {
+public:
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+    explicit BlockWriteBuffer(std::ostream& sink) : sink(sink), block(BLOCK_SIZE) {
+        setp(block.data(), block.data() + block.size());
+    }
+
+    BlockWriteBuffer(const BlockWriteBuffer&) = delete;
+    BlockWriteBuffer& operator=(const BlockWriteBuffer&) = delete;
+
+    // Write the last block and the end marker
+    void finish() {
+        flushBlock();
+        writeFrame(nullptr, 0);
+        sink.flush();
+        if (!sink) {
+            throw std::runtime_error("Failed to write block.");
+        }
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        flushBlock();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize size) override {
+        std::streamsize written = 0;
+        while (written < size) {
+            if (pptr() == epptr()) {
+                flushBlock();
+            }
+            std::streamsize chunk = std::min<std::streamsize>(size - written, epptr() - pptr());
+            std::memcpy(pptr(), data + written, static_cast<size_t>(chunk));
+            pbump(static_cast<int>(chunk));
+            written += chunk;
+        }
+        return written;
+    }
+
+private:
+    std::ostream& sink;
+    std::vector<char> block;
+
+    void flushBlock() {
+        size_t size = static_cast<size_t>(pptr() - pbase());
+        if (size > 0) {
+            writeFrame(block.data(), size);
+        }
+        setp(block.data(), block.data() + block.size());
+    }
+
+    void writeFrame(const char* data, size_t size) {
+        writeU32(sink, static_cast<uint32_t>(size));
+        writeU32(sink, crc32c(data, size));
+        sink.write(data, size);
+    }
+};
+
+// BlockReadBuffer class
+// Reads the blocks written by BlockWriteBuffer, verifying each checksum before any of its
+// bytes are handed out. A corrupt block, or a stream that ends before the end marker,
+// throws std::runtime_error.
+class BlockReadBuffer : public std::streambuf {
+public:
+    explicit BlockReadBuffer(std::istream& source) : source(source) {
+        setg(nullptr, nullptr, nullptr);
+    }
+
+    BlockReadBuffer(const BlockReadBuffer&) = delete;
+    BlockReadBuffer& operator=(const BlockReadBuffer&) = delete;
+
+    // Whether the end marker was reached
+    bool isComplete() const {
+        return complete;
+    }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        if (complete || !readBlock()) {
+            return traits_type::eof();
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    std::streamsize xsgetn(char* data, std::streamsize size) override {
+        std::streamsize copied = 0;
+        while (copied < size) {
+            if (gptr() == egptr() && (complete || !readBlock())) {
+                break;
+            }
+            std::streamsize chunk = std::min<std::streamsize>(size - copied, egptr() - gptr());
+            std::memcpy(data + copied, gptr(), static_cast<size_t>(chunk));
+            gbump(static_cast<int>(chunk));
+            copied += chunk;
+        }
+        return copied;
+    }
+
+private:
+    std::istream& source;
+    std::vector<char> block;
+    bool complete = false;
+
+    // Load and verify the next block, false at the end marker
+    bool readBlock() {
+        uint32_t size = readU32(source);
+        uint32_t checksum = readU32(source);
+        if (!source) {
+            throw std::runtime_error("File is truncated.");
+        }
+        if (size > BlockWriteBuffer::BLOCK_SIZE) {
+            throw std::runtime_error("Invalid block size, the file is corrupt.");
+        }
+        block.resize(size);
+        source.read(block.data(), size);
+        if (!source) {
+            throw std::runtime_error("File is truncated.");
+        }
+        if (crc32c(block.data(), size) != checksum) {
+            throw std::runtime_error("Block checksum mismatch, the file is corrupt.");
+        }
+        if (size == 0) {
+            complete = true;
+            return false;
+        }
+        setg(block.data(), block.data(), block.data() + size);
+        return true;
+    }
+};
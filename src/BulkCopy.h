@@ -0,0 +1,537 @@
+// BulkCopy.h
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "BlockStream.h"
+#include "ColumnStore.h"
+#include "Database.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+
+// Layout of a file read or written by COPY
+enum class CopyFormat {
+    CSV,   // One row per line, fields separated by ',' and quoted with '"' when needed
+    BINARY // Typed column blocks, see importTable
+};
+
+struct CopyOptions {
+    CopyFormat format = CopyFormat::CSV;
+    bool header = false; // CSV: the first line names the columns and is skipped on import
+    size_t jobs = 0;     // Worker threads parsing the file, 0 for one per hardware thread
+};
+
+// Binary COPY files start with the magic, the column count and one type byte per column,
+// followed by blocks of up to COPY_BLOCK_ROWS rows until the end of the file:
+//   uint32 rows | uint64 payload size | payload
+// The payload holds the block column after column: INT int32, TIMESTAMP int64, FLOAT float32 and
+// BOOL uint8 per row; STRING and BLOB a uint32 length per row followed by the bytes of every row.
+// Numbers are little-endian, as in the database file.
+constexpr char COPY_MAGIC[8] = { 'R', 'D', 'B', 'C', 'O', 'P', 'Y', '1' };
+constexpr size_t COPY_BLOCK_ROWS = 65536;
+
+// CSV files are cut into chunks of about this many bytes, each parsed by one worker
+constexpr size_t COPY_CHUNK_BYTES = size_t(4) << 20;
+
+// Part of the file one worker parses into columns
+struct CopyChunk {
+    size_t begin;
+    size_t end;
+    size_t line; // CSV: line number of the first row, for error messages
+    size_t rows; // BINARY: rows in the block
+};
+
+uint32_t decodeU32(const uint8_t* data) {
+    return uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24;
+}
+
+uint64_t decodeU64(const uint8_t* data) {
+    return uint64_t(decodeU32(data)) | uint64_t(decodeU32(data + 4)) << 32;
+}
+
+// Cut a CSV file at line ends outside quoted fields, so every chunk holds whole rows
+std::vector<CopyChunk> splitCsv(const uint8_t* data, size_t size, size_t start, size_t line) {
+    std::vector<CopyChunk> chunks;
+    size_t chunkStart = start;
+    size_t chunkLine = line;
+    bool quoted = false;
+    for (size_t i = start; i < size; ++i) {
+        if (data[i] == '"') {
+            quoted = !quoted;
+        }
+        else if (data[i] == '\n' && !quoted) {
+            ++line;
+            if (i + 1 - chunkStart >= COPY_CHUNK_BYTES) {
+                chunks.push_back({ chunkStart, i + 1, chunkLine, 0 });
+                chunkStart = i + 1;
+                chunkLine = line;
+            }
+        }
+    }
+    if (quoted) {
+        throw std::runtime_error("Unterminated quoted field in the last row.");
+    }
+    if (chunkStart < size) {
+        chunks.push_back({ chunkStart, size, chunkLine, 0 });
+    }
+    return chunks;
+}
+
+// Convert one CSV field to a column value, an empty field takes the default of the column
+Value csvValue(std::string_view field, DataType type) {
+    if (field.empty()) {
+        return defaultValue(type);
+    }
+    const char* first = field.data();
+    const char* last = field.data() + field.size();
+    switch (type) {
+    case DataType::INT: {
+        int value = 0;
+        auto result = std::from_chars(first, last, value);
+        if (result.ec != std::errc() || result.ptr != last) {
+            throw std::runtime_error("Invalid INT value: " + std::string(field));
+        }
+        return value;
+    }
+    case DataType::TIMESTAMP: {
+        long long value = 0;
+        auto result = std::from_chars(first, last, value);
+        if (result.ec != std::errc() || result.ptr != last) {
+            throw std::runtime_error("Invalid TIMESTAMP value: " + std::string(field));
+        }
+        return static_cast<std::time_t>(value);
+    }
+    case DataType::FLOAT: {
+        // strtof needs a terminated string, the field is a view into the mapped file
+        std::string text(field);
+        char* end = nullptr;
+        float value = std::strtof(text.c_str(), &end);
+        if (end != text.c_str() + text.size()) {
+            throw std::runtime_error("Invalid FLOAT value: " + text);
+        }
+        return value;
+    }
+    case DataType::BOOL:
+        if (field == "true" || field == "TRUE") {
+            return true;
+        }
+        if (field == "false" || field == "FALSE") {
+            return false;
+        }
+        throw std::runtime_error("Invalid BOOL value: " + std::string(field));
+    case DataType::STRING:
+        return std::string(field);
+    case DataType::BLOB:
+        return std::vector<uint8_t>(field.begin(), field.end());
+    }
+    return defaultValue(type);
+}
+
+// Parse the rows of a CSV chunk into one column per table column
+std::vector<ColumnVector> parseCsvChunk(const uint8_t* data, const CopyChunk& chunk, const std::vector<Column>& columns) {
+    std::vector<ColumnVector> parsed;
+    for (const auto& column : columns) {
+        parsed.emplace_back(column.type);
+    }
+    std::string unescaped;
+    size_t line = chunk.line;
+    size_t i = chunk.begin;
+    while (i < chunk.end) {
+        // Blank lines, such as the one after a trailing line break, hold no row
+        if (data[i] == '\n' || (data[i] == '\r' && i + 1 < chunk.end && data[i + 1] == '\n')) {
+            i += data[i] == '\r' ? 2 : 1;
+            ++line;
+            continue;
+        }
+
+        size_t rowLine = line;
+        size_t field = 0;
+        try {
+            while (true) {
+                std::string_view text;
+                if (i < chunk.end && data[i] == '"') {
+                    // A quote inside a quoted field is written twice
+                    unescaped.clear();
+                    ++i;
+                    while (i < chunk.end) {
+                        if (data[i] == '"') {
+                            if (i + 1 < chunk.end && data[i + 1] == '"') {
+                                unescaped.push_back('"');
+                                i += 2;
+                                continue;
+                            }
+                            ++i;
+                            break;
+                        }
+                        if (data[i] == '\n') {
+                            ++line;
+                        }
+                        unescaped.push_back(static_cast<char>(data[i]));
+                        ++i;
+                    }
+                    text = unescaped;
+                }
+                else {
+                    size_t start = i;
+                    while (i < chunk.end && data[i] != ',' && data[i] != '\n') {
+                        ++i;
+                    }
+                    size_t end = i;
+                    if (end > start && data[end - 1] == '\r') {
+                        --end;
+                    }
+                    text = std::string_view(reinterpret_cast<const char*>(data) + start, end - start);
+                }
+
+                if (field >= columns.size()) {
+                    throw std::runtime_error("Row has more fields than the table has columns.");
+                }
+                parsed[field].append(csvValue(text, columns[field].type));
+                ++field;
+
+                if (i < chunk.end && data[i] == '\r') {
+                    ++i;
+                }
+                if (i >= chunk.end || data[i] == '\n') {
+                    ++i;
+                    ++line;
+                    break;
+                }
+                if (data[i] != ',') {
+                    throw std::runtime_error("Unexpected character after a quoted field.");
+                }
+                ++i;
+            }
+            if (field != columns.size()) {
+                throw std::runtime_error("Row has " + std::to_string(field) + " fields, the table has " +
+                                         std::to_string(columns.size()) + " columns.");
+            }
+        }
+        catch (const std::runtime_error& e) {
+            throw std::runtime_error("Line " + std::to_string(rowLine) + ": " + e.what());
+        }
+    }
+    return parsed;
+}
+
+// Find the blocks of a binary file after checking that its columns match the table
+std::vector<CopyChunk> splitBinary(const uint8_t* data, size_t size, const std::vector<Column>& columns) {
+    size_t headerSize = sizeof(COPY_MAGIC) + 4 + columns.size();
+    if (size < sizeof(COPY_MAGIC) + 4 || std::memcmp(data, COPY_MAGIC, sizeof(COPY_MAGIC)) != 0) {
+        throw std::runtime_error("Not a binary COPY file.");
+    }
+    if (decodeU32(data + sizeof(COPY_MAGIC)) != columns.size() || size < headerSize) {
+        throw std::runtime_error("Binary COPY file has a different number of columns than the table.");
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (data[sizeof(COPY_MAGIC) + 4 + i] != static_cast<uint8_t>(columns[i].type)) {
+            throw std::runtime_error("Type of column " + columns[i].name + " differs from the binary COPY file.");
+        }
+    }
+
+    std::vector<CopyChunk> chunks;
+    size_t offset = headerSize;
+    while (offset < size) {
+        if (size - offset < 12) {
+            throw std::runtime_error("Binary COPY file is truncated.");
+        }
+        size_t rows = decodeU32(data + offset);
+        uint64_t payload = decodeU64(data + offset + 4);
+        offset += 12;
+        if (payload > size - offset) {
+            throw std::runtime_error("Binary COPY file is truncated.");
+        }
+        chunks.push_back({ offset, offset + static_cast<size_t>(payload), 0, rows });
+        offset += static_cast<size_t>(payload);
+    }
+    return chunks;
+}
+
+// Decode a binary block into one column per table column
+std::vector<ColumnVector> parseBinaryChunk(const uint8_t* data, const CopyChunk& chunk, const std::vector<Column>& columns) {
+    std::vector<ColumnVector> parsed;
+    size_t offset = chunk.begin;
+    size_t rows = chunk.rows;
+    auto take = [&](size_t bytes) {
+        if (bytes > chunk.end - offset) {
+            throw std::runtime_error("Binary COPY block is truncated.");
+        }
+        const uint8_t* at = data + offset;
+        offset += bytes;
+        return at;
+    };
+
+    for (const auto& column : columns) {
+        ColumnVector values(column.type);
+        switch (column.type) {
+        case DataType::INT: {
+            const uint8_t* at = take(rows * 4);
+            std::vector<int> decoded(rows);
+            for (size_t r = 0; r < rows; ++r) {
+                decoded[r] = static_cast<int32_t>(decodeU32(at + r * 4));
+            }
+            values.appendValues(decoded.data(), rows);
+            break;
+        }
+        case DataType::TIMESTAMP: {
+            const uint8_t* at = take(rows * 8);
+            std::vector<std::time_t> decoded(rows);
+            for (size_t r = 0; r < rows; ++r) {
+                decoded[r] = static_cast<std::time_t>(static_cast<int64_t>(decodeU64(at + r * 8)));
+            }
+            values.appendValues(decoded.data(), rows);
+            break;
+        }
+        case DataType::FLOAT: {
+            const uint8_t* at = take(rows * 4);
+            std::vector<float> decoded(rows);
+            for (size_t r = 0; r < rows; ++r) {
+                uint32_t bits = decodeU32(at + r * 4);
+                std::memcpy(&decoded[r], &bits, sizeof(bits));
+            }
+            values.appendValues(decoded.data(), rows);
+            break;
+        }
+        case DataType::BOOL: {
+            const uint8_t* at = take(rows);
+            std::vector<uint64_t> bits((rows + 63) / 64);
+            for (size_t r = 0; r < rows; ++r) {
+                bits[r >> 6] |= uint64_t(at[r] != 0) << (r & 63);
+            }
+            values.appendBits(bits.data(), rows);
+            break;
+        }
+        case DataType::STRING:
+        case DataType::BLOB: {
+            const uint8_t* at = take(rows * 4);
+            std::vector<uint32_t> lengths(rows);
+            size_t total = 0;
+            for (size_t r = 0; r < rows; ++r) {
+                lengths[r] = decodeU32(at + r * 4);
+                total += lengths[r];
+            }
+            values.appendByteValues(lengths.data(), take(total), rows);
+            break;
+        }
+        }
+        parsed.push_back(std::move(values));
+    }
+    if (offset != chunk.end) {
+        throw std::runtime_error("Binary COPY block has trailing bytes.");
+    }
+    return parsed;
+}
+
+// Parse the bytes of a COPY file into one column per table column.
+// The data is cut into chunks that workers parse and convert in parallel, a window of chunks
+// at a time, and a single writer gathers the converted columns in order.
+std::vector<ColumnVector> parseCopyData(const uint8_t* data, size_t size, const std::vector<Column>& tableColumns,
+                                        const CopyOptions& options) {
+    std::vector<CopyChunk> chunks;
+    if (options.format == CopyFormat::BINARY) {
+        chunks = splitBinary(data, size, tableColumns);
+    }
+    else {
+        size_t start = 0;
+        size_t line = 1;
+        if (options.header) {
+            const void* newline = size > 0 ? std::memchr(data, '\n', size) : nullptr;
+            start = newline ? static_cast<const uint8_t*>(newline) - data + 1 : size;
+            line = 2;
+        }
+        chunks = splitCsv(data, size, start, line);
+    }
+
+    std::vector<ColumnVector> loaded;
+    for (const auto& column : tableColumns) {
+        loaded.emplace_back(column.type);
+    }
+    size_t jobs = options.jobs ? options.jobs : defaultJobs();
+    size_t window = std::max<size_t>(1, jobs * 2);
+    for (size_t first = 0; first < chunks.size(); first += window) {
+        size_t count = std::min(window, chunks.size() - first);
+        std::vector<std::vector<ColumnVector>> parsed(count);
+        parallelFor(count, jobs, [&](size_t i) {
+            const CopyChunk& chunk = chunks[first + i];
+            parsed[i] = options.format == CopyFormat::BINARY ? parseBinaryChunk(data, chunk, tableColumns)
+                                                             : parseCsvChunk(data, chunk, tableColumns);
+        });
+        for (auto& columns : parsed) {
+            for (size_t c = 0; c < columns.size(); ++c) {
+                loaded[c].appendColumn(columns[c]);
+            }
+            columns.clear();
+        }
+    }
+    return loaded;
+}
+
+// Load every row of a file into a table, all or none, returns the number of rows loaded.
+// The file is mapped and parsed by parseCopyData, then the table appends the rows in one go
+// and indexes them (see Table::bulkAppend). The appended columns are moved to imported when
+// it is given, so the caller can log the rows rather than the file name.
+size_t importTable(Table& table, const std::string& path, const CopyOptions& options,
+                   const std::vector<ForeignKeyTarget>& foreignKeys, std::vector<ColumnVector>* imported = nullptr) {
+    MappedFile file(path);
+    std::vector<ColumnVector> loaded = parseCopyData(file.getData(), file.getSize(), table.columns, options);
+    size_t rows = loaded.empty() ? 0 : loaded[0].size();
+    table.bulkAppend(loaded, foreignKeys);
+    if (imported) {
+        *imported = std::move(loaded);
+    }
+    return rows;
+}
+
+// Write a CSV field, quoted when it holds a separator, a quote or a line break
+void writeCsvField(std::ostream& out, std::string_view field) {
+    if (field.find_first_of(",\"\r\n") == std::string_view::npos) {
+        out << field;
+        return;
+    }
+    out << '"';
+    for (char c : field) {
+        if (c == '"') {
+            out << '"';
+        }
+        out << c;
+    }
+    out << '"';
+}
+
+// Write the given rows of columns in the binary COPY format, header included
+void writeBinaryCopy(std::ostream& out, const std::vector<const ColumnVector*>& columns, const std::vector<RowId>& rows) {
+    writeRaw(out, COPY_MAGIC, sizeof(COPY_MAGIC));
+    writeU32(out, static_cast<uint32_t>(columns.size()));
+    for (const ColumnVector* data : columns) {
+        writeU8(out, static_cast<uint8_t>(data->getType()));
+    }
+    for (size_t first = 0; first < rows.size(); first += COPY_BLOCK_ROWS) {
+        size_t count = std::min(COPY_BLOCK_ROWS, rows.size() - first);
+        uint64_t payload = 0;
+        for (const ColumnVector* column : columns) {
+            const ColumnVector& data = *column;
+            switch (data.getType()) {
+            case DataType::INT:
+            case DataType::FLOAT:
+                payload += count * 4;
+                break;
+            case DataType::TIMESTAMP:
+                payload += count * 8;
+                break;
+            case DataType::BOOL:
+                payload += count;
+                break;
+            case DataType::STRING:
+            case DataType::BLOB:
+                payload += count * 4;
+                for (size_t r = first; r < first + count; ++r) {
+                    payload += data.getBytes(rows[r]).size();
+                }
+                break;
+            }
+        }
+        writeU32(out, static_cast<uint32_t>(count));
+        writeU64(out, payload);
+
+        for (const ColumnVector* column : columns) {
+            const ColumnVector& data = *column;
+            for (size_t r = first; r < first + count; ++r) {
+                switch (data.getType()) {
+                case DataType::INT:
+                    writeI32(out, data.getInt(rows[r]));
+                    break;
+                case DataType::TIMESTAMP:
+                    writeI64(out, static_cast<int64_t>(data.getTimestamp(rows[r])));
+                    break;
+                case DataType::FLOAT:
+                    writeF32(out, data.getFloat(rows[r]));
+                    break;
+                case DataType::BOOL:
+                    writeU8(out, data.getBool(rows[r]) ? 1 : 0);
+                    break;
+                case DataType::STRING:
+                case DataType::BLOB:
+                    writeU32(out, static_cast<uint32_t>(data.getBytes(rows[r]).size()));
+                    break;
+                }
+            }
+            if (data.getType() == DataType::STRING || data.getType() == DataType::BLOB) {
+                for (size_t r = first; r < first + count; ++r) {
+                    std::string_view bytes = data.getBytes(rows[r]);
+                    writeRaw(out, bytes.data(), bytes.size());
+                }
+            }
+        }
+    }
+}
+
+// Write the live rows of a table to a file that importTable reads back, returns the rows written
+size_t exportTable(const Table& table, const std::string& path, const CopyOptions& options) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    std::vector<RowId> rows;
+    rows.reserve(table.rowCount());
+    table.forEachRow([&](RowId row) {
+        rows.push_back(row);
+    });
+
+    if (options.format == CopyFormat::CSV) {
+        if (options.header) {
+            for (size_t c = 0; c < table.columns.size(); ++c) {
+                out << (c > 0 ? "," : "");
+                writeCsvField(out, table.columns[c].name);
+            }
+            out << '\n';
+        }
+        char number[32];
+        for (RowId row : rows) {
+            for (size_t c = 0; c < table.columns.size(); ++c) {
+                const ColumnVector& data = table.columnData[c];
+                if (c > 0) {
+                    out << ',';
+                }
+                switch (data.getType()) {
+                case DataType::INT:
+                    out.write(number, std::to_chars(number, number + sizeof(number), data.getInt(row)).ptr - number);
+                    break;
+                case DataType::TIMESTAMP:
+                    out.write(number, std::to_chars(number, number + sizeof(number), static_cast<long long>(data.getTimestamp(row))).ptr - number);
+                    break;
+                case DataType::FLOAT:
+                    out.write(number, std::to_chars(number, number + sizeof(number), data.getFloat(row)).ptr - number);
+                    break;
+                case DataType::BOOL:
+                    out << (data.getBool(row) ? "true" : "false");
+                    break;
+                case DataType::STRING:
+                case DataType::BLOB:
+                    writeCsvField(out, data.getBytes(row));
+                    break;
+                }
+            }
+            out << '\n';
+        }
+    }
+    else {
+        std::vector<const ColumnVector*> columns;
+        for (const auto& data : table.columnData) {
+            columns.push_back(&data);
+        }
+        writeBinaryCopy(out, columns, rows);
+    }
+
+    out.flush();
+    if (!out) {
+        throw std::runtime_error("Failed to write file: " + path);
+    }
+    return rows.size();
+}
@@ -0,0 +1,56 @@
+// Checksum.h
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Lookup tables for a reflected CRC-32 polynomial, processed eight bytes at a time
+template<uint32_t Polynomial>
+struct CrcTables {
+    std::array<std::array<uint32_t, 256>, 8> table;
+
+    CrcTables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? Polynomial ^ (value >> 1) : value >> 1;
+            }
+            table[0][i] = value;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (size_t slice = 1; slice < 8; ++slice) {
+                table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xFF];
+            }
+        }
+    }
+
+    uint32_t update(const void* data, size_t size, uint32_t crc) const {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        crc = ~crc;
+        while (size >= 8) {
+            // The words are assembled byte by byte, so the result does not depend on endianness
+            uint32_t low = (uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24) ^ crc;
+            uint32_t high = uint32_t(bytes[4]) | uint32_t(bytes[5]) << 8 | uint32_t(bytes[6]) << 16 | uint32_t(bytes[7]) << 24;
+            crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24]
+                ^ table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+            bytes += 8;
+            size -= 8;
+        }
+        while (size-- > 0) {
+            crc = table[0][(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+};
+
+// CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320)
+uint32_t crc32(const void* data, size_t size, uint32_t crc = 0) {
+    static const CrcTables<0xEDB88320u> tables;
+    return tables.update(data, size, crc);
+}
+
+// CRC-32C (Castagnoli, reflected polynomial 0x82F63B78)
+uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0) {
+    static const CrcTables<0x82F63B78u> tables;
+    return tables.update(data, size, crc);
+}
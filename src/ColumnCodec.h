@@ -0,0 +1,424 @@
+// ColumnCodec.h
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "BlockStream.h"
+
+// How the values of a column are laid out on disk. The encoder measures the candidates for
+// the column type and writes the smallest, the decoder reads the encoding byte in front.
+enum class ColumnEncoding : uint8_t {
+    PLAIN,        // Fixed-width values, BOOL as a bitmap, STRING/BLOB as bit-packed lengths then the bytes
+    DELTA_PACKED, // INT/TIMESTAMP: first value, then each frame of deltas as a minimum and bit-packed offsets from it
+    RUN_LENGTH,   // BOOL: first value, then the bit-packed length of every run
+    DICTIONARY    // STRING/BLOB: every distinct value once, then a bit-packed code per row
+};
+
+// Deltas are packed in frames of this many, so one outlier only widens its own frame
+constexpr size_t DELTA_FRAME = 128;
+
+// Distinct values are counted over this many rows before a dictionary is given up on
+constexpr size_t DICTIONARY_SAMPLE = 4096;
+
+// Bits needed to store value, 0 for 0
+unsigned bitWidth(uint64_t value) {
+    unsigned width = 0;
+    while (value) {
+        width++;
+        value >>= 1;
+    }
+    return width;
+}
+
+// Bytes taken by count values packed at width bits, rounded up to whole 64-bit words
+size_t packedBytes(size_t count, unsigned width) {
+    return (count * width + 63) / 64 * sizeof(uint64_t);
+}
+
+// The low width bits of every value, back to back in little-endian 64-bit words
+void writePacked(std::ostream& out, const uint64_t* values, size_t count, unsigned width) {
+    if (width == 0 || count == 0) {
+        return;
+    }
+    std::vector<char> bytes(packedBytes(count, width));
+    size_t position = 0;
+    uint64_t word = 0;
+    unsigned used = 0;
+    auto flush = [&]() {
+        for (int i = 0; i < 8; ++i) {
+            bytes[position++] = static_cast<char>(word >> (8 * i));
+        }
+    };
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t value = values[i];
+        word |= value << used;
+        used += width;
+        if (used >= 64) {
+            flush();
+            used -= 64;
+            word = used > 0 ? value >> (width - used) : 0; // Bits that did not fit start the next word
+        }
+    }
+    if (used > 0) {
+        flush();
+    }
+    writeRaw(out, bytes.data(), bytes.size());
+}
+
+void readPacked(std::istream& in, uint64_t* values, size_t count, unsigned width) {
+    if (width == 0) {
+        std::fill(values, values + count, 0);
+        return;
+    }
+    std::vector<unsigned char> bytes(packedBytes(count, width));
+    readRaw(in, bytes.data(), bytes.size());
+    std::vector<uint64_t> words(bytes.size() / sizeof(uint64_t) + 1, 0); // Padding word, a value may read one past the end
+    for (size_t w = 0; w + 1 < words.size(); ++w) {
+        uint64_t word = 0;
+        for (int i = 0; i < 8; ++i) {
+            word |= uint64_t(bytes[w * 8 + i]) << (8 * i);
+        }
+        words[w] = word;
+    }
+    uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+    for (size_t i = 0, bit = 0; i < count; ++i, bit += width) {
+        size_t w = bit >> 6;
+        unsigned offset = bit & 63;
+        uint64_t value = words[w] >> offset;
+        if (offset + width > 64) {
+            value |= words[w + 1] << (64 - offset);
+        }
+        values[i] = value & mask;
+    }
+}
+
+// Width byte followed by the packed values, wide enough for the largest
+void writePackedValues(std::ostream& out, const std::vector<uint64_t>& values) {
+    uint64_t largest = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+    unsigned width = bitWidth(largest);
+    writeU8(out, static_cast<uint8_t>(width));
+    writePacked(out, values.data(), values.size(), width);
+}
+
+size_t packedValuesBytes(const std::vector<uint64_t>& values) {
+    uint64_t largest = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+    return 1 + packedBytes(values.size(), bitWidth(largest));
+}
+
+void readPackedValues(std::istream& in, std::vector<uint64_t>& values, size_t count) {
+    unsigned width = readU8(in);
+    if (!in || width > 64) {
+        throw std::runtime_error("Invalid packed width.");
+    }
+    values.resize(count);
+    readPacked(in, values.data(), count, width);
+}
+
+ColumnEncoding readEncoding(std::istream& in) {
+    uint8_t encoding = readU8(in);
+    if (!in || encoding > static_cast<uint8_t>(ColumnEncoding::DICTIONARY)) {
+        throw std::runtime_error("Invalid column encoding.");
+    }
+    return static_cast<ColumnEncoding>(encoding);
+}
+
+// INT and TIMESTAMP values, PLAIN or DELTA_PACKED. Deltas are taken modulo 2^64 so any sequence round trips.
+template<typename T>
+void encodeIntegers(std::ostream& out, const std::vector<T>& values) {
+    static_assert(std::is_integral_v<T> && (sizeof(T) == 4 || sizeof(T) == 8), "32 or 64-bit integers");
+    size_t count = values.size();
+    std::vector<uint64_t> deltas(count > 0 ? count - 1 : 0);
+    for (size_t i = 1; i < count; ++i) {
+        deltas[i - 1] = static_cast<uint64_t>(static_cast<int64_t>(values[i])) - static_cast<uint64_t>(static_cast<int64_t>(values[i - 1]));
+    }
+
+    // Frame minimums and widths decide the delta size before anything is written
+    std::vector<int64_t> minimums;
+    std::vector<unsigned> widths;
+    size_t deltaSize = sizeof(int64_t);
+    for (size_t start = 0; start < deltas.size(); start += DELTA_FRAME) {
+        size_t end = std::min(start + DELTA_FRAME, deltas.size());
+        int64_t minimum = std::numeric_limits<int64_t>::max();
+        for (size_t i = start; i < end; ++i) {
+            minimum = std::min(minimum, static_cast<int64_t>(deltas[i]));
+        }
+        uint64_t spread = 0;
+        for (size_t i = start; i < end; ++i) {
+            spread = std::max(spread, deltas[i] - static_cast<uint64_t>(minimum));
+        }
+        minimums.push_back(minimum);
+        widths.push_back(bitWidth(spread));
+        deltaSize += sizeof(int64_t) + 1 + packedBytes(end - start, widths.back());
+    }
+
+    if (count == 0 || deltaSize >= count * sizeof(T)) {
+        writeU8(out, static_cast<uint8_t>(ColumnEncoding::PLAIN));
+        std::vector<char> bytes(count * sizeof(T));
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t value = static_cast<uint64_t>(static_cast<int64_t>(values[i]));
+            for (size_t b = 0; b < sizeof(T); ++b) {
+                bytes[i * sizeof(T) + b] = static_cast<char>(value >> (8 * b));
+            }
+        }
+        writeRaw(out, bytes.data(), bytes.size());
+        return;
+    }
+
+    writeU8(out, static_cast<uint8_t>(ColumnEncoding::DELTA_PACKED));
+    writeI64(out, static_cast<int64_t>(values[0]));
+    for (size_t frame = 0, start = 0; start < deltas.size(); ++frame, start += DELTA_FRAME) {
+        size_t end = std::min(start + DELTA_FRAME, deltas.size());
+        for (size_t i = start; i < end; ++i) {
+            deltas[i] -= static_cast<uint64_t>(minimums[frame]);
+        }
+        writeI64(out, minimums[frame]);
+        writeU8(out, static_cast<uint8_t>(widths[frame]));
+        writePacked(out, deltas.data() + start, end - start, widths[frame]);
+    }
+}
+
+template<typename T>
+void decodeIntegers(std::istream& in, std::vector<T>& values, size_t count) {
+    values.resize(count);
+    ColumnEncoding encoding = readEncoding(in);
+    if (encoding == ColumnEncoding::PLAIN) {
+        std::vector<unsigned char> bytes(count * sizeof(T));
+        readRaw(in, bytes.data(), bytes.size());
+        for (size_t i = 0; i < count; ++i) {
+            std::make_unsigned_t<T> value = 0;
+            for (size_t b = 0; b < sizeof(T); ++b) {
+                value |= static_cast<std::make_unsigned_t<T>>(bytes[i * sizeof(T) + b]) << (8 * b);
+            }
+            values[i] = static_cast<T>(value);
+        }
+        return;
+    }
+    if (encoding != ColumnEncoding::DELTA_PACKED) {
+        throw std::runtime_error("Invalid column encoding.");
+    }
+    if (count == 0) {
+        return;
+    }
+    uint64_t previous = static_cast<uint64_t>(readI64(in));
+    values[0] = static_cast<T>(static_cast<int64_t>(previous));
+    uint64_t offsets[DELTA_FRAME];
+    for (size_t start = 1; start < count; start += DELTA_FRAME) {
+        size_t end = std::min(start + DELTA_FRAME, count);
+        uint64_t minimum = static_cast<uint64_t>(readI64(in));
+        unsigned width = readU8(in);
+        if (!in || width > 64) {
+            throw std::runtime_error("Invalid packed width.");
+        }
+        readPacked(in, offsets, end - start, width);
+        for (size_t i = start; i < end; ++i) {
+            previous += minimum + offsets[i - start];
+            values[i] = static_cast<T>(static_cast<int64_t>(previous));
+        }
+    }
+}
+
+// FLOAT values are always PLAIN
+void encodeFloats(std::ostream& out, const std::vector<float>& values) {
+    writeU8(out, static_cast<uint8_t>(ColumnEncoding::PLAIN));
+    for (float value : values) {
+        writeF32(out, value);
+    }
+}
+
+void decodeFloats(std::istream& in, std::vector<float>& values, size_t count) {
+    if (readEncoding(in) != ColumnEncoding::PLAIN) {
+        throw std::runtime_error("Invalid column encoding.");
+    }
+    values.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = readF32(in);
+    }
+}
+
+// BOOL values given as a bitmap of count bits, PLAIN or RUN_LENGTH
+void encodeBools(std::ostream& out, const std::vector<uint64_t>& bits, size_t count) {
+    auto bit = [&](size_t i) {
+        return ((bits[i >> 6] >> (i & 63)) & 1) != 0;
+    };
+    std::vector<uint64_t> runs;
+    for (size_t start = 0; start < count;) {
+        size_t end = start + 1;
+        while (end < count && bit(end) == bit(start)) {
+            end++;
+        }
+        runs.push_back(end - start);
+        start = end;
+    }
+
+    size_t plainSize = (count + 63) / 64 * sizeof(uint64_t);
+    size_t runSize = 1 + sizeof(uint64_t) + packedValuesBytes(runs);
+    if (count == 0 || runSize >= plainSize) {
+        writeU8(out, static_cast<uint8_t>(ColumnEncoding::PLAIN));
+        for (size_t w = 0; w < (count + 63) / 64; ++w) {
+            writeU64(out, bits[w]);
+        }
+        return;
+    }
+    writeU8(out, static_cast<uint8_t>(ColumnEncoding::RUN_LENGTH));
+    writeU8(out, bit(0));
+    writeU64(out, runs.size());
+    writePackedValues(out, runs);
+}
+
+// Decodes into a bitmap of count bits
+void decodeBools(std::istream& in, std::vector<uint64_t>& bits, size_t count) {
+    bits.assign((count + 63) / 64, 0);
+    ColumnEncoding encoding = readEncoding(in);
+    if (encoding == ColumnEncoding::PLAIN) {
+        for (uint64_t& word : bits) {
+            word = readU64(in);
+        }
+        return;
+    }
+    if (encoding != ColumnEncoding::RUN_LENGTH) {
+        throw std::runtime_error("Invalid column encoding.");
+    }
+    bool value = readU8(in) != 0;
+    uint64_t numRuns = readU64(in);
+    if (!in || numRuns > count) {
+        throw std::runtime_error("Invalid run count.");
+    }
+    std::vector<uint64_t> runs;
+    readPackedValues(in, runs, static_cast<size_t>(numRuns));
+    size_t position = 0;
+    for (uint64_t run : runs) {
+        if (run > count - position) {
+            throw std::runtime_error("Invalid run length.");
+        }
+        if (value) {
+            for (size_t i = position; i < position + run; ++i) {
+                bits[i >> 6] |= uint64_t(1) << (i & 63);
+            }
+        }
+        position += static_cast<size_t>(run);
+        value = !value;
+    }
+    if (position != count) {
+        throw std::runtime_error("Invalid run length.");
+    }
+}
+
+// STRING and BLOB values, PLAIN or DICTIONARY
+void encodeStrings(std::ostream& out, const std::vector<std::string_view>& values) {
+    size_t count = values.size();
+    std::vector<uint64_t> lengths(count);
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        lengths[i] = values[i].size();
+        totalBytes += values[i].size();
+    }
+    size_t plainSize = packedValuesBytes(lengths) + totalBytes;
+
+    // Codes in order of first appearance, given up on once most values turn out distinct
+    std::unordered_map<std::string_view, uint64_t> dictionary;
+    std::vector<std::string_view> entries;
+    std::vector<uint64_t> codes(count);
+    bool useDictionary = count > 0;
+    for (size_t i = 0; i < count && useDictionary; ++i) {
+        auto inserted = dictionary.emplace(values[i], entries.size());
+        if (inserted.second) {
+            entries.push_back(values[i]);
+        }
+        codes[i] = inserted.first->second;
+        if ((i + 1 == DICTIONARY_SAMPLE && entries.size() * 2 > DICTIONARY_SAMPLE) || entries.size() * 2 > count) {
+            useDictionary = false;
+        }
+    }
+    std::vector<uint64_t> entryLengths;
+    if (useDictionary) {
+        size_t entryBytes = 0;
+        for (std::string_view entry : entries) {
+            entryLengths.push_back(entry.size());
+            entryBytes += entry.size();
+        }
+        size_t dictionarySize = sizeof(uint64_t) + packedValuesBytes(entryLengths) + entryBytes
+            + 1 + packedBytes(count, bitWidth(entries.size() - 1));
+        useDictionary = dictionarySize < plainSize;
+    }
+
+    if (!useDictionary) {
+        writeU8(out, static_cast<uint8_t>(ColumnEncoding::PLAIN));
+        writePackedValues(out, lengths);
+        for (std::string_view value : values) {
+            writeRaw(out, value.data(), value.size());
+        }
+        return;
+    }
+    writeU8(out, static_cast<uint8_t>(ColumnEncoding::DICTIONARY));
+    writeU64(out, entries.size());
+    writePackedValues(out, entryLengths);
+    for (std::string_view entry : entries) {
+        writeRaw(out, entry.data(), entry.size());
+    }
+    writePackedValues(out, codes);
+}
+
+// Decodes into the length of every value and their bytes back to back
+void decodeStrings(std::istream& in, std::vector<uint32_t>& lengths, std::vector<uint8_t>& bytes, size_t count, size_t maxValueSize) {
+    // Lengths and bytes of count values stored one after another
+    auto readValues = [&](size_t numValues, std::vector<uint64_t>& valueLengths, std::vector<uint8_t>& valueBytes) {
+        readPackedValues(in, valueLengths, numValues);
+        size_t total = 0;
+        for (uint64_t length : valueLengths) {
+            if (length > maxValueSize) {
+                throw std::runtime_error("Invalid value size.");
+            }
+            total += static_cast<size_t>(length);
+        }
+        valueBytes.resize(total);
+        readRaw(in, valueBytes.data(), total);
+    };
+
+    ColumnEncoding encoding = readEncoding(in);
+    std::vector<uint64_t> valueLengths;
+    if (encoding == ColumnEncoding::PLAIN) {
+        readValues(count, valueLengths, bytes);
+        lengths.assign(valueLengths.begin(), valueLengths.end());
+        return;
+    }
+    if (encoding != ColumnEncoding::DICTIONARY) {
+        throw std::runtime_error("Invalid column encoding.");
+    }
+    uint64_t numEntries = readU64(in);
+    if (!in || numEntries > count) {
+        throw std::runtime_error("Invalid dictionary size.");
+    }
+    std::vector<uint8_t> entryBytes;
+    readValues(static_cast<size_t>(numEntries), valueLengths, entryBytes);
+    std::vector<size_t> entryOffsets(valueLengths.size());
+    for (size_t e = 1; e < valueLengths.size(); ++e) {
+        entryOffsets[e] = entryOffsets[e - 1] + static_cast<size_t>(valueLengths[e - 1]);
+    }
+
+    std::vector<uint64_t> codes;
+    readPackedValues(in, codes, count);
+    lengths.resize(count);
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (codes[i] >= numEntries) {
+            throw std::runtime_error("Invalid dictionary code.");
+        }
+        lengths[i] = static_cast<uint32_t>(valueLengths[codes[i]]);
+        total += lengths[i];
+    }
+    bytes.resize(total);
+    for (size_t i = 0, position = 0; i < count; ++i) {
+        if (lengths[i] > 0) {
+            std::memcpy(bytes.data() + position, entryBytes.data() + entryOffsets[codes[i]], lengths[i]);
+        }
+        position += lengths[i];
+    }
+}
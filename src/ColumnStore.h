@@ -0,0 +1,512 @@
+// ColumnStore.h
+#pragma once
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "DataTypes.h"
+
+// Typed, contiguous storage for every value of a single column.
+// Fixed-width types live in a plain vector, BOOL is packed into a bitmap and
+// STRING/BLOB values share one byte arena addressed by offset/length pairs.
+class ColumnVector {
+public:
+    // The arrays behind a column, as the typed accessors and the packed filters read them
+    struct Arrays {
+        const void* values = nullptr;     // INT, TIMESTAMP and FLOAT values, BOOL bitmap words
+        size_t valueBytes = 0;
+        const uint64_t* offsets = nullptr; // STRING and BLOB offsets into bytes, one per row
+        const uint32_t* lengths = nullptr;
+        const uint8_t* bytes = nullptr;
+        size_t byteCount = 0;
+    };
+
+    ColumnVector() : type(DataType::INT) {}
+
+    explicit ColumnVector(DataType type) : type(type) {}
+
+    ColumnVector(const ColumnVector& other)
+        : type(other.type), count(other.count), ints(other.ints), timestamps(other.timestamps), floats(other.floats),
+          bits(other.bits), offsets(other.offsets), lengths(other.lengths), bytes(other.bytes), deadBytes(other.deadBytes) {
+        syncView();
+    }
+
+    ColumnVector& operator=(const ColumnVector& other) {
+        if (this != &other) {
+            ColumnVector copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    // Moving a vector keeps its buffer, so the view stays valid
+    ColumnVector(ColumnVector&& other) noexcept = default;
+    ColumnVector& operator=(ColumnVector&& other) noexcept = default;
+
+    DataType getType() const {
+        return type;
+    }
+
+    // Number of slots (live or deleted) stored in the column
+    size_t size() const {
+        return count;
+    }
+
+    // Append a value at the next row id
+    void append(const Value& value);
+
+    // Append the default value of the column type
+    void appendDefault();
+
+    // Append count values decoded by a loader in one go, the column type must match
+    void appendValues(const int* values, size_t count);
+    void appendValues(const std::time_t* values, size_t count);
+    void appendValues(const float* values, size_t count);
+
+    // BOOL values from a bitmap of count bits
+    void appendBits(const uint64_t* bits, size_t count);
+
+    // STRING or BLOB values whose bytes are stored back to back
+    void appendByteValues(const uint32_t* valueLengths, const uint8_t* data, size_t count);
+
+    // Every value of another column of the same type, in order
+    void appendColumn(const ColumnVector& other);
+
+    // Overwrite the value stored at a row id
+    void set(RowId row, const Value& value);
+
+    // Materialize the value stored at a row id
+    Value get(RowId row) const;
+
+    // Compare the stored value against a value without materializing it
+    bool equals(RowId row, const Value& value) const;
+
+    void reserve(size_t capacity);
+    void clear();
+
+    // Approximate heap footprint of the column in bytes
+    size_t memoryUsage() const;
+
+    // Arrays the column currently reads from
+    Arrays getArrays() const;
+
+    // Typed accessors for scans that already know the column type
+    int getInt(RowId row) const {
+        return static_cast<const int*>(view.values)[row];
+    }
+
+    std::time_t getTimestamp(RowId row) const {
+        return static_cast<const std::time_t*>(view.values)[row];
+    }
+
+    float getFloat(RowId row) const {
+        return static_cast<const float*>(view.values)[row];
+    }
+
+    bool getBool(RowId row) const {
+        return (static_cast<const uint64_t*>(view.values)[row >> 6] >> (row & 63)) & 1;
+    }
+
+    // STRING and BLOB values as a view into the byte arena
+    std::string_view getBytes(RowId row) const {
+        return std::string_view(reinterpret_cast<const char*>(view.bytes) + view.offsets[row], view.lengths[row]);
+    }
+
+private:
+    DataType type;
+    size_t count = 0;
+
+    std::vector<int> ints;
+    std::vector<std::time_t> timestamps;
+    std::vector<float> floats;
+    std::vector<uint64_t> bits;
+
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<uint8_t> bytes;
+    size_t deadBytes = 0; // Arena bytes no longer referenced after updates
+
+    Arrays view; // What the accessors read, points into the vectors above
+
+    template<typename T>
+    static const T& expectType(const Value& value);
+
+    void setBool(RowId row, bool value);
+    void appendBytes(const uint8_t* data, size_t size);
+    void setBytes(RowId row, const uint8_t* data, size_t size);
+    void compactBytes();
+
+    // Point the view back at the vectors, called after every change to them
+    void syncView();
+};
+
+// Throws when a value does not carry the alternative the column expects
+template<typename T>
+const T& ColumnVector::expectType(const Value& value) {
+    const T* typed = std::get_if<T>(&value);
+    if (!typed) {
+        throw std::runtime_error("Value does not match the column type.");
+    }
+    return *typed;
+}
+
+void ColumnVector::append(const Value& value) {
+    switch (type) {
+    case DataType::INT:
+        ints.push_back(expectType<int>(value));
+        break;
+    case DataType::TIMESTAMP:
+        timestamps.push_back(expectType<std::time_t>(value));
+        break;
+    case DataType::FLOAT:
+        floats.push_back(expectType<float>(value));
+        break;
+    case DataType::BOOL:
+        if ((count & 63) == 0) {
+            bits.push_back(0);
+        }
+        setBool(count, expectType<bool>(value));
+        break;
+    case DataType::STRING: {
+        const std::string& str = expectType<std::string>(value);
+        appendBytes(reinterpret_cast<const uint8_t*>(str.data()), str.size());
+        break;
+    }
+    case DataType::BLOB: {
+        const std::vector<uint8_t>& blob = expectType<std::vector<uint8_t>>(value);
+        appendBytes(blob.data(), blob.size());
+        break;
+    }
+    }
+    count++;
+    syncView();
+}
+
+void ColumnVector::appendDefault() {
+    append(defaultValue(type));
+}
+
+void ColumnVector::appendValues(const int* values, size_t n) {
+    if (type != DataType::INT) {
+        throw std::runtime_error("Value does not match the column type.");
+    }
+    ints.insert(ints.end(), values, values + n);
+    count += n;
+    syncView();
+}
+
+void ColumnVector::appendValues(const std::time_t* values, size_t n) {
+    if (type != DataType::TIMESTAMP) {
+        throw std::runtime_error("Value does not match the column type.");
+    }
+    timestamps.insert(timestamps.end(), values, values + n);
+    count += n;
+    syncView();
+}
+
+void ColumnVector::appendValues(const float* values, size_t n) {
+    if (type != DataType::FLOAT) {
+        throw std::runtime_error("Value does not match the column type.");
+    }
+    floats.insert(floats.end(), values, values + n);
+    count += n;
+    syncView();
+}
+
+void ColumnVector::appendBits(const uint64_t* source, size_t n) {
+    if (type != DataType::BOOL) {
+        throw std::runtime_error("Value does not match the column type.");
+    }
+    if ((count & 63) == 0) {
+        // Word aligned, the bitmap is copied as it is with the unused high bits cleared
+        bits.insert(bits.end(), source, source + (n + 63) / 64);
+        if (n & 63) {
+            bits.back() &= (uint64_t(1) << (n & 63)) - 1;
+        }
+        count += n;
+    }
+    else {
+        for (size_t i = 0; i < n; ++i, ++count) {
+            if ((count & 63) == 0) {
+                bits.push_back(0);
+            }
+            setBool(count, (source[i >> 6] >> (i & 63)) & 1);
+        }
+    }
+    syncView();
+}
+
+void ColumnVector::appendByteValues(const uint32_t* valueLengths, const uint8_t* data, size_t n) {
+    if (type != DataType::STRING && type != DataType::BLOB) {
+        throw std::runtime_error("Value does not match the column type.");
+    }
+    size_t total = 0;
+    offsets.reserve(offsets.size() + n);
+    for (size_t i = 0; i < n; ++i) {
+        offsets.push_back(bytes.size() + total);
+        total += valueLengths[i];
+    }
+    lengths.insert(lengths.end(), valueLengths, valueLengths + n);
+    bytes.insert(bytes.end(), data, data + total);
+    count += n;
+    syncView();
+}
+
+void ColumnVector::appendColumn(const ColumnVector& other) {
+    if (other.type != type) {
+        throw std::runtime_error("Value does not match the column type.");
+    }
+    switch (type) {
+    case DataType::INT:
+        appendValues(static_cast<const int*>(other.view.values), other.count);
+        break;
+    case DataType::TIMESTAMP:
+        appendValues(static_cast<const std::time_t*>(other.view.values), other.count);
+        break;
+    case DataType::FLOAT:
+        appendValues(static_cast<const float*>(other.view.values), other.count);
+        break;
+    case DataType::BOOL:
+        appendBits(static_cast<const uint64_t*>(other.view.values), other.count);
+        break;
+    case DataType::STRING:
+    case DataType::BLOB:
+        offsets.reserve(count + other.count);
+        lengths.reserve(count + other.count);
+        for (RowId row = 0; row < other.count; ++row) {
+            std::string_view value = other.getBytes(row);
+            appendBytes(reinterpret_cast<const uint8_t*>(value.data()), value.size());
+        }
+        count += other.count;
+        syncView();
+        break;
+    }
+}
+
+void ColumnVector::set(RowId row, const Value& value) {
+    switch (type) {
+    case DataType::INT:
+        ints[row] = expectType<int>(value);
+        break;
+    case DataType::TIMESTAMP:
+        timestamps[row] = expectType<std::time_t>(value);
+        break;
+    case DataType::FLOAT:
+        floats[row] = expectType<float>(value);
+        break;
+    case DataType::BOOL:
+        setBool(row, expectType<bool>(value));
+        break;
+    case DataType::STRING: {
+        const std::string& str = expectType<std::string>(value);
+        setBytes(row, reinterpret_cast<const uint8_t*>(str.data()), str.size());
+        break;
+    }
+    case DataType::BLOB: {
+        const std::vector<uint8_t>& blob = expectType<std::vector<uint8_t>>(value);
+        setBytes(row, blob.data(), blob.size());
+        break;
+    }
+    }
+    syncView();
+}
+
+Value ColumnVector::get(RowId row) const {
+    switch (type) {
+    case DataType::INT:
+        return getInt(row);
+    case DataType::TIMESTAMP:
+        return getTimestamp(row);
+    case DataType::FLOAT:
+        return getFloat(row);
+    case DataType::BOOL:
+        return getBool(row);
+    case DataType::STRING:
+        return std::string(getBytes(row));
+    case DataType::BLOB: {
+        const uint8_t* start = view.bytes + view.offsets[row];
+        return std::vector<uint8_t>(start, start + view.lengths[row]);
+    }
+    }
+    return {};
+}
+
+bool ColumnVector::equals(RowId row, const Value& value) const {
+    switch (type) {
+    case DataType::INT: {
+        const int* typed = std::get_if<int>(&value);
+        return typed && getInt(row) == *typed;
+    }
+    case DataType::TIMESTAMP: {
+        const std::time_t* typed = std::get_if<std::time_t>(&value);
+        return typed && getTimestamp(row) == *typed;
+    }
+    case DataType::FLOAT: {
+        const float* typed = std::get_if<float>(&value);
+        return typed && getFloat(row) == *typed;
+    }
+    case DataType::BOOL: {
+        const bool* typed = std::get_if<bool>(&value);
+        return typed && getBool(row) == *typed;
+    }
+    case DataType::STRING: {
+        const std::string* typed = std::get_if<std::string>(&value);
+        return typed && getBytes(row) == *typed;
+    }
+    case DataType::BLOB: {
+        const std::vector<uint8_t>* typed = std::get_if<std::vector<uint8_t>>(&value);
+        return typed && typed->size() == view.lengths[row]
+            && (typed->empty() || std::memcmp(view.bytes + view.offsets[row], typed->data(), typed->size()) == 0);
+    }
+    }
+    return false;
+}
+
+void ColumnVector::reserve(size_t capacity) {
+    switch (type) {
+    case DataType::INT:
+        ints.reserve(capacity);
+        break;
+    case DataType::TIMESTAMP:
+        timestamps.reserve(capacity);
+        break;
+    case DataType::FLOAT:
+        floats.reserve(capacity);
+        break;
+    case DataType::BOOL:
+        bits.reserve((capacity + 63) / 64);
+        break;
+    case DataType::STRING:
+    case DataType::BLOB:
+        offsets.reserve(capacity);
+        lengths.reserve(capacity);
+        break;
+    }
+    syncView();
+}
+
+void ColumnVector::clear() {
+    count = 0;
+    deadBytes = 0;
+    ints.clear();
+    timestamps.clear();
+    floats.clear();
+    bits.clear();
+    offsets.clear();
+    lengths.clear();
+    bytes.clear();
+    syncView();
+}
+
+size_t ColumnVector::memoryUsage() const {
+    return ints.capacity() * sizeof(int)
+        + timestamps.capacity() * sizeof(std::time_t)
+        + floats.capacity() * sizeof(float)
+        + bits.capacity() * sizeof(uint64_t)
+        + offsets.capacity() * sizeof(uint64_t)
+        + lengths.capacity() * sizeof(uint32_t)
+        + bytes.capacity();
+}
+
+ColumnVector::Arrays ColumnVector::getArrays() const {
+    Arrays arrays = view;
+    switch (type) {
+    case DataType::INT:
+        arrays.valueBytes = count * sizeof(int);
+        break;
+    case DataType::TIMESTAMP:
+        arrays.valueBytes = count * sizeof(std::time_t);
+        break;
+    case DataType::FLOAT:
+        arrays.valueBytes = count * sizeof(float);
+        break;
+    case DataType::BOOL:
+        arrays.valueBytes = (count + 63) / 64 * sizeof(uint64_t);
+        break;
+    case DataType::STRING:
+    case DataType::BLOB:
+        arrays.valueBytes = 0;
+        break;
+    }
+    return arrays;
+}
+
+void ColumnVector::syncView() {
+    switch (type) {
+    case DataType::INT:
+        view.values = ints.data();
+        break;
+    case DataType::TIMESTAMP:
+        view.values = timestamps.data();
+        break;
+    case DataType::FLOAT:
+        view.values = floats.data();
+        break;
+    case DataType::BOOL:
+        view.values = bits.data();
+        break;
+    case DataType::STRING:
+    case DataType::BLOB:
+        view.values = nullptr;
+        break;
+    }
+    view.offsets = offsets.data();
+    view.lengths = lengths.data();
+    view.bytes = bytes.data();
+    view.byteCount = bytes.size();
+}
+
+void ColumnVector::setBool(RowId row, bool value) {
+    uint64_t mask = uint64_t(1) << (row & 63);
+    if (value) {
+        bits[row >> 6] |= mask;
+    }
+    else {
+        bits[row >> 6] &= ~mask;
+    }
+}
+
+void ColumnVector::appendBytes(const uint8_t* data, size_t size) {
+    if (size > UINT32_MAX) {
+        throw std::runtime_error("Value too large for a column.");
+    }
+    offsets.push_back(bytes.size());
+    lengths.push_back(static_cast<uint32_t>(size));
+    bytes.insert(bytes.end(), data, data + size);
+}
+
+void ColumnVector::setBytes(RowId row, const uint8_t* data, size_t size) {
+    if (size > UINT32_MAX) {
+        throw std::runtime_error("Value too large for a column.");
+    }
+    if (size <= lengths[row]) {
+        // Shrinking values are rewritten in place
+        if (size > 0) {
+            std::memmove(bytes.data() + offsets[row], data, size);
+        }
+        deadBytes += lengths[row] - size;
+    }
+    else {
+        deadBytes += lengths[row];
+        offsets[row] = bytes.size();
+        bytes.insert(bytes.end(), data, data + size);
+    }
+    lengths[row] = static_cast<uint32_t>(size);
+
+    if (deadBytes > 4096 && deadBytes > bytes.size() / 2) {
+        compactBytes();
+    }
+}
+
+void ColumnVector::compactBytes() {
+    std::vector<uint8_t> packed;
+    packed.reserve(bytes.size() - deadBytes);
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* start = bytes.data() + offsets[i];
+        offsets[i] = packed.size();
+        packed.insert(packed.end(), start, start + lengths[i]);
+    }
+    bytes.swap(packed);
+    deadBytes = 0;
+}
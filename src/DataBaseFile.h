@@ -1,219 +1,888 @@
 // DataBaseFile.h
 #pragma once
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <map>
+#include <set>
 #include <sstream>
+#include "BlockStream.h"
+#include "ColumnCodec.h"
 #include "Database.h"
+#include "ParallelFor.h"
+#include "WriteAheadLog.h"
 
 namespace fs = std::filesystem;
 
 class DataBaseFile {
 public:
-    // Save the database to a binary file
-    static void saveDatabase(const Database& db, const std::string& dbName, DatabaseManager& dbManager) {
+    // Save the database to a binary file.
+    // A header carrying the format version is followed by a directory of section sizes and one
+    // section per table, each a run of CRC-32C checked blocks (see BlockStream.h). Inside a section
+    // the values are stored column by column in the encoding that suits them (see ColumnCodec.h).
+    // Sections are encoded on up to jobs threads (0 uses every core) and can be read back independently.
+    // The file is written beside the old one and renamed over it once complete.
+    static void saveDatabase(const Database& db, const std::string& dbName, DatabaseManager& dbManager, size_t jobs = 0) {
         fs::path path = fs::current_path();
         path /= dbName + ".db"; // Use the database name as the file name
-        std::ofstream file(path, std::ios::binary);
-        if (file.is_open()) {
-            // Write the number of tables
-            size_t numTables = db.tables.size();
-            file.write(reinterpret_cast<const char*>(&numTables), sizeof(numTables));
-
-            for (const auto& tablePair : db.tables) {
-                const Table& table = tablePair.second;
-
-                // Write the table name size and name
-                size_t tableNameSize = table.name.size();
-                file.write(reinterpret_cast<const char*>(&tableNameSize), sizeof(tableNameSize));
-                file.write(table.name.c_str(), tableNameSize);
-
-                // Write the number of columns
-                size_t numColumns = table.columns.size();
-                file.write(reinterpret_cast<const char*>(&numColumns), sizeof(numColumns));
-
-                // Write each column's name and type
-                for (const auto& column : table.columns) {
-                    size_t columnNameSize = column.name.size();
-                    file.write(reinterpret_cast<const char*>(&columnNameSize), sizeof(columnNameSize));
-                    file.write(column.name.c_str(), columnNameSize);
-
-                    DataType columnType = column.type;
-                    file.write(reinterpret_cast<const char*>(&columnType), sizeof(columnType));
-
-                    bool isPrimaryKey = column.isPrimaryKey;
-                    file.write(reinterpret_cast<const char*>(&isPrimaryKey), sizeof(isPrimaryKey));
-
-                    // Write the B-tree index if it exists
-                    bool hasIndex = column.index != nullptr;
-                    file.write(reinterpret_cast<const char*>(&hasIndex), sizeof(hasIndex));
-                    if (hasIndex) {
-                        column.index->serialize(file);
-                    }
-                }
+        fs::path tempPath = path;
+        tempPath += ".tmp";
 
-                // Write the number of rows
-                size_t numRows = table.rows.size();
-                file.write(reinterpret_cast<const char*>(&numRows), sizeof(numRows));
-
-                // Write each row's data
-                for (const auto& row : table.rows) {
-                    for (const auto& column : table.columns) {
-                        const std::string& columnName = column.name;
-                        const auto& value = row.getData(columnName);
-
-                        if (std::holds_alternative<int>(value)) {
-                            int intValue = std::get<int>(value);
-                            file.write(reinterpret_cast<const char*>(&intValue), sizeof(intValue));
-                        }
-                        else if (std::holds_alternative<std::string>(value)) {
-                            const std::string& strValue = std::get<std::string>(value);
-                            size_t valueSize = strValue.size();
-                            file.write(reinterpret_cast<const char*>(&valueSize), sizeof(valueSize));
-                            file.write(strValue.c_str(), valueSize);
-                        }
-                        else if (std::holds_alternative<bool>(value)) {
-                            bool boolValue = std::get<bool>(value);
-                            file.write(reinterpret_cast<const char*>(&boolValue), sizeof(boolValue));
-                        }
-                        else if (std::holds_alternative<std::time_t>(value)) {
-                            std::time_t timestampValue = std::get<std::time_t>(value);
-                            file.write(reinterpret_cast<const char*>(&timestampValue), sizeof(timestampValue));
-                        }
-                        else if (std::holds_alternative<float>(value)) {
-                            float floatValue = std::get<float>(value);
-                            file.write(reinterpret_cast<const char*>(&floatValue), sizeof(floatValue));
-                        }
-                        else if (std::holds_alternative<std::vector<uint8_t>>(value)) {
-                            const std::vector<uint8_t>& blobValue = std::get<std::vector<uint8_t>>(value);
-                            size_t blobSize = blobValue.size();
-                            file.write(reinterpret_cast<const char*>(&blobSize), sizeof(blobSize));
-                            file.write(reinterpret_cast<const char*>(blobValue.data()), blobSize);
-                        }
-                    }
-                }
+        std::vector<std::string> names = db.getTableNames();
+        std::vector<std::string> sections(names.size());
+        parallelFor(names.size(), jobs, [&](size_t i) {
+            Table temporary;
+            std::ostringstream section;
+            BlockWriteBuffer blocks(section);
+            std::ostream out(&blocks);
+            writeTable(out, readableTable(db, names[i], temporary));
+            blocks.finish();
+            sections[i] = section.str();
+        });
+
+        {
+            std::ofstream file(tempPath, std::ios::binary);
+            if (!file.is_open()) {
+                throw std::runtime_error("Failed to open database file: " + path.string());
+            }
+            writeFileHeader(file);
+            BlockWriteBuffer directoryBlocks(file);
+            std::ostream directory(&directoryBlocks);
+            writeU64(directory, sections.size());
+            for (const std::string& section : sections) {
+                writeU64(directory, section.size());
+            }
+            directoryBlocks.finish();
+            for (const std::string& section : sections) {
+                file.write(section.data(), section.size());
+            }
+            if (!file.flush()) {
+                throw std::runtime_error("Failed to write database file: " + path.string());
             }
-            file.close();
         }
+        fs::rename(tempPath, path);
     }
 
-    static Database loadDatabase(const std::string& dbName, DatabaseManager& dbManager) {
+    // Load a database saved by saveDatabase. Corrupt or truncated files throw instead of loading partially.
+    // Tables are read and their indexes rebuilt on up to jobs threads (0 uses every core).
+    // Files from before the header existed (version 1) hold the same fields without blocks or checksums,
+    // version 2 files hold every table in a single run of blocks and are read on one thread,
+    // version 3 files store their sections row by row.
+    static Database loadDatabase(const std::string& dbName, size_t jobs = 0) {
         Database db;
         fs::path path = fs::current_path();
         path /= dbName + ".db"; // Use the database name as the file name
         std::ifstream file(path, std::ios::binary);
         if (file.is_open()) {
-            size_t numTables = 0;
-            file.read(reinterpret_cast<char*>(&numTables), sizeof(numTables));
-            std::cout << "Number of tables: " << numTables << std::endl;
-
-            for (size_t i = 0; i < numTables; ++i) {
-                // Read the table name
-                size_t tableNameSize = 0;
-                file.read(reinterpret_cast<char*>(&tableNameSize), sizeof(tableNameSize));
-                if (tableNameSize > 1000) { // Arbitrary large value check
-                    throw std::runtime_error("Invalid table name size.");
+            uint32_t version = readFileHeader(file);
+            if (version == 1) {
+                readTables(file, db);
+            }
+            else if (version >= 3) {
+                readSections(file, path, db, version, jobs);
+            }
+            else {
+                BlockReadBuffer blocks(file);
+                std::istream in(&blocks);
+                in.exceptions(std::ios::badbit); // Checksum errors thrown by the buffer reach the caller
+                readTables(in, db);
+                if (in.peek() != std::char_traits<char>::eof() || !blocks.isComplete()) {
+                    throw std::runtime_error("Unexpected data at the end of the database file.");
                 }
-                std::string tableName(tableNameSize, '\0');
-                file.read(&tableName[0], tableNameSize);
-                std::cout << "Table name: " << tableName << std::endl;
-
-                Table table(tableName);
-
-                // Read the number of columns
-                size_t numColumns = 0;
-                file.read(reinterpret_cast<char*>(&numColumns), sizeof(numColumns));
-                std::cout << "Number of columns: " << numColumns << std::endl;
-
-                for (size_t j = 0; j < numColumns; ++j) {
-                    // Read each column's name
-                    size_t columnNameSize = 0;
-                    file.read(reinterpret_cast<char*>(&columnNameSize), sizeof(columnNameSize));
-                    if (columnNameSize > 1000) { // Arbitrary large value check
-                        throw std::runtime_error("Invalid column name size.");
-                    }
-                    std::string columnName(columnNameSize, '\0');
-                    file.read(&columnName[0], columnNameSize);
-                    std::cout << "Column name: " << columnName << std::endl;
-
-                    // Read each column's type
-                    DataType columnType;
-                    file.read(reinterpret_cast<char*>(&columnType), sizeof(columnType));
-                    std::cout << "Column type: " << static_cast<int>(columnType) << std::endl;
-
-                    // Read primary key flag
-                    bool isPrimaryKey;
-                    file.read(reinterpret_cast<char*>(&isPrimaryKey), sizeof(isPrimaryKey));
-                    std::cout << "Is primary key: " << isPrimaryKey << std::endl;
-
-                    Column column(columnName, columnType, isPrimaryKey);
-
-                    // Read the B-tree index if it exists
-                    bool hasIndex;
-                    file.read(reinterpret_cast<char*>(&hasIndex), sizeof(hasIndex));
-                    if (hasIndex) {
-                        column.index = std::make_unique<BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>>();
-                        column.index->deserialize(file);
-                    }
-
-                    table.addColumn(column);
+            }
+        }
+        return db;
+    }
+
+    // Write the changes since the last checkpoint into the directory dirName.
+    // Every page of Table::PAGE_ROWS row ids is a segment file of its own. Only dirty pages are
+    // written, clean ones keep the segment the previous manifest points at. The new manifest
+    // replaces the old one with a rename once every segment is synced, so a crash leaves
+    // either checkpoint whole. Tables loaded from elsewhere are written in full.
+    // A segment holds the live flags and then each column of its page, encoded as in saveDatabase.
+    // The manifest ends with db.appliedLsn, the log records replay passes over for this database.
+    // Segments are encoded and synced on up to jobs threads (0 uses every core).
+    static void checkpoint(Database& db, const std::string& dirName, size_t jobs = 0) {
+        fs::path dir = fs::current_path() / dirName;
+        fs::create_directories(dir);
+
+        // Segments of the previous checkpoint, by table
+        uint64_t generation = 0;
+        std::map<std::string, std::vector<uint64_t>> previousPages;
+        std::ifstream previous(dir / MANIFEST_NAME, std::ios::binary);
+        if (previous.is_open()) {
+            BlockReadBuffer blocks(previous);
+            std::istream in(&blocks);
+            in.exceptions(std::ios::badbit);
+            uint32_t previousVersion = 0;
+            generation = readPageTable(in, previousPages, previousVersion);
+            // Segments in an older layout are not mixed with new ones, every page is rewritten
+            if (previousVersion < SEGMENT_VERSION) {
+                previousPages.clear();
+            }
+        }
+        generation++;
+
+        std::ostringstream manifestFile;
+        BlockWriteBuffer manifestBlocks(manifestFile);
+        std::ostream manifest(&manifestBlocks);
+        writeRaw(manifest, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+        writeU32(manifest, CHECKPOINT_VERSION);
+        writeU64(manifest, generation);
+
+        // Pages that keep their segment, and the dirty ones to write.
+        // Stored tables that were never loaded keep their segments if they are in this directory,
+        // otherwise they are read and written in full.
+        std::vector<std::string> names = db.getTableNames();
+        std::vector<const Table*> tables;       // nullptr for stored tables that keep their segments
+        std::vector<Table> temporaries;
+        temporaries.reserve(names.size());
+        std::vector<size_t> tableSlots;
+        std::vector<std::vector<uint64_t>> tablePages;
+        std::vector<std::pair<size_t, size_t>> dirtyPages;
+        writeU64(manifest, names.size());
+        for (const std::string& tableName : names) {
+            auto loaded = db.tables.find(tableName);
+            const Table* source = loaded != db.tables.end() ? &loaded->second : nullptr;
+            if (!source) {
+                const StoredTable& stored = db.storedTables.at(tableName);
+                if (fs::path(stored.directory) == dir && stored.layoutVersion >= SEGMENT_VERSION) {
+                    tables.push_back(nullptr);
+                    tableSlots.push_back(stored.slotCount);
+                    tablePages.push_back(stored.pages);
+                    continue;
                 }
+                temporaries.push_back(loadStoredTable(tableName, stored));
+                temporaries.back().markAllDirty();
+                source = &temporaries.back();
+            }
+            const Table& table = *source;
+            auto previousTable = previousPages.find(table.name);
+            // A table read from another checkpoint has clean pages that are not in this one
+            auto stored = db.storedTables.find(tableName);
+            if (stored != db.storedTables.end() && fs::path(stored->second.directory) != dir) {
+                previousTable = previousPages.end();
+            }
 
-                // Read the number of rows
-                size_t numRows = 0;
-                file.read(reinterpret_cast<char*>(&numRows), sizeof(numRows));
-                std::cout << "Number of rows: " << numRows << std::endl;
-
-                for (size_t k = 0; k < numRows; ++k) {
-                    Row row;
-                    for (const auto& column : table.columns) {
-                        if (column.type == DataType::INT) {
-                            int intValue;
-                            file.read(reinterpret_cast<char*>(&intValue), sizeof(intValue));
-                            row.addData(column.name, intValue);
-                        }
-                        else if (column.type == DataType::STRING) {
-                            size_t valueSize = 0;
-                            file.read(reinterpret_cast<char*>(&valueSize), sizeof(valueSize));
-                            if (valueSize > 1000000) { // Arbitrary large value check
-                                throw std::runtime_error("Invalid string value size.");
-                            }
-                            std::string strValue(valueSize, '\0');
-                            file.read(&strValue[0], valueSize);
-                            row.addData(column.name, strValue);
-                        }
-                        else if (column.type == DataType::BOOL) {
-                            bool boolValue;
-                            file.read(reinterpret_cast<char*>(&boolValue), sizeof(boolValue));
-                            row.addData(column.name, boolValue);
-                        }
-                        else if (column.type == DataType::TIMESTAMP) {
-                            std::time_t timestampValue;
-                            file.read(reinterpret_cast<char*>(&timestampValue), sizeof(timestampValue));
-                            row.addData(column.name, timestampValue);
-                        }
-                        else if (column.type == DataType::FLOAT) {
-                            float floatValue;
-                            file.read(reinterpret_cast<char*>(&floatValue), sizeof(floatValue));
-                            row.addData(column.name, floatValue);
-                        }
-                        else if (column.type == DataType::BLOB) {
-                            size_t blobSize = 0;
-                            file.read(reinterpret_cast<char*>(&blobSize), sizeof(blobSize));
-                            if (blobSize > 1000000) { // Arbitrary large value check
-                                throw std::runtime_error("Invalid blob value size.");
-                            }
-                            std::vector<uint8_t> blobValue(blobSize);
-                            file.read(reinterpret_cast<char*>(blobValue.data()), blobSize);
-                            row.addData(column.name, blobValue);
-                        }
-                    }
-                    table.addRow(row, dbManager); // Pass the DatabaseManager reference here
+            std::vector<uint64_t> pages(table.pageCount(), generation);
+            for (size_t page = 0; page < pages.size(); ++page) {
+                bool reusable = previousTable != previousPages.end() && page < previousTable->second.size() && !table.isPageDirty(page);
+                if (reusable) {
+                    pages[page] = previousTable->second[page];
+                }
+                else {
+                    dirtyPages.emplace_back(tables.size(), page);
                 }
+            }
+            tables.push_back(&table);
+            tableSlots.push_back(table.slotCount());
+            tablePages.push_back(std::move(pages));
+        }
+
+        parallelFor(dirtyPages.size(), jobs, [&](size_t i) {
+            const Table& table = *tables[dirtyPages[i].first];
+            size_t page = dirtyPages[i].second;
+
+            // Deleted slots are written too so row ids survive the round trip
+            std::ostringstream segmentFile;
+            BlockWriteBuffer segmentBlocks(segmentFile);
+            std::ostream segment(&segmentBlocks);
+            RowId start = page * Table::PAGE_ROWS;
+            RowId end = std::min(table.slotCount(), start + Table::PAGE_ROWS);
+            std::vector<RowId> rows;
+            std::vector<uint64_t> liveBits((end - start + 63) / 64, 0);
+            for (RowId row = start; row < end; ++row) {
+                rows.push_back(row);
+                liveBits[(row - start) >> 6] |= uint64_t(table.isLive(row)) << ((row - start) & 63);
+            }
+            encodeBools(segment, liveBits, rows.size());
+            for (const auto& data : table.columnData) {
+                writeColumnValues(segment, data, rows);
+            }
+            segmentBlocks.finish();
+            writeDurably(dir / segmentName(table.name, page, generation), segmentFile.str());
+        });
+
+        std::set<std::string> liveSegments;
+        for (size_t t = 0; t < names.size(); ++t) {
+            const std::vector<uint64_t>& pages = tablePages[t];
+            writeBytes(manifest, names[t].data(), names[t].size());
+            writeU64(manifest, tableSlots[t]);
+            writeU64(manifest, pages.size());
+            for (size_t page = 0; page < pages.size(); ++page) {
+                writeU64(manifest, pages[page]);
+                liveSegments.insert(segmentName(names[t], page, pages[page]));
+            }
+        }
+
+        // Table definitions follow the page table, in the same order
+        for (size_t t = 0; t < names.size(); ++t) {
+            if (tables[t]) {
+                writeColumns(manifest, *tables[t]);
+            }
+            else {
+                const std::string& definition = db.storedTables.at(names[t]).definition;
+                writeRaw(manifest, definition.data(), definition.size());
+            }
+        }
+        writeU64(manifest, db.appliedLsn);
+
+        manifestBlocks.finish();
+        writeDurably(dir / MANIFEST_TEMP_NAME, manifestFile.str());
+        fs::rename(dir / MANIFEST_TEMP_NAME, dir / MANIFEST_NAME);
+
+        // Every table now matches its segments, so loaded ones can be evicted and read back from here
+        for (size_t t = 0; t < names.size(); ++t) {
+            if (tables[t]) {
+                db.storedTables[names[t]] = storedTable(*tables[t], dir, CHECKPOINT_VERSION, tableSlots[t], tablePages[t]);
+            }
+        }
+        for (auto& tablePair : db.tables) {
+            tablePair.second.clearDirty();
+        }
+        db.tableLoader = loadStoredTable;
+
+        // Segments only the previous checkpoint used
+        for (const auto& entry : fs::directory_iterator(dir)) {
+            if (entry.path().extension() == ".seg" && !liveSegments.count(entry.path().filename().string())) {
+                std::error_code ignored;
+                fs::remove(entry.path(), ignored);
+            }
+        }
+    }
+
+    static bool hasCheckpoint(const std::string& dirName) {
+        return fs::exists(fs::current_path() / dirName / MANIFEST_NAME);
+    }
+
+    // Load the database written by checkpoint, every table starts out clean.
+    // Tables are read and their indexes rebuilt on up to jobs threads (0 uses every core).
+    static Database loadCheckpoint(const std::string& dirName, size_t jobs = 0) {
+        Database db = openCheckpoint(dirName);
+        std::vector<std::string> names = db.getTableNames();
+        std::vector<Table> tables(names.size());
+        parallelFor(names.size(), jobs, [&](size_t i) {
+            tables[i] = loadStoredTable(names[i], db.storedTables.at(names[i]));
+        });
+        // The stored entries stay, the tables can be evicted until they change
+        for (size_t i = 0; i < names.size(); ++i) {
+            db.storedTables[names[i]].changes = tables[i].changes;
+            db.tables.emplace(names[i], std::move(tables[i]));
+        }
+        return db;
+    }
+
+    // Open the database written by checkpoint without reading any rows. Only the manifest is
+    // read, every table is read from its segments the first time Database::getTable asks for it.
+    static Database openCheckpoint(const std::string& dirName) {
+        Database db;
+        fs::path dir = fs::current_path() / dirName;
+        std::ifstream manifestFile(dir / MANIFEST_NAME, std::ios::binary);
+        if (!manifestFile.is_open()) {
+            throw std::runtime_error("Checkpoint manifest not found in " + dirName + ".");
+        }
+        BlockReadBuffer manifestBlocks(manifestFile);
+        std::istream manifest(&manifestBlocks);
+        manifest.exceptions(std::ios::badbit);
 
-                db.addTable(table);
+        std::vector<std::pair<std::string, size_t>> tableSlots;
+        std::map<std::string, std::vector<uint64_t>> tablePages;
+        uint32_t version = 0;
+        readPageTable(manifest, tablePages, version, &tableSlots);
+
+        for (const auto& [tableName, numSlots] : tableSlots) {
+            Table table(tableName);
+            readColumns(manifest, table, version >= 3);
+            if (!manifest) {
+                throw std::runtime_error("Truncated checkpoint manifest.");
             }
-            file.close();
+            db.storedTables[tableName] = storedTable(table, dir, version, numSlots, tablePages[tableName]);
         }
+        if (version >= 4) {
+            db.appliedLsn = readU64(manifest);
+            if (!manifest) {
+                throw std::runtime_error("Truncated checkpoint manifest.");
+            }
+        }
+        db.tableLoader = loadStoredTable;
         return db;
     }
+
+    // Read a table from its checkpoint segments, it starts out clean
+    static Table loadStoredTable(const std::string& tableName, const StoredTable& stored) {
+        Table table(tableName);
+        std::istringstream definition(stored.definition);
+        readColumns(definition, table, true);
+
+        fs::path dir = stored.directory;
+        size_t numSlots = stored.slotCount;
+        std::vector<Value> row;
+        table.reserveRows(numSlots);
+        row.reserve(table.columns.size());
+        for (size_t page = 0; page < stored.pages.size(); ++page) {
+            std::ifstream segmentFile(dir / segmentName(tableName, page, stored.pages[page]), std::ios::binary);
+            if (!segmentFile.is_open()) {
+                throw std::runtime_error("Missing checkpoint segment for table " + tableName + ".");
+            }
+            BlockReadBuffer segmentBlocks(segmentFile);
+            std::istream segment(&segmentBlocks);
+            segment.exceptions(std::ios::badbit);
+            RowId start = page * Table::PAGE_ROWS;
+            RowId end = std::min(numSlots, start + Table::PAGE_ROWS);
+            if (stored.layoutVersion >= SEGMENT_VERSION) {
+                std::vector<uint64_t> liveBits;
+                decodeBools(segment, liveBits, end - start);
+                for (auto& data : table.columnData) {
+                    readColumnValues(segment, data, end - start);
+                }
+                for (RowId slot = start; slot < end; ++slot) {
+                    bool isLive = (liveBits[(slot - start) >> 6] >> ((slot - start) & 63)) & 1;
+                    table.live.push_back(isLive);
+                    table.liveRows += isLive;
+                }
+                continue;
+            }
+            // Version 1 segments store their slots row by row
+            for (RowId slot = start; slot < end; ++slot) {
+                bool isLive = readU8(segment) != 0;
+                readValues(segment, table, row);
+                if (!segment) {
+                    throw std::runtime_error("Truncated checkpoint segment for table " + tableName + ".");
+                }
+                table.appendRowValues(row, isLive);
+            }
+        }
+        table.rebuildIndexes();
+        table.clearDirty();
+        return table;
+    }
+
+    // Save every database of dbManager as a checkpoint directory inside dirName, and a catalog
+    // listing them. Stored tables that were never loaded keep their segments.
+    // appliedLsn is the last write-ahead log record the databases hold, it is saved with each of them.
+    static void saveCatalog(DatabaseManager& dbManager, const std::string& dirName, uint64_t appliedLsn, size_t jobs = 0) {
+        fs::path dir = fs::current_path() / dirName;
+        fs::create_directories(dir);
+        for (auto& databasePair : dbManager.databases) {
+            databasePair.second.appliedLsn = appliedLsn;
+            checkpoint(databasePair.second, (fs::path(dirName) / databasePair.first).string(), jobs);
+        }
+
+        std::ostringstream catalogFile;
+        BlockWriteBuffer catalogBlocks(catalogFile);
+        std::ostream catalog(&catalogBlocks);
+        writeRaw(catalog, CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+        writeU32(catalog, CATALOG_VERSION);
+        writeU64(catalog, dbManager.databases.size());
+        for (const auto& databasePair : dbManager.databases) {
+            writeBytes(catalog, databasePair.first.data(), databasePair.first.size());
+        }
+        writeBytes(catalog, dbManager.currentDatabaseName.data(), dbManager.currentDatabaseName.size());
+        writeU64(catalog, appliedLsn);
+        catalogBlocks.finish();
+        writeDurably(dir / CATALOG_TEMP_NAME, catalogFile.str());
+        fs::rename(dir / CATALOG_TEMP_NAME, dir / CATALOG_NAME);
+        dbManager.appliedLsn = appliedLsn;
+    }
+
+    static bool hasCatalog(const std::string& dirName) {
+        return fs::exists(fs::current_path() / dirName / CATALOG_NAME);
+    }
+
+    // Open every database listed in the catalog in dirName without reading any rows (see openCheckpoint),
+    // and select the database that was current when the catalog was saved.
+    // Version 1 catalogs have no log position, every logged record is replayed after them.
+    static void openCatalog(const std::string& dirName, DatabaseManager& dbManager) {
+        fs::path dir = fs::current_path() / dirName;
+        std::ifstream catalogFile(dir / CATALOG_NAME, std::ios::binary);
+        if (!catalogFile.is_open()) {
+            throw std::runtime_error("Catalog not found in " + dirName + ".");
+        }
+        BlockReadBuffer catalogBlocks(catalogFile);
+        std::istream catalog(&catalogBlocks);
+        catalog.exceptions(std::ios::badbit);
+
+        char magic[sizeof(CATALOG_MAGIC)] = {};
+        readRaw(catalog, magic, sizeof(magic));
+        uint32_t version = readU32(catalog);
+        if (!catalog || std::memcmp(magic, CATALOG_MAGIC, sizeof(CATALOG_MAGIC)) != 0) {
+            throw std::runtime_error("Not a database catalog: " + dirName);
+        }
+        if (version > CATALOG_VERSION) {
+            throw std::runtime_error("Catalog version " + std::to_string(version) + " is newer than this program supports.");
+        }
+        uint64_t numDatabases = readU64(catalog);
+        for (uint64_t i = 0; i < numDatabases && catalog; ++i) {
+            std::string databaseName = readBytes(catalog, MAX_NAME_SIZE);
+            dbManager.databases[databaseName] = openCheckpoint((fs::path(dirName) / databaseName).string());
+        }
+        std::string current = readBytes(catalog, MAX_NAME_SIZE);
+        dbManager.appliedLsn = version >= 2 ? readU64(catalog) : 0;
+        if (!catalog) {
+            throw std::runtime_error("Truncated catalog in " + dirName + ".");
+        }
+        dbManager.currentDatabase = nullptr;
+        dbManager.selectDatabase(current);
+    }
+
+private:
+    // A table of db to read from, a stored table that is not in memory is read into temporary
+    static const Table& readableTable(const Database& db, const std::string& tableName, Table& temporary) {
+        auto loaded = db.tables.find(tableName);
+        if (loaded != db.tables.end()) {
+            return loaded->second;
+        }
+        temporary = loadStoredTable(tableName, db.storedTables.at(tableName));
+        return temporary;
+    }
+
+    // Where a table written to a checkpoint lives, with its definition and secondary index names
+    static StoredTable storedTable(const Table& table, const fs::path& dir, uint32_t version, size_t numSlots, const std::vector<uint64_t>& pages) {
+        StoredTable stored;
+        stored.directory = dir.string();
+        stored.layoutVersion = version;
+        stored.slotCount = numSlots;
+        stored.pages = pages;
+        std::ostringstream definition;
+        writeColumns(definition, table);
+        stored.definition = definition.str();
+        for (const auto& column : table.columns) {
+            if (column.index) {
+                stored.indexNames.push_back(column.indexName);
+            }
+        }
+        stored.changes = table.changes;
+        return stored;
+    }
+
+    static constexpr char FILE_MAGIC[8] = { 'A', 'T', 'L', 'A', 'S', 'D', 'B', '\0' };
+    static constexpr uint32_t FILE_VERSION = 5;
+    static constexpr size_t MAX_NAME_SIZE = 1000;       // Arbitrary large value check
+    static constexpr size_t MAX_VALUE_SIZE = 1000000;   // Arbitrary large value check
+
+    // Magic, format version and a CRC-32C of both
+    static void writeFileHeader(std::ostream& out) {
+        std::ostringstream header;
+        header.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+        writeU32(header, FILE_VERSION);
+        std::string bytes = header.str();
+        out.write(bytes.data(), bytes.size());
+        writeU32(out, crc32c(bytes.data(), bytes.size()));
+    }
+
+    // Version of the file, the stream is left at the first block. Version 1 files have no header.
+    static uint32_t readFileHeader(std::istream& in) {
+        char header[sizeof(FILE_MAGIC) + sizeof(uint32_t)];
+        if (!in.read(header, sizeof(header)) || std::memcmp(header, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+            in.clear();
+            in.seekg(0);
+            return 1;
+        }
+        std::istringstream fields(std::string(header + sizeof(FILE_MAGIC), sizeof(uint32_t)));
+        uint32_t version = readU32(fields);
+        if (readU32(in) != crc32c(header, sizeof(header))) {
+            throw std::runtime_error("Database file header is corrupt.");
+        }
+        if (version > FILE_VERSION) {
+            throw std::runtime_error("Database file version " + std::to_string(version) + " is newer than this program supports.");
+        }
+        return version;
+    }
+
+    // A table: name, column definitions, row count and the live rows one column after another
+    static void writeTable(std::ostream& out, const Table& table) {
+        writeBytes(out, table.name.data(), table.name.size());
+        writeColumns(out, table);
+        writeU64(out, table.rowCount());
+        std::vector<RowId> rows;
+        rows.reserve(table.rowCount());
+        table.forEachRow([&](RowId row) {
+            rows.push_back(row);
+        });
+        for (const auto& data : table.columnData) {
+            writeColumnValues(out, data, rows);
+        }
+    }
+
+    // Read a table written by writeTable and build its indexes.
+    // Files before version 4 store the values row by row, files before version 5 have no index fanout.
+    static Table readTable(std::istream& in, uint32_t version) {
+        Table table(readBytes(in, MAX_NAME_SIZE));
+        readColumns(in, table, version >= 5);
+        uint64_t numRows = readU64(in);
+        if (!in) {
+            throw std::runtime_error("Database file is truncated.");
+        }
+
+        // Rows were validated when they were saved, so they are appended as-is
+        // and the indexes are bulk loaded once every row is in place
+        if (version >= 4) {
+            if (numRows > MAX_RESERVED_ROWS * 64) {
+                throw std::runtime_error("Invalid row count.");
+            }
+            for (auto& data : table.columnData) {
+                readColumnValues(in, data, static_cast<size_t>(numRows));
+            }
+            table.live.assign(static_cast<size_t>(numRows), true);
+            table.liveRows = static_cast<size_t>(numRows);
+            table.markAllDirty();
+        }
+        else {
+            table.reserveRows(static_cast<size_t>(std::min<uint64_t>(numRows, MAX_RESERVED_ROWS)));
+            std::vector<Value> row;
+            row.reserve(table.columns.size());
+            for (uint64_t k = 0; k < numRows && in; ++k) {
+                readValues(in, table, row);
+                table.appendRowValues(row);
+            }
+        }
+        if (!in) {
+            throw std::runtime_error("Database file is truncated.");
+        }
+        table.rebuildIndexes();
+        return table;
+    }
+
+    // Version 1 and 2 files: the table count followed by every table in turn
+    static void readTables(std::istream& in, Database& db) {
+        uint64_t numTables = readU64(in);
+        for (uint64_t i = 0; i < numTables && in; ++i) {
+            db.addTable(readTable(in, 1));
+        }
+        if (!in) {
+            throw std::runtime_error("Database file is truncated.");
+        }
+    }
+
+    // Version 3 and later files: a directory of section sizes, then one section per table.
+    // Every worker opens the file itself and seeks to the sections it reads.
+    static void readSections(std::istream& file, const fs::path& path, Database& db, uint32_t version, size_t jobs) {
+        std::vector<uint64_t> offsets;
+        std::vector<uint64_t> sizes;
+        {
+            BlockReadBuffer directoryBlocks(file);
+            std::istream directory(&directoryBlocks);
+            directory.exceptions(std::ios::badbit);
+            uint64_t numTables = readU64(directory);
+            for (uint64_t i = 0; i < numTables && directory; ++i) {
+                sizes.push_back(readU64(directory));
+            }
+            if (!directory || directory.peek() != std::char_traits<char>::eof() || !directoryBlocks.isComplete()) {
+                throw std::runtime_error("Database file directory is corrupt.");
+            }
+        }
+        // The block reader stops right after the end marker, the first section starts there
+        uint64_t offset = static_cast<uint64_t>(file.tellg());
+        uint64_t fileSize = fs::file_size(path);
+        for (uint64_t size : sizes) {
+            if (size > fileSize - std::min(offset, fileSize)) {
+                throw std::runtime_error("Database file is truncated.");
+            }
+            offsets.push_back(offset);
+            offset += size;
+        }
+
+        std::vector<Table> tables(sizes.size());
+        parallelFor(tables.size(), jobs, [&](size_t i) {
+            std::ifstream sectionFile(path, std::ios::binary);
+            if (!sectionFile.is_open() || !sectionFile.seekg(static_cast<std::streamoff>(offsets[i]))) {
+                throw std::runtime_error("Failed to open database file: " + path.string());
+            }
+            BlockReadBuffer blocks(sectionFile);
+            std::istream in(&blocks);
+            in.exceptions(std::ios::badbit);
+            tables[i] = readTable(in, version);
+            if (in.peek() != std::char_traits<char>::eof() || !blocks.isComplete()
+                || static_cast<uint64_t>(sectionFile.tellg()) != offsets[i] + sizes[i]) {
+                throw std::runtime_error("Database file section is corrupt.");
+            }
+        });
+        for (Table& table : tables) {
+            db.addTable(std::move(table));
+        }
+    }
+
+    // A corrupt row count must not reserve unbounded memory up front
+    static constexpr uint64_t MAX_RESERVED_ROWS = 1 << 24;
+
+    // Column definitions of a table: name, type, primary key flag and index kind, index fanout,
+    // secondary index kind and name
+    static void writeColumns(std::ostream& out, const Table& table) {
+        writeU64(out, table.columns.size());
+        for (const auto& column : table.columns) {
+            writeBytes(out, column.name.data(), column.name.size());
+            writeU32(out, static_cast<uint32_t>(column.type));
+            writeU8(out, column.isPrimaryKey);
+            if (column.isPrimaryKey) {
+                IndexKind primaryKeyKind = table.getPrimaryKeyIndex() ? table.getPrimaryKeyIndex()->getKind() : column.indexKind;
+                writeU32(out, static_cast<uint32_t>(primaryKeyKind));
+            }
+            writeU32(out, static_cast<uint32_t>(column.indexFanout));
+
+            // Write the index kind and name if the column is indexed, the index itself is rebuilt from the rows on load
+            writeU8(out, column.index != nullptr);
+            if (column.index) {
+                writeU32(out, static_cast<uint32_t>(column.index->getKind()));
+                writeBytes(out, column.indexName.data(), column.indexName.size());
+            }
+        }
+    }
+
+    // Definitions from before the fanout was stored (hasFanout false) get the default node size
+    static void readColumns(std::istream& in, Table& table, bool hasFanout) {
+        uint64_t numColumns = readU64(in);
+        for (uint64_t j = 0; j < numColumns && in; ++j) {
+            std::string columnName = readBytes(in, MAX_NAME_SIZE);
+            uint32_t columnType = readU32(in);
+            if (columnType > static_cast<uint32_t>(DataType::BLOB)) {
+                throw std::runtime_error("Invalid column type.");
+            }
+            bool isPrimaryKey = readU8(in) != 0;
+
+            Column column(columnName, static_cast<DataType>(columnType), isPrimaryKey);
+            if (isPrimaryKey) {
+                column.setIndexKind(readIndexKind(in));
+            }
+            if (hasFanout) {
+                uint32_t fanout = readU32(in);
+                if (fanout > static_cast<uint32_t>(std::numeric_limits<int>::max()) || (fanout != 0 && fanout < 4)) {
+                    throw std::runtime_error("Invalid index fanout.");
+                }
+                column.setIndexFanout(static_cast<int>(fanout));
+            }
+
+            // Recreate the secondary index, it is filled once the rows are read
+            bool hasIndex = readU8(in) != 0;
+            if (hasIndex) {
+                IndexKind indexKind = readIndexKind(in);
+                column.indexName = readBytes(in, MAX_NAME_SIZE);
+                column.index = makeIndex(column.type, indexKind, column.getIndexDegree(), false);
+            }
+
+            table.addColumn(column);
+        }
+    }
+
+    static IndexKind readIndexKind(std::istream& in) {
+        uint32_t kind = readU32(in);
+        if (kind > static_cast<uint32_t>(IndexKind::HASH)) {
+            throw std::runtime_error("Invalid index kind.");
+        }
+        return static_cast<IndexKind>(kind);
+    }
+
+    // Values of a column at the given rows, encoded as a whole (see ColumnCodec.h)
+    static void writeColumnValues(std::ostream& out, const ColumnVector& data, const std::vector<RowId>& rows) {
+        switch (data.getType()) {
+        case DataType::INT: {
+            std::vector<int> values(rows.size());
+            for (size_t i = 0; i < rows.size(); ++i) {
+                values[i] = data.getInt(rows[i]);
+            }
+            encodeIntegers(out, values);
+            break;
+        }
+        case DataType::TIMESTAMP: {
+            std::vector<int64_t> values(rows.size());
+            for (size_t i = 0; i < rows.size(); ++i) {
+                values[i] = static_cast<int64_t>(data.getTimestamp(rows[i]));
+            }
+            encodeIntegers(out, values);
+            break;
+        }
+        case DataType::FLOAT: {
+            std::vector<float> values(rows.size());
+            for (size_t i = 0; i < rows.size(); ++i) {
+                values[i] = data.getFloat(rows[i]);
+            }
+            encodeFloats(out, values);
+            break;
+        }
+        case DataType::BOOL: {
+            std::vector<uint64_t> bits((rows.size() + 63) / 64, 0);
+            for (size_t i = 0; i < rows.size(); ++i) {
+                bits[i >> 6] |= uint64_t(data.getBool(rows[i])) << (i & 63);
+            }
+            encodeBools(out, bits, rows.size());
+            break;
+        }
+        case DataType::STRING:
+        case DataType::BLOB: {
+            std::vector<std::string_view> values(rows.size());
+            for (size_t i = 0; i < rows.size(); ++i) {
+                values[i] = data.getBytes(rows[i]);
+            }
+            encodeStrings(out, values);
+            break;
+        }
+        }
+    }
+
+    // Decode count values written by writeColumnValues and append them to the column
+    static void readColumnValues(std::istream& in, ColumnVector& data, size_t count) {
+        switch (data.getType()) {
+        case DataType::INT: {
+            std::vector<int> values;
+            decodeIntegers(in, values, count);
+            data.appendValues(values.data(), count);
+            break;
+        }
+        case DataType::TIMESTAMP: {
+            std::vector<int64_t> values;
+            decodeIntegers(in, values, count);
+            std::vector<std::time_t> timestamps(values.begin(), values.end());
+            data.appendValues(timestamps.data(), count);
+            break;
+        }
+        case DataType::FLOAT: {
+            std::vector<float> values;
+            decodeFloats(in, values, count);
+            data.appendValues(values.data(), count);
+            break;
+        }
+        case DataType::BOOL: {
+            std::vector<uint64_t> bits;
+            decodeBools(in, bits, count);
+            data.appendBits(bits.data(), count);
+            break;
+        }
+        case DataType::STRING:
+        case DataType::BLOB: {
+            std::vector<uint32_t> lengths;
+            std::vector<uint8_t> bytes;
+            decodeStrings(in, lengths, bytes, count, MAX_VALUE_SIZE);
+            data.appendByteValues(lengths.data(), bytes.data(), count);
+            break;
+        }
+        }
+        if (!in) {
+            throw std::runtime_error("Database file is truncated.");
+        }
+    }
+
+    // Values of one row in column order
+    static void writeValues(std::ostream& out, const Table& table, RowId row) {
+        for (size_t c = 0; c < table.columns.size(); ++c) {
+            const ColumnVector& data = table.columnData[c];
+
+            if (data.getType() == DataType::INT) {
+                writeI32(out, data.getInt(row));
+            }
+            else if (data.getType() == DataType::STRING || data.getType() == DataType::BLOB) {
+                std::string_view bytes = data.getBytes(row);
+                writeBytes(out, bytes.data(), bytes.size());
+            }
+            else if (data.getType() == DataType::BOOL) {
+                writeU8(out, data.getBool(row));
+            }
+            else if (data.getType() == DataType::TIMESTAMP) {
+                writeI64(out, static_cast<int64_t>(data.getTimestamp(row)));
+            }
+            else if (data.getType() == DataType::FLOAT) {
+                writeF32(out, data.getFloat(row));
+            }
+        }
+    }
+
+    static void readValues(std::istream& in, const Table& table, std::vector<Value>& row) {
+        row.clear();
+        for (const auto& column : table.columns) {
+            if (column.type == DataType::INT) {
+                row.push_back(static_cast<int>(readI32(in)));
+            }
+            else if (column.type == DataType::STRING) {
+                row.push_back(readBytes(in, MAX_VALUE_SIZE));
+            }
+            else if (column.type == DataType::BOOL) {
+                row.push_back(readU8(in) != 0);
+            }
+            else if (column.type == DataType::TIMESTAMP) {
+                row.push_back(static_cast<std::time_t>(readI64(in)));
+            }
+            else if (column.type == DataType::FLOAT) {
+                row.push_back(readF32(in));
+            }
+            else if (column.type == DataType::BLOB) {
+                std::string blob = readBytes(in, MAX_VALUE_SIZE);
+                row.push_back(std::vector<uint8_t>(blob.begin(), blob.end()));
+            }
+        }
+    }
+
+    static constexpr char MANIFEST_MAGIC[8] = { 'A', 'T', 'L', 'A', 'S', 'C', 'K', 'P' };
+    static constexpr uint32_t CHECKPOINT_VERSION = 4; // Version 1 segments store their slots row by row, version 2 manifests
+                                                      // have no index fanout and version 3 ones no log position
+    static constexpr uint32_t SEGMENT_VERSION = 2;    // Oldest checkpoint version whose segments are in the current layout
+    static constexpr const char* MANIFEST_NAME = "MANIFEST";
+    static constexpr char CATALOG_MAGIC[8] = { 'A', 'T', 'L', 'A', 'S', 'C', 'A', 'T' };
+    static constexpr uint32_t CATALOG_VERSION = 2;
+    static constexpr const char* CATALOG_NAME = "CATALOG";
+    static constexpr const char* CATALOG_TEMP_NAME = "CATALOG.tmp";
+    static constexpr const char* MANIFEST_TEMP_NAME = "MANIFEST.tmp";
+
+    static std::string segmentName(const std::string& tableName, size_t page, uint64_t generation) {
+        return tableName + "." + std::to_string(page) + "." + std::to_string(generation) + ".seg";
+    }
+
+    // Replace the file at path with data and sync it to disk
+    static void writeDurably(const fs::path& path, const std::string& data) {
+        std::error_code ignored;
+        fs::remove(path, ignored); // Left over from a checkpoint that did not finish
+        LogFile file;
+        file.open(path.string());
+        file.write(data.data(), data.size());
+        file.sync();
+    }
+
+    // Force a file written through a stream to disk
+    static void syncFile(const fs::path& path) {
+        LogFile file;
+        file.open(path.string());
+        file.sync();
+    }
+
+    // Read the layout version, the generation and the segment generation of every page from a manifest.
+    // Tables and their slot counts are listed in manifest order when tables is given.
+    static uint64_t readPageTable(std::istream& in, std::map<std::string, std::vector<uint64_t>>& pages, uint32_t& version,
+                                  std::vector<std::pair<std::string, size_t>>* tables = nullptr) {
+        // Version 1 manifests have no magic and start with the generation
+        char magic[sizeof(MANIFEST_MAGIC)] = {};
+        readRaw(in, magic, sizeof(magic));
+        uint64_t generation = 0;
+        if (std::memcmp(magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) == 0) {
+            version = readU32(in);
+            generation = readU64(in);
+            if (version > CHECKPOINT_VERSION) {
+                throw std::runtime_error("Checkpoint version " + std::to_string(version) + " is newer than this program supports.");
+            }
+        }
+        else {
+            version = 1;
+            for (int i = 0; i < 8; ++i) {
+                generation |= uint64_t(static_cast<unsigned char>(magic[i])) << (8 * i);
+            }
+        }
+        uint64_t numTables = readU64(in);
+        for (uint64_t i = 0; i < numTables && in; ++i) {
+            std::string tableName = readBytes(in, MAX_NAME_SIZE);
+            uint64_t numSlots = readU64(in);
+            uint64_t numPages = readU64(in);
+            if (numPages != (numSlots + Table::PAGE_ROWS - 1) / Table::PAGE_ROWS) {
+                throw std::runtime_error("Invalid page count for table " + tableName + ".");
+            }
+            std::vector<uint64_t>& tablePages = pages[tableName];
+            tablePages.clear();
+            for (uint64_t page = 0; page < numPages && in; ++page) {
+                tablePages.push_back(readU64(in));
+            }
+            if (tables) {
+                tables->emplace_back(tableName, static_cast<size_t>(numSlots));
+            }
+        }
+        if (!in) {
+            throw std::runtime_error("Truncated checkpoint manifest.");
+        }
+        return generation;
+    }
 };
@@ -0,0 +1,47 @@
+// DataTypes.h
+#pragma once
+#include <cstdint>
+#include <ctime> // Include for std::time_t
+#include <string>
+#include <variant>
+#include <vector>
+
+// Data type enum
+enum class DataType {
+    INT,
+    STRING,
+    BOOL,
+    TIMESTAMP,
+    FLOAT,
+    BLOB
+};
+
+// A single cell value, one alternative per DataType (in the same order)
+using Value = std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>;
+
+// Stable handle of a row inside a table's column storage
+using RowId = size_t;
+
+// The value a column holds when a row does not provide one
+Value defaultValue(DataType type) {
+    switch (type) {
+    case DataType::INT:
+        return 0;
+    case DataType::STRING:
+        return std::string();
+    case DataType::BOOL:
+        return false;
+    case DataType::TIMESTAMP:
+        return std::time_t(0);
+    case DataType::FLOAT:
+        return 0.0f;
+    case DataType::BLOB:
+        return std::vector<uint8_t>();
+    }
+    return {};
+}
+
+// Whether a value holds the alternative used for a column type
+bool matchesType(const Value& value, DataType type) {
+    return value.index() == static_cast<size_t>(type);
+}
@@ -5,35 +5,101 @@
 #include <vector>
 #include <variant>
 #include <optional>
-#include <ctime> // Include for std::time_t
-#include "BTree.h"
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include "DataTypes.h"
+#include "ColumnStore.h"
+#include "Index.h"
 class DatabaseManager; // Forward declaration
 
 /////////////////////////////////////////////////////////////////////////////////
 ///////////RELATIONAL DATABASE EDUCATIONAL ONLY ////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
-// Data type enum
-enum class DataType {
-    INT,
-    STRING,
-    BOOL,
-    TIMESTAMP,
-    FLOAT,
-    BLOB
-};
-
 // Forward declare the Table class
 class Table;
 
+// A table saved in a checkpoint, read from there when it is first accessed (see DataBaseFile::openCatalog)
+struct StoredTable {
+    std::string directory;                // Checkpoint directory holding the segments
+    uint32_t layoutVersion = 0;           // Checkpoint layout the segments are written in
+    size_t slotCount = 0;
+    std::vector<uint64_t> pages;          // Segment generation of every page
+    std::string definition;               // Column definitions as written to the manifest
+    std::vector<std::string> indexNames;  // Secondary indexes, found by name without loading the table
+    uint64_t changes = 0;                 // Table::changes when the loaded table matched the segments
+};
+
+// Stamp of the tables a database holds in memory. Every stamp is unique across databases and
+// a copied database takes a new one, so a Table* cached next to a stamp is valid while it matches.
+class SchemaVersion {
+public:
+    SchemaVersion() : value(next()) {}
+    SchemaVersion(const SchemaVersion&) : value(next()) {}
+
+    SchemaVersion& operator=(const SchemaVersion&) {
+        value = next();
+        return *this;
+    }
+
+    // Called whenever a table is added, replaced or dropped from memory
+    void bump() {
+        value = next();
+    }
+
+    uint64_t get() const {
+        return value;
+    }
+
+private:
+    uint64_t value;
+
+    static uint64_t next() {
+        static std::atomic<uint64_t> counter{ 0 };
+        return ++counter;
+    }
+};
+
 // Our core database class that will encapsulate the entire database itself 
 class Database {
 public:
-    std::map<std::string, Table> tables;
+    std::map<std::string, Table> tables;              // Tables in memory
+    std::map<std::string, StoredTable> storedTables;  // Tables on disk, loaded ones keep their entry
+    std::function<Table(const std::string&, const StoredTable&)> tableLoader; // Reads a stored table
+    SchemaVersion schemaVersion;                      // Loading a stored table keeps it, pointers stay valid
+    uint64_t appliedLsn = 0;                          // Last write-ahead log record its checkpoint holds
 
     void addTable(const Table& table);
+    void addTable(Table&& table);
+
+    // A table in memory, read from its checkpoint first if it is only stored
     Table* getTable(const std::string& tableName);
     void clear();
+
+    // Names of every table, in memory or stored
+    std::vector<std::string> getTableNames() const;
+
+    // Bytes held by the tables in memory
+    size_t memoryUsage() const;
+
+    // Drop tables unchanged since they were stored, least recently used first, until at most
+    // budget bytes are held. Only called between commands, a dropped table's Table* dangles.
+    void evictTables(size_t budget);
+
+    // Table owning the secondary index with this name, nullptr if no table has it
+    Table* findIndexOwner(const std::string& indexName);
+
+    // Give every column referenced by a foreign key an index, so checks never scan the parent
+    void indexForeignKeys();
+
+private:
+    std::map<std::string, std::chrono::steady_clock::time_point> lastUse;
+
+    bool isEvictable(const std::string& tableName) const;
 };
 
 // Row class that will describe our rows inside the database
@@ -63,6 +129,13 @@ public:
         : referencedTable(refTable), referencedColumn(refColumn) {}
 };
 
+// A foreign key column resolved against the table it references
+struct ForeignKeyTarget {
+    size_t column;
+    const Table* refTable;
+    size_t refColumn;
+};
+
 // Column class that will describe our Columns within the database
 class Column {
 public:
@@ -70,23 +143,24 @@ public:
     DataType type;
     bool isPrimaryKey;
     std::optional<ForeignKey> foreignKey;
-    std::unique_ptr<BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>> index;
+    std::unique_ptr<Index> index; // Secondary index created with CREATE INDEX
+    std::string indexName;
+    int indexFanout = 0; // Maximum children per index node, 0 sizes nodes to one page
+    IndexKind indexKind = IndexKind::BTREE; // Structure of the primary key index
 
  
     Column() = default;
 
     Column(const std::string& name, DataType type, bool isPrimaryKey = false, std::optional<ForeignKey> foreignKey = std::nullopt)
         : name(name), type(type), isPrimaryKey(isPrimaryKey), foreignKey(foreignKey) {
-        if (isPrimaryKey) {
-            index = std::make_unique<BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>>(3); 
-        }
+        // The primary key index is owned by the Table (see Table::primaryKeyIndex)
     }
 
    
     Column(const Column& other)
-        : name(other.name), type(other.type), isPrimaryKey(other.isPrimaryKey), foreignKey(other.foreignKey) {
+        : name(other.name), type(other.type), isPrimaryKey(other.isPrimaryKey), foreignKey(other.foreignKey), indexName(other.indexName), indexFanout(other.indexFanout), indexKind(other.indexKind) {
         if (other.index) {
-            index = std::make_unique<BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>>(*other.index);
+            index = other.index->clone();
         }
     }
 
@@ -99,8 +173,11 @@ public:
         type = other.type;
         isPrimaryKey = other.isPrimaryKey;
         foreignKey = other.foreignKey;
+        indexName = other.indexName;
+        indexFanout = other.indexFanout;
+        indexKind = other.indexKind;
         if (other.index) {
-            index = std::make_unique<BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>>(*other.index);
+            index = other.index->clone();
         }
         else {
             index.reset();
@@ -122,9 +199,22 @@ public:
         foreignKey = ForeignKey(refTable, refColumn);
     }
 
-    void addToIndex(const std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>& value) {
+    void setIndexFanout(int fanout) {
+        indexFanout = fanout;
+    }
+
+    void setIndexKind(IndexKind kind) {
+        indexKind = kind;
+    }
+
+    // Minimum degree of the B-tree matching the fanout, 0 when the default applies
+    int getIndexDegree() const {
+        return indexFanout / 2;
+    }
+
+    void addToIndex(const Value& value, RowId row) {
         if (index) {
-            index->insert(value);
+            index->insert(value, row);
         }
     }
 };
@@ -135,8 +225,15 @@ class Table {
 public:
     std::string name;
     std::vector<Column> columns;
-    std::vector<Row> rows;
-    std::unique_ptr<BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>> primaryKeyBTree;
+    std::vector<ColumnVector> columnData; // One typed vector per column, indexed by RowId
+    std::vector<bool> live;               // Deleted rows keep their slot so row ids stay stable
+    size_t liveRows = 0;
+    std::unique_ptr<Index> primaryKeyIndex; // Primary key value -> RowId
+    std::vector<bool> dirtyPages;           // Pages of PAGE_ROWS row ids changed since the last checkpoint
+    uint64_t changes = 0;                   // Bumped by every change to the rows or the column definitions
+
+    // Rows are checkpointed in pages of this many row ids
+    static constexpr size_t PAGE_ROWS = 4096;
 
   
     Table() = default;
@@ -145,10 +242,10 @@ public:
     Table(const std::string& name) : name(name) {}
 
     Table(const Table& other)
-        : name(other.name), columns(other.columns), rows(other.rows) {
-        if (other.primaryKeyBTree) {
-            primaryKeyBTree = std::make_unique<BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>>(other.primaryKeyBTree->getDegree());
-            other.primaryKeyBTree->copyTo(*primaryKeyBTree);
+        : name(other.name), columns(other.columns), columnData(other.columnData), live(other.live), liveRows(other.liveRows),
+          dirtyPages(other.dirtyPages), changes(other.changes) {
+        if (other.primaryKeyIndex) {
+            primaryKeyIndex = other.primaryKeyIndex->clone();
         }
     }
 
@@ -159,13 +256,16 @@ public:
         }
         name = other.name;
         columns = other.columns;
-        rows = other.rows;
-        if (other.primaryKeyBTree) {
-            primaryKeyBTree = std::make_unique<BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>>(other.primaryKeyBTree->getDegree());
-            other.primaryKeyBTree->copyTo(*primaryKeyBTree);
+        columnData = other.columnData;
+        live = other.live;
+        liveRows = other.liveRows;
+        dirtyPages = other.dirtyPages;
+        changes = other.changes;
+        if (other.primaryKeyIndex) {
+            primaryKeyIndex = other.primaryKeyIndex->clone();
         }
         else {
-            primaryKeyBTree.reset();
+            primaryKeyIndex.reset();
         }
         return *this;
     }
@@ -185,13 +285,236 @@ public:
                 }
             }
           
-            primaryKeyBTree = std::make_unique<BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>>(3); 
+            // The key type of the index is fixed by the column type
+            if (!primaryKeyIndex) {
+                primaryKeyIndex = makeIndex(column.type, column.indexKind, column.getIndexDegree());
+            }
         }
         columns.push_back(column);
+
+        // Existing rows get the default value of the new column
+        ColumnVector data(column.type);
+        data.reserve(live.size());
+        for (size_t i = 0; i < live.size(); ++i) {
+            data.appendDefault();
+        }
+        columnData.push_back(std::move(data));
+        markAllDirty();
     }
 
     void addRow(const Row& row, DatabaseManager& dbManager);
 
+    // Insert rows given in column order one after another, typed as the columns are, against
+    // foreign keys the caller resolved with resolveForeignKeys. Prepared inserts resolve them
+    // once for many rows. More than one row goes in as a batch through insertColumns.
+    void insertValues(const std::vector<Value>& values, const std::vector<ForeignKeyTarget>& foreignKeys);
+
+    // Insert a batch of rows, all or none. Every distinct foreign key value is looked up once
+    // for the whole batch and primary keys are checked against each other as well as the table.
+    void addRows(const std::vector<Row>& rows, DatabaseManager& dbManager);
+
+    // Insert a batch given column by column: one vector per table column, in column order, all
+    // the same length and typed as their columns. Checked like addRows, then each column is
+    // appended and indexed in one pass.
+    void insertColumns(const std::vector<std::vector<Value>>& columnValues, const std::vector<ForeignKeyTarget>& foreignKeys);
+
+    // Append a large batch of typed columns, one per table column and all the same length,
+    // all or none. An empty table gets its indexes bulk loaded from the batch, otherwise the
+    // new rows are inserted into them, so the cost follows the batch and not the table.
+    void bulkAppend(const std::vector<ColumnVector>& batch, const std::vector<ForeignKeyTarget>& foreignKeys);
+
+    // Append a row given in column order without validating it or updating indexes.
+    // Bulk paths call rebuildIndexes once the whole batch is stored.
+    // Loading keeps deleted slots with isLive false so row ids stay the same.
+    void appendRowValues(const std::vector<Value>& values, bool isLive = true);
+
+    // Rebuild the primary key and column indexes from the live rows, one bulk load per index
+    void rebuildIndexes(bool primaryKey = true);
+
+    // Look up the referenced table and column of every foreign key of this table
+    std::vector<ForeignKeyTarget> resolveForeignKeys(DatabaseManager& dbManager) const;
+
+    // Values of a row in column order, missing columns get their default. Throws on a type mismatch.
+    std::vector<Value> resolveValues(const Row& row) const;
+
+    // Append a validated row and add it to every index
+    void storeRow(const std::vector<Value>& values);
+
+    // Reserve storage for that many additional rows in every column
+    void reserveRows(size_t rows) {
+        for (auto& data : columnData) {
+            data.reserve(live.size() + rows);
+        }
+        live.reserve(live.size() + rows);
+    }
+
+    // Number of rows that have not been deleted
+    size_t rowCount() const {
+        return liveRows;
+    }
+
+    // Number of row ids handed out so far, including deleted ones
+    size_t slotCount() const {
+        return live.size();
+    }
+
+    bool isLive(RowId row) const {
+        return row < live.size() && live[row];
+    }
+
+    // Number of checkpoint pages covering the row ids handed out so far
+    size_t pageCount() const {
+        return (live.size() + PAGE_ROWS - 1) / PAGE_ROWS;
+    }
+
+    bool isPageDirty(size_t page) const {
+        return page < dirtyPages.size() && dirtyPages[page];
+    }
+
+    // Record that the page holding row changed since the last checkpoint
+    void markDirty(RowId row) {
+        size_t page = row / PAGE_ROWS;
+        if (page >= dirtyPages.size()) {
+            dirtyPages.resize(page + 1, false);
+        }
+        dirtyPages[page] = true;
+        changes++;
+    }
+
+    // Record that the pages holding count rows from first on changed
+    void markDirty(RowId first, size_t count) {
+        if (count == 0) {
+            return;
+        }
+        size_t lastPage = (first + count - 1) / PAGE_ROWS;
+        if (lastPage >= dirtyPages.size()) {
+            dirtyPages.resize(lastPage + 1, false);
+        }
+        for (size_t page = first / PAGE_ROWS; page <= lastPage; ++page) {
+            dirtyPages[page] = true;
+        }
+        changes++;
+    }
+
+    void markAllDirty() {
+        dirtyPages.assign(pageCount(), true);
+        changes++;
+    }
+
+    // Called once every page is written to a checkpoint
+    void clearDirty() {
+        dirtyPages.assign(pageCount(), false);
+    }
+
+    // Call fn(RowId) for every live row in insertion order
+    template<typename Fn>
+    void forEachRow(Fn fn) const {
+        for (RowId row = 0; row < live.size(); ++row) {
+            if (live[row]) {
+                fn(row);
+            }
+        }
+    }
+
+    int getColumnIndex(const std::string& columnName) const {
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (columns[i].name == columnName) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    Value getValue(RowId row, size_t columnIndex) const {
+        return columnData[columnIndex].get(row);
+    }
+
+    Value getValue(RowId row, const std::string& columnName) const {
+        int columnIndex = getColumnIndex(columnName);
+        if (columnIndex < 0) {
+            return {};
+        }
+        return columnData[columnIndex].get(row);
+    }
+
+    // Materialize a row as a column name -> value map
+    Row getRow(RowId row) const {
+        Row result;
+        for (size_t i = 0; i < columns.size(); ++i) {
+            result.addData(columns[i].name, columnData[i].get(row));
+        }
+        return result;
+    }
+
+    // Look up a live row through the primary key index
+    std::optional<RowId> findByPrimaryKey(const Value& primaryKey) const {
+        if (!primaryKeyIndex) {
+            return std::nullopt;
+        }
+        return primaryKeyIndex->find(primaryKey);
+    }
+
+    // First live row whose column equals value, through the primary key or column index when possible
+    std::optional<RowId> findRow(size_t columnIndex, const Value& value) const {
+        if (primaryKeyIndex && columns[columnIndex].isPrimaryKey) {
+            return findByPrimaryKey(value);
+        }
+        if (columns[columnIndex].index) {
+            return columns[columnIndex].index->find(value);
+        }
+        const ColumnVector& data = columnData[columnIndex];
+        for (RowId row = 0; row < live.size(); ++row) {
+            if (live[row] && data.equals(row, value)) {
+                return row;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Every live row whose column equals value, in row id order
+    RowList findRows(size_t columnIndex, const Value& value) const {
+        if (primaryKeyIndex && columns[columnIndex].isPrimaryKey) {
+            std::optional<RowId> row = findByPrimaryKey(value);
+            return row ? RowList{ *row } : RowList();
+        }
+        if (columns[columnIndex].index) {
+            return columns[columnIndex].index->findAll(value);
+        }
+        RowList rows;
+        const ColumnVector& data = columnData[columnIndex];
+        for (RowId row = 0; row < live.size(); ++row) {
+            if (live[row] && data.equals(row, value)) {
+                rows.push_back(row);
+            }
+        }
+        return rows;
+    }
+
+    // Build a non-unique index over a column, filled from the rows already stored
+    void createIndex(const std::string& indexName, const std::string& columnName, IndexKind kind);
+
+    // Drop the secondary index with this name, returns false if the table has none
+    bool dropIndex(const std::string& indexName);
+
+    // Column carrying the secondary index with this name, nullptr if there is none
+    const Column* getIndexedColumn(const std::string& indexName) const {
+        for (const auto& column : columns) {
+            if (column.index && column.indexName == indexName) {
+                return &column;
+            }
+        }
+        return nullptr;
+    }
+
+    // Approximate heap footprint of the stored rows in bytes
+    size_t memoryUsage() const {
+        size_t total = live.capacity() / 8;
+        for (const auto& data : columnData) {
+            total += data.memoryUsage();
+        }
+        return total;
+    }
+
     const Column* getPrimaryKey() const {
         for (const auto& column : columns) {
             if (column.isPrimaryKey) {
@@ -209,39 +532,158 @@ public:
         }
         return nullptr; 
     }
-    void deleteRow(const std::variant<int, std::string, bool, time_t, float, std::vector<uint8_t>>& primaryKey);
-    void updateRow(const std::variant<int, std::string, bool, time_t, float, std::vector<uint8_t>>& oldPrimaryKey, const Row& newRow);
+    void deleteRow(const Value& primaryKey);
+    void updateRow(const Value& oldPrimaryKey, const Row& newRow);
   
-    void setPrimaryKeyBTree(BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>* btree) {
-        primaryKeyBTree.reset(btree);
+    void setPrimaryKeyIndex(std::unique_ptr<Index> index) {
+        primaryKeyIndex = std::move(index);
     }
 
-    BTree<std::variant<int, std::string, bool, std::time_t, float, std::vector<uint8_t>>>* getPrimaryKeyBTree() const {
-        return primaryKeyBTree.get();
+    Index* getPrimaryKeyIndex() const {
+        return primaryKeyIndex.get();
     }
 };
 
 
 void Database::addTable(const Table& table) {
+    storedTables.erase(table.name); // A new table replaces the stored one
     tables[table.name] = table;
+    schemaVersion.bump();
+    indexForeignKeys();
+}
+
+// Moving keeps the table's indexes as they are instead of cloning them
+void Database::addTable(Table&& table) {
+    std::string tableName = table.name;
+    storedTables.erase(tableName);
+    tables[tableName] = std::move(table);
+    schemaVersion.bump();
+    indexForeignKeys();
 }
 
 Table* Database::getTable(const std::string& tableName) {
     auto it = tables.find(tableName);
-    if (it != tables.end()) {
-        return &(it->second);
+    if (it == tables.end()) {
+        auto stored = storedTables.find(tableName);
+        if (stored == storedTables.end() || !tableLoader) {
+            return nullptr;
+        }
+        // Inserting into the map leaves pointers to the other tables valid
+        it = tables.emplace(tableName, tableLoader(tableName, stored->second)).first;
+        stored->second.changes = it->second.changes;
     }
-    return nullptr;
+    lastUse[tableName] = std::chrono::steady_clock::now();
+    return &(it->second);
 }
 
 void Database::clear() {
     tables.clear();
+    storedTables.clear();
+    lastUse.clear();
+    schemaVersion.bump();
+}
+
+std::vector<std::string> Database::getTableNames() const {
+    std::vector<std::string> names;
+    for (const auto& tablePair : tables) {
+        names.push_back(tablePair.first);
+    }
+    for (const auto& storedPair : storedTables) {
+        if (!tables.count(storedPair.first)) {
+            names.push_back(storedPair.first);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+size_t Database::memoryUsage() const {
+    size_t total = 0;
+    for (const auto& tablePair : tables) {
+        total += tablePair.second.memoryUsage();
+    }
+    return total;
+}
+
+bool Database::isEvictable(const std::string& tableName) const {
+    auto stored = storedTables.find(tableName);
+    auto table = tables.find(tableName);
+    return stored != storedTables.end() && table != tables.end() && table->second.changes == stored->second.changes;
+}
+
+void Database::evictTables(size_t budget) {
+    size_t usage = memoryUsage();
+    if (usage <= budget) {
+        return;
+    }
+    std::vector<std::pair<std::chrono::steady_clock::time_point, std::string>> candidates;
+    for (const auto& tablePair : tables) {
+        if (isEvictable(tablePair.first)) {
+            candidates.emplace_back(lastUse[tablePair.first], tablePair.first);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (const auto& candidate : candidates) {
+        if (usage <= budget) {
+            break;
+        }
+        auto table = tables.find(candidate.second);
+        usage -= std::min(usage, table->second.memoryUsage());
+        tables.erase(table);
+        lastUse.erase(candidate.second);
+        schemaVersion.bump();
+    }
+}
+
+Table* Database::findIndexOwner(const std::string& indexName) {
+    for (auto& tablePair : tables) {
+        if (tablePair.second.getIndexedColumn(indexName)) {
+            return &tablePair.second;
+        }
+    }
+    // Stored tables list their index names, only the owner is loaded
+    for (const auto& storedPair : storedTables) {
+        const auto& names = storedPair.second.indexNames;
+        if (!tables.count(storedPair.first) && std::find(names.begin(), names.end(), indexName) != names.end()) {
+            return getTable(storedPair.first);
+        }
+    }
+    return nullptr;
+}
+
+void Database::indexForeignKeys() {
+    for (auto& tablePair : tables) {
+        for (const auto& column : tablePair.second.columns) {
+            if (!column.foreignKey) {
+                continue;
+            }
+            // References to tables that do not exist yet are indexed once the table is added
+            Table* refTable = getTable(column.foreignKey->referencedTable);
+            if (!refTable) {
+                continue;
+            }
+            int refColumn = refTable->getColumnIndex(column.foreignKey->referencedColumn);
+            if (refColumn < 0 || refTable->columns[refColumn].isPrimaryKey || refTable->columns[refColumn].index) {
+                continue;
+            }
+
+            // Foreign key checks are equality lookups, a hash index is enough
+            std::string baseName = "fk_" + refTable->name + "_" + refTable->columns[refColumn].name;
+            std::string indexName = baseName;
+            for (int suffix = 2; findIndexOwner(indexName); ++suffix) {
+                indexName = baseName + "_" + std::to_string(suffix);
+            }
+            refTable->createIndex(indexName, refTable->columns[refColumn].name, IndexKind::HASH);
+        }
+    }
 }
 
 class DatabaseManager {
 public:
     std::map<std::string, Database> databases;
     Database* currentDatabase = nullptr;
+    std::string currentDatabaseName;
+    uint64_t appliedLsn = 0; // Last write-ahead log record the saved catalog holds
 
     void createDatabase(const std::string& dbName) {
         databases[dbName] = Database();
@@ -251,6 +693,7 @@ public:
         auto it = databases.find(dbName);
         if (it != databases.end()) {
             currentDatabase = &(it->second);
+            currentDatabaseName = dbName;
             return true;
         }
         return false;
@@ -259,88 +702,450 @@ public:
     Database* getCurrentDatabase() {
         return currentDatabase;
     }
+
+    // Bytes the tables in memory may hold before stored ones are evicted, 0 for no limit
+    size_t memoryBudget = 0;
+
+    // Evict tables until the budget is met, from the other databases before the current one.
+    // Call only between commands, no Table* may be held across it.
+    void enforceMemoryBudget() {
+        if (memoryBudget == 0) {
+            return;
+        }
+        size_t usage = 0;
+        for (const auto& databasePair : databases) {
+            usage += databasePair.second.memoryUsage();
+        }
+        for (int pass = 0; pass < 2 && usage > memoryBudget; ++pass) {
+            for (auto& databasePair : databases) {
+                Database& db = databasePair.second;
+                if ((&db == currentDatabase) != (pass == 1) || usage <= memoryBudget) {
+                    continue;
+                }
+                size_t before = db.memoryUsage();
+                db.evictTables(before - std::min(before, usage - memoryBudget));
+                usage -= before - db.memoryUsage();
+            }
+        }
+    }
 };
 
 
 
 void Table::addRow(const Row& row, DatabaseManager& dbManager) {
-    const Column* primaryKey = getPrimaryKey();
-    if (primaryKey) {
-        auto primaryKeyValue = row.getData(primaryKey->name);
-        if (primaryKey->index) {
-            if (primaryKey->index->search(primaryKeyValue)) {
+    // Resolve every value before touching storage so a type error leaves the table unchanged
+    insertValues(resolveValues(row), resolveForeignKeys(dbManager));
+}
+
+void Table::insertValues(const std::vector<Value>& values, const std::vector<ForeignKeyTarget>& foreignKeys) {
+    if (columns.empty() || values.size() % columns.size() != 0) {
+        throw std::runtime_error("Row does not match the table columns.");
+    }
+    if (values.size() > columns.size()) {
+        size_t count = values.size() / columns.size();
+        std::vector<std::vector<Value>> columnValues(columns.size());
+        for (size_t i = 0; i < columns.size(); ++i) {
+            columnValues[i].reserve(count);
+            for (size_t row = 0; row < count; ++row) {
+                columnValues[i].push_back(values[row * columns.size() + i]);
+            }
+        }
+        insertColumns(columnValues, foreignKeys);
+        return;
+    }
+
+    if (primaryKeyIndex) {
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (columns[i].isPrimaryKey && primaryKeyIndex->contains(values[i])) {
                 throw std::runtime_error("Duplicate primary key value.");
             }
         }
     }
 
-    for (const auto& column : columns) {
-        if (column.foreignKey) {
-            const auto& fk = column.foreignKey.value();
-            Database* db = dbManager.getCurrentDatabase();
-            Table* refTable = db->getTable(fk.referencedTable);
-            if (!refTable) {
-                throw std::runtime_error("Referenced table not found.");
-            }
-            const Column* refColumn = refTable->getColumn(fk.referencedColumn);
-            if (!refColumn) {
-                throw std::runtime_error("Referenced column not found.");
-            }
-            auto refValue = row.getData(column.name);
-            bool found = false;
-            for (const auto& refRow : refTable->rows) {
-                if (refRow.getData(fk.referencedColumn) == refValue) {
-                    found = true;
-                    break;
+    // Referenced columns are indexed (see Database::indexForeignKeys), so each check is one lookup
+    for (const auto& fk : foreignKeys) {
+        if (!fk.refTable->findRow(fk.refColumn, values[fk.column])) {
+            throw std::runtime_error("Foreign key constraint violation.");
+        }
+    }
+
+    storeRow(values);
+}
+
+void Table::addRows(const std::vector<Row>& rows, DatabaseManager& dbManager) {
+    std::vector<std::vector<Value>> columnValues(columns.size());
+    for (auto& values : columnValues) {
+        values.reserve(rows.size());
+    }
+    for (const auto& row : rows) {
+        std::vector<Value> values = resolveValues(row);
+        for (size_t i = 0; i < columns.size(); ++i) {
+            columnValues[i].push_back(std::move(values[i]));
+        }
+    }
+    insertColumns(columnValues, resolveForeignKeys(dbManager));
+}
+
+void Table::insertColumns(const std::vector<std::vector<Value>>& columnValues, const std::vector<ForeignKeyTarget>& foreignKeys) {
+    if (columnValues.size() != columns.size()) {
+        throw std::runtime_error("Batch does not match the table columns.");
+    }
+    size_t count = columnValues.empty() ? 0 : columnValues[0].size();
+    for (const auto& values : columnValues) {
+        if (values.size() != count) {
+            throw std::runtime_error("Batch columns differ in length.");
+        }
+    }
+
+    // Primary keys go into the index as they are checked, so a key repeated within the batch
+    // is found like one already in the table. A batch that fails takes its keys out again.
+    RowId first = live.size();
+    std::vector<std::pair<size_t, size_t>> keyed; // Primary key column, rows indexed
+    auto unindexKeys = [&]() {
+        for (const auto& [column, rows] : keyed) {
+            for (size_t row = 0; row < rows; ++row) {
+                primaryKeyIndex->remove(columnValues[column][row], first + row);
+            }
+        }
+    };
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].isPrimaryKey && primaryKeyIndex) {
+            keyed.emplace_back(i, 0);
+            for (const Value& value : columnValues[i]) {
+                if (primaryKeyIndex->contains(value)) {
+                    unindexKeys();
+                    throw std::runtime_error("Duplicate primary key value.");
                 }
+                primaryKeyIndex->insert(value, first + keyed.back().second++);
+            }
+        }
+    }
+
+    // Child rows usually repeat a few parent keys, each distinct value is checked once
+    for (const auto& fk : foreignKeys) {
+        std::unique_ptr<Index> checked = makeIndex(columns[fk.column].type, IndexKind::HASH);
+        for (const Value& refValue : columnValues[fk.column]) {
+            if (checked->contains(refValue)) {
+                continue;
+            }
+            if (!fk.refTable->findRow(fk.refColumn, refValue)) {
+                unindexKeys();
+                throw std::runtime_error("Foreign key constraint violation.");
+            }
+            checked->insert(refValue, 0);
+        }
+    }
+
+    reserveRows(count);
+    for (size_t i = 0; i < columns.size(); ++i) {
+        for (const Value& value : columnValues[i]) {
+            columnData[i].append(value);
+        }
+    }
+    live.resize(first + count, true);
+    liveRows += count;
+    markDirty(first, count);
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].index) {
+            for (size_t row = 0; row < count; ++row) {
+                columns[i].addToIndex(columnValues[i][row], first + row);
+            }
+        }
+    }
+}
+
+void Table::bulkAppend(const std::vector<ColumnVector>& batch, const std::vector<ForeignKeyTarget>& foreignKeys) {
+    if (batch.size() != columns.size()) {
+        throw std::runtime_error("Batch does not match the table columns.");
+    }
+    size_t count = batch.empty() ? 0 : batch[0].size();
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (batch[i].size() != count || batch[i].getType() != columns[i].type) {
+            throw std::runtime_error("Batch does not match the table columns.");
+        }
+    }
+
+    // Into an empty table the key index is bulk loaded aside and replaces the old one once the
+    // batch is in, keys repeated within the batch are found first. Otherwise keys go into the
+    // index as they are checked, like insertColumns, and a batch that fails takes them out again.
+    RowId first = live.size();
+    bool empty = liveRows == 0;
+    std::unique_ptr<Index> keys;
+    std::vector<std::pair<size_t, size_t>> keyed; // Primary key column, rows indexed
+    auto unindexKeys = [&]() {
+        for (const auto& [column, rows] : keyed) {
+            for (size_t row = 0; row < rows; ++row) {
+                primaryKeyIndex->remove(batch[column].get(row), first + row);
+            }
+        }
+    };
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (!columns[i].isPrimaryKey || !primaryKeyIndex) {
+            continue;
+        }
+        if (empty) {
+            std::unique_ptr<Index> seen = makeIndex(columns[i].type, IndexKind::HASH);
+            std::vector<std::pair<Value, RowId>> entries;
+            entries.reserve(count);
+            for (size_t row = 0; row < count; ++row) {
+                Value key = batch[i].get(row);
+                if (seen->contains(key)) {
+                    throw std::runtime_error("Duplicate primary key value.");
+                }
+                seen->insert(key, 0);
+                entries.emplace_back(std::move(key), first + row);
+            }
+            keys = makeIndex(columns[i].type, primaryKeyIndex->getKind(), primaryKeyIndex->getDegree());
+            keys->bulkLoad(std::move(entries));
+            continue;
+        }
+        keyed.emplace_back(i, 0);
+        for (size_t row = 0; row < count; ++row) {
+            Value key = batch[i].get(row);
+            if (primaryKeyIndex->contains(key)) {
+                unindexKeys();
+                throw std::runtime_error("Duplicate primary key value.");
+            }
+            primaryKeyIndex->insert(key, first + keyed.back().second++);
+        }
+    }
+
+    // Child rows usually repeat a few parent keys, each distinct value is checked once
+    for (const auto& fk : foreignKeys) {
+        std::unique_ptr<Index> checked = makeIndex(columns[fk.column].type, IndexKind::HASH);
+        for (size_t row = 0; row < count; ++row) {
+            Value refValue = batch[fk.column].get(row);
+            if (checked->contains(refValue)) {
+                continue;
             }
-            if (!found) {
+            if (!fk.refTable->findRow(fk.refColumn, refValue)) {
+                unindexKeys();
                 throw std::runtime_error("Foreign key constraint violation.");
             }
+            checked->insert(refValue, 0);
+        }
+    }
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columnData[i].appendColumn(batch[i]);
+    }
+    live.resize(first + count, true);
+    liveRows += count;
+    markDirty(first, count);
+    if (keys) {
+        primaryKeyIndex = std::move(keys);
+    }
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (!columns[i].index) {
+            continue;
+        }
+        if (empty) {
+            std::vector<std::pair<Value, RowId>> entries;
+            entries.reserve(count);
+            for (size_t row = 0; row < count; ++row) {
+                entries.emplace_back(batch[i].get(row), first + row);
+            }
+            columns[i].index->bulkLoad(std::move(entries));
+        }
+        else {
+            for (size_t row = 0; row < count; ++row) {
+                columns[i].addToIndex(batch[i].get(row), first + row);
+            }
+        }
+    }
+}
+
+std::vector<ForeignKeyTarget> Table::resolveForeignKeys(DatabaseManager& dbManager) const {
+    std::vector<ForeignKeyTarget> targets;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (!columns[i].foreignKey) {
+            continue;
+        }
+        const auto& fk = columns[i].foreignKey.value();
+        Database* db = dbManager.getCurrentDatabase();
+        Table* refTable = db ? db->getTable(fk.referencedTable) : nullptr;
+        if (!refTable) {
+            throw std::runtime_error("Referenced table not found.");
+        }
+        int refColumn = refTable->getColumnIndex(fk.referencedColumn);
+        if (refColumn < 0) {
+            throw std::runtime_error("Referenced column not found.");
+        }
+        targets.push_back({ i, refTable, static_cast<size_t>(refColumn) });
+    }
+    return targets;
+}
+
+std::vector<Value> Table::resolveValues(const Row& row) const {
+    std::vector<Value> values;
+    values.reserve(columns.size());
+    for (const auto& column : columns) {
+        auto it = row.data.find(column.name);
+        values.push_back(it != row.data.end() ? it->second : defaultValue(column.type));
+        if (!matchesType(values.back(), column.type)) {
+            throw std::runtime_error("Value for column " + column.name + " does not match its type.");
         }
     }
+    return values;
+}
+
+void Table::storeRow(const std::vector<Value>& values) {
+    RowId rowId = live.size();
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columnData[i].append(values[i]);
+    }
+    live.push_back(true);
+    liveRows++;
+    markDirty(rowId);
 
-    rows.push_back(row);
-    for (auto& column : columns) { 
-        auto value = row.getData(column.name);
-        if (column.index) {
-            column.addToIndex(value);
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].isPrimaryKey && primaryKeyIndex) {
+            primaryKeyIndex->insert(values[i], rowId);
         }
+        if (columns[i].index) {
+            columns[i].addToIndex(values[i], rowId);
+        }
+    }
+}
+
+void Table::appendRowValues(const std::vector<Value>& values, bool isLive) {
+    if (values.size() != columns.size()) {
+        throw std::runtime_error("Row does not match the table columns.");
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columnData[i].append(values[i]);
+    }
+    markDirty(live.size());
+    live.push_back(isLive);
+    if (isLive) {
+        liveRows++;
     }
 }
-void Table::deleteRow(const std::variant<int, std::string, bool, time_t, float, std::vector<uint8_t>>& primaryKey) {
+
+void Table::rebuildIndexes(bool primaryKey) {
+    auto collect = [&](size_t columnIndex) {
+        std::vector<std::pair<Value, RowId>> entries;
+        entries.reserve(liveRows);
+        forEachRow([&](RowId row) {
+            entries.emplace_back(columnData[columnIndex].get(row), row);
+        });
+        return entries;
+    };
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (primaryKey && columns[i].isPrimaryKey && primaryKeyIndex) {
+            primaryKeyIndex->bulkLoad(collect(i));
+        }
+        if (columns[i].index) {
+            columns[i].index->bulkLoad(collect(i));
+        }
+    }
+}
+
+void Table::createIndex(const std::string& indexName, const std::string& columnName, IndexKind kind) {
+    int columnIndex = getColumnIndex(columnName);
+    if (columnIndex < 0) {
+        throw std::runtime_error("Column not found: " + columnName);
+    }
+    Column& column = columns[columnIndex];
+    if (column.isPrimaryKey) {
+        throw std::runtime_error("Primary key column " + columnName + " is already indexed.");
+    }
+    if (column.index) {
+        throw std::runtime_error("Column " + columnName + " already has index " + column.indexName + ".");
+    }
+
+    std::unique_ptr<Index> index = makeIndex(column.type, kind, column.getIndexDegree(), false);
+    std::vector<std::pair<Value, RowId>> entries;
+    entries.reserve(liveRows);
+    forEachRow([&](RowId row) {
+        entries.emplace_back(columnData[columnIndex].get(row), row);
+    });
+    index->bulkLoad(std::move(entries));
+
+    column.index = std::move(index);
+    column.indexName = indexName;
+    changes++;
+}
+
+bool Table::dropIndex(const std::string& indexName) {
+    for (auto& column : columns) {
+        if (column.index && column.indexName == indexName) {
+            column.index.reset();
+            column.indexName.clear();
+            changes++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Table::deleteRow(const Value& primaryKey) {
     const Column* primaryKeyColumn = getPrimaryKey();
     if (!primaryKeyColumn) {
         throw std::runtime_error("Primary key column not found.");
     }
 
-    auto it = std::find_if(rows.begin(), rows.end(), [&](const Row& row) {
-        return row.getData(primaryKeyColumn->name) == primaryKey;
-        });
+    auto row = findByPrimaryKey(primaryKey);
 
-    if (it != rows.end()) {
-        primaryKeyBTree->remove(primaryKey);
-        rows.erase(it);
+    if (row) {
+        primaryKeyIndex->remove(primaryKey, *row);
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (columns[i].index) {
+                columns[i].index->remove(columnData[i].get(*row), *row);
+            }
+        }
+        live[*row] = false;
+        liveRows--;
+        markDirty(*row);
     }
     else {
         throw std::runtime_error("Row with the given primary key not found");
     }
 }
 
-void Table::updateRow(const std::variant<int, std::string, bool, time_t, float, std::vector<uint8_t>>& oldPrimaryKey, const Row& newRow) {
+void Table::updateRow(const Value& oldPrimaryKey, const Row& newRow) {
     const Column* primaryKeyColumn = getPrimaryKey();
     if (!primaryKeyColumn) {
         throw std::runtime_error("Primary key column not found.");
     }
 
-    auto it = std::find_if(rows.begin(), rows.end(), [&](const Row& row) {
-        return row.getData(primaryKeyColumn->name) == oldPrimaryKey;
-        });
+    auto row = findByPrimaryKey(oldPrimaryKey);
 
-    if (it != rows.end()) {
-        primaryKeyBTree->remove(oldPrimaryKey);
-        *it = newRow;
-        primaryKeyBTree->insert(newRow.getData(primaryKeyColumn->name));
+    if (row) {
+        for (const auto& column : columns) {
+            auto value = newRow.data.find(column.name);
+            if (value != newRow.data.end() && !matchesType(value->second, column.type)) {
+                throw std::runtime_error("Value for column " + column.name + " does not match its type.");
+            }
+        }
+
+        auto newPrimaryKey = newRow.data.find(primaryKeyColumn->name);
+        bool keyChanged = newPrimaryKey != newRow.data.end() && newPrimaryKey->second != oldPrimaryKey;
+        if (keyChanged && primaryKeyIndex->contains(newPrimaryKey->second)) {
+            throw std::runtime_error("Duplicate primary key value.");
+        }
+
+        // Only the columns present in newRow are overwritten
+        for (size_t i = 0; i < columns.size(); ++i) {
+            auto value = newRow.data.find(columns[i].name);
+            if (value == newRow.data.end()) {
+                continue;
+            }
+            if (columns[i].index) {
+                columns[i].index->remove(columnData[i].get(*row), *row);
+                columns[i].addToIndex(value->second, *row);
+            }
+            columnData[i].set(*row, value->second);
+        }
+        markDirty(*row);
+
+        if (keyChanged) {
+            primaryKeyIndex->remove(oldPrimaryKey, *row);
+            primaryKeyIndex->insert(newPrimaryKey->second, *row);
+        }
     }
     else {
         throw std::runtime_error("Row with the given primary key not found");
@@ -0,0 +1,132 @@
+// FilterKernels.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Packed compares when the build targets AVX2, scalar code is the fallback
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FILTER_KERNELS_AVX2 1
+#endif
+
+// Values a filter compares are cut into words of 64: bit i of a word stands for value i.
+// Every comparison is built from two masks, values less than and values greater than the
+// constant, so all six operators share one kernel per type. A value that is neither (a
+// float NaN) counts as equal, the same order the row-at-a-time comparison uses.
+struct CompareBits {
+    bool less;    // Keep values below the constant
+    bool greater; // Keep values above the constant
+    bool invert;  // Keep the values not picked by the two above instead
+};
+
+// Mask of the values passing out of the less and greater masks of n <= 64 values
+uint64_t combineBits(const CompareBits& compare, uint64_t less, uint64_t greater, size_t n) {
+    uint64_t word = (compare.less ? less : 0) | (compare.greater ? greater : 0);
+    if (compare.invert) {
+        word = ~word;
+    }
+    return n == 64 ? word : word & ((uint64_t(1) << n) - 1);
+}
+
+// Less and greater masks of n <= 64 values, values not packed are compared one by one
+template<typename T>
+void compareWordScalar(const T* values, size_t start, size_t n, T constant, uint64_t& less, uint64_t& greater) {
+    for (size_t i = start; i < n; ++i) {
+        less |= uint64_t(values[i] < constant) << i;
+        greater |= uint64_t(constant < values[i]) << i;
+    }
+}
+
+void compareWord(const int32_t* values, size_t n, int32_t constant, uint64_t& less, uint64_t& greater) {
+    less = 0;
+    greater = 0;
+    size_t i = 0;
+#if defined(FILTER_KERNELS_AVX2)
+    __m256i needle = _mm256_set1_epi32(constant);
+    for (; i + 8 <= n; i += 8) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        less |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, data)))) << i;
+        greater |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(data, needle)))) << i;
+    }
+#endif
+    compareWordScalar(values, i, n, constant, less, greater);
+}
+
+void compareWord(const int64_t* values, size_t n, int64_t constant, uint64_t& less, uint64_t& greater) {
+    less = 0;
+    greater = 0;
+    size_t i = 0;
+#if defined(FILTER_KERNELS_AVX2)
+    __m256i needle = _mm256_set1_epi64x(constant);
+    for (; i + 4 <= n; i += 4) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        less |= uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(needle, data)))) << i;
+        greater |= uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(data, needle)))) << i;
+    }
+#endif
+    compareWordScalar(values, i, n, constant, less, greater);
+}
+
+void compareWord(const float* values, size_t n, float constant, uint64_t& less, uint64_t& greater) {
+    less = 0;
+    greater = 0;
+    size_t i = 0;
+#if defined(FILTER_KERNELS_AVX2)
+    __m256 needle = _mm256_set1_ps(constant);
+    for (; i + 8 <= n; i += 8) {
+        __m256 data = _mm256_loadu_ps(values + i);
+        less |= uint64_t(_mm256_movemask_ps(_mm256_cmp_ps(data, needle, _CMP_LT_OQ))) << i;
+        greater |= uint64_t(_mm256_movemask_ps(_mm256_cmp_ps(data, needle, _CMP_GT_OQ))) << i;
+    }
+#endif
+    compareWordScalar(values, i, n, constant, less, greater);
+}
+
+// AND into mask the result of comparing count values against a constant.
+// INT, TIMESTAMP and FLOAT column arrays.
+template<typename T>
+void filterValues(const T* values, size_t count, const CompareBits& compare, T constant, uint64_t* mask) {
+    for (size_t word = 0; word * 64 < count; ++word) {
+        size_t n = count - word * 64 < 64 ? count - word * 64 : 64;
+        uint64_t less;
+        uint64_t greater;
+        compareWord(values + word * 64, n, constant, less, greater);
+        mask[word] &= combineBits(compare, less, greater, n);
+    }
+}
+
+// As above for count BOOL values packed in bitmap words, false before true
+void filterBits(const uint64_t* bits, size_t count, const CompareBits& compare, bool constant, uint64_t* mask) {
+    for (size_t word = 0; word * 64 < count; ++word) {
+        size_t n = count - word * 64 < 64 ? count - word * 64 : 64;
+        uint64_t less = constant ? ~bits[word] : 0;
+        uint64_t greater = constant ? 0 : bits[word];
+        mask[word] &= combineBits(compare, less, greater, n);
+    }
+}
+
+// Index of the lowest set bit of a non-zero word
+unsigned lowestBit(uint64_t word) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(word));
+#endif
+}
+
+// Write first + i for every set bit i of the count bits of mask, return how many were written
+template<typename Id>
+size_t maskToSelection(const uint64_t* mask, size_t count, Id first, Id* selection) {
+    size_t selected = 0;
+    for (size_t word = 0; word * 64 < count; ++word) {
+        for (uint64_t bits = mask[word]; bits != 0; bits &= bits - 1) {
+            selection[selected++] = first + word * 64 + lowestBit(bits);
+        }
+    }
+    return selected;
+}
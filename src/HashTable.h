@@ -0,0 +1,384 @@
+// HashTable.h
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// 64-bit finalizer, spreads weak hashes (std::hash<int> is the identity) over every bit
+uint64_t mixHash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Hash of an index key
+template<typename K>
+struct KeyHash {
+    uint64_t operator()(const K& key) const {
+        return mixHash(std::hash<K>()(key));
+    }
+};
+
+template<>
+struct KeyHash<std::vector<uint8_t>> {
+    uint64_t operator()(const std::vector<uint8_t>& key) const {
+        std::string_view bytes(reinterpret_cast<const char*>(key.data()), key.size());
+        return mixHash(std::hash<std::string_view>()(bytes));
+    }
+};
+
+// HashTable class
+// An unordered map from unique keys to values using open addressing with linear probing.
+// A byte array of control tags sits next to the entries: each full slot keeps 7 bits of
+// its key's hash, so a probe only compares keys whose tag matches.
+// Growing is incremental. The old slots stay readable and a few of them are moved into
+// the new table on every insert or remove, so no single call rehashes the whole table.
+template<typename K, typename V, typename Hash = KeyHash<K>>
+class HashTable {
+public:
+    HashTable() = default;
+
+    // Insert an entry, returns false and leaves the table unchanged if the key exists
+    bool insert(const K& key, const V& value);
+
+    // Remove a key, returns false if it was not found
+    bool remove(const K& key);
+
+    // Find the value stored for a key, nullptr if the key is absent
+    V* find(const K& key);
+
+    const V* find(const K& key) const {
+        return const_cast<HashTable*>(this)->find(key);
+    }
+
+    bool contains(const K& key) const {
+        return find(key) != nullptr;
+    }
+
+    // Replace the contents with entries, sized once up front.
+    // Returns false and leaves the table unchanged if a key appears twice.
+    bool bulkLoad(std::vector<std::pair<K, V>> entries);
+
+    void clear() {
+        current = Slots();
+        old = Slots();
+        migrated = 0;
+        count = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Hash tables have no nodes, the degree is reported as 0
+    int getDegree() const {
+        return 0;
+    }
+
+    // Whether entries are still being moved out of the previous, smaller table
+    bool isResizing() const {
+        return old.capacity > 0;
+    }
+
+    size_t capacity() const {
+        return current.capacity;
+    }
+
+private:
+    static constexpr uint8_t EMPTY = 0;
+    static constexpr uint8_t DELETED = 1;
+    static constexpr uint8_t FULL = 0x80; // Full slots are FULL | 7 hash bits
+    static constexpr size_t MIN_CAPACITY = 16;
+    static constexpr size_t MIGRATE_SLOTS = 32; // Old slots moved per insert or remove
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+    struct Entry {
+        K key;
+        V value;
+    };
+
+    // Control bytes come from calloc and entries are only constructed in full slots, so
+    // allocating a large table does not touch its memory up front.
+    struct Slots {
+        uint8_t* control = nullptr;
+        Entry* entries = nullptr;
+        size_t capacity = 0; // Power of two
+        size_t used = 0;     // Full and deleted slots, the probe chains are bounded by the empty ones
+        size_t full = 0;
+
+        Slots() = default;
+
+        explicit Slots(size_t capacity) : capacity(capacity) {
+            control = static_cast<uint8_t*>(std::calloc(capacity, 1));
+            if (!control) {
+                throw std::bad_alloc();
+            }
+            entries = static_cast<Entry*>(::operator new(capacity * sizeof(Entry), std::nothrow));
+            if (!entries) {
+                std::free(control);
+                throw std::bad_alloc();
+            }
+        }
+
+        Slots(const Slots& other) : Slots() {
+            if (other.capacity == 0) {
+                return;
+            }
+            Slots copy(other.capacity);
+            for (size_t slot = 0; slot < other.capacity; ++slot) {
+                if (other.control[slot] & FULL) {
+                    new (&copy.entries[slot]) Entry(other.entries[slot]);
+                    copy.full++;
+                }
+                copy.control[slot] = other.control[slot];
+            }
+            copy.used = other.used;
+            swap(copy);
+        }
+
+        Slots(Slots&& other) noexcept {
+            swap(other);
+        }
+
+        Slots& operator=(Slots other) noexcept {
+            swap(other);
+            return *this;
+        }
+
+        ~Slots() {
+            // A drained table has no entries left, freeing it does not scan the slots
+            for (size_t slot = 0; full > 0 && slot < capacity; ++slot) {
+                if (control[slot] & FULL) {
+                    entries[slot].~Entry();
+                }
+            }
+            std::free(control);
+            ::operator delete(entries);
+        }
+
+        void swap(Slots& other) noexcept {
+            std::swap(control, other.control);
+            std::swap(entries, other.entries);
+            std::swap(capacity, other.capacity);
+            std::swap(used, other.used);
+            std::swap(full, other.full);
+        }
+
+        size_t mask() const {
+            return capacity - 1;
+        }
+    };
+
+    Slots current;
+    Slots old;
+    size_t migrated = 0; // Old slots already moved into current
+    size_t count = 0;
+    Hash hasher;
+
+    static uint8_t tag(uint64_t hash) {
+        return static_cast<uint8_t>(FULL | (hash >> 57));
+    }
+
+    // Slot holding key, NOT_FOUND if it is not in slots
+    static size_t findSlot(const Slots& slots, const K& key, uint64_t hash);
+
+    // Store an entry whose key is known to be absent
+    static void place(Slots& slots, K&& key, V&& value, uint64_t hash);
+
+    // Mark a slot free and destroy its entry
+    static void erase(Slots& slots, size_t slot);
+
+    // Smallest table that holds entries at no more than half load
+    static size_t capacityFor(size_t entries) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity < entries * 2) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    bool needsGrowth() const {
+        return (current.used + 1) * 4 > current.capacity * 3;
+    }
+
+    void beginResize();
+    void migrateStep();
+    void rehashAll(size_t capacity);
+};
+
+template<typename K, typename V, typename Hash>
+size_t HashTable<K, V, Hash>::findSlot(const Slots& slots, const K& key, uint64_t hash) {
+    if (slots.capacity == 0) {
+        return NOT_FOUND;
+    }
+    uint8_t wanted = tag(hash);
+    size_t mask = slots.mask();
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        uint8_t control = slots.control[slot];
+        if (control == EMPTY) {
+            return NOT_FOUND;
+        }
+        if (control == wanted && slots.entries[slot].key == key) {
+            return slot;
+        }
+    }
+}
+
+template<typename K, typename V, typename Hash>
+void HashTable<K, V, Hash>::place(Slots& slots, K&& key, V&& value, uint64_t hash) {
+    size_t mask = slots.mask();
+    size_t slot = hash & mask;
+    while (slots.control[slot] & FULL) {
+        slot = (slot + 1) & mask;
+    }
+    if (slots.control[slot] == EMPTY) {
+        slots.used++;
+    }
+    new (&slots.entries[slot]) Entry{ std::move(key), std::move(value) };
+    slots.control[slot] = tag(hash);
+    slots.full++;
+}
+
+template<typename K, typename V, typename Hash>
+void HashTable<K, V, Hash>::erase(Slots& slots, size_t slot) {
+    slots.entries[slot].~Entry();
+    slots.full--;
+    // A slot followed by an empty one ends its probe chain and can become empty itself
+    if (slots.control[(slot + 1) & slots.mask()] == EMPTY) {
+        slots.control[slot] = EMPTY;
+        slots.used--;
+    }
+    else {
+        slots.control[slot] = DELETED;
+    }
+}
+
+template<typename K, typename V, typename Hash>
+bool HashTable<K, V, Hash>::insert(const K& key, const V& value) {
+    uint64_t hash = hasher(key);
+    if (findSlot(current, key, hash) != NOT_FOUND || findSlot(old, key, hash) != NOT_FOUND) {
+        return false;
+    }
+    migrateStep();
+    if (current.capacity == 0 || needsGrowth()) {
+        beginResize();
+    }
+    place(current, K(key), V(value), hash);
+    count++;
+    return true;
+}
+
+template<typename K, typename V, typename Hash>
+bool HashTable<K, V, Hash>::remove(const K& key) {
+    uint64_t hash = hasher(key);
+    size_t slot = findSlot(current, key, hash);
+    if (slot != NOT_FOUND) {
+        erase(current, slot);
+    }
+    else {
+        slot = findSlot(old, key, hash);
+        if (slot == NOT_FOUND) {
+            return false;
+        }
+        erase(old, slot);
+    }
+    count--;
+    migrateStep();
+    return true;
+}
+
+template<typename K, typename V, typename Hash>
+V* HashTable<K, V, Hash>::find(const K& key) {
+    uint64_t hash = hasher(key);
+    size_t slot = findSlot(current, key, hash);
+    if (slot != NOT_FOUND) {
+        return &current.entries[slot].value;
+    }
+    slot = findSlot(old, key, hash);
+    if (slot != NOT_FOUND) {
+        return &old.entries[slot].value;
+    }
+    return nullptr;
+}
+
+template<typename K, typename V, typename Hash>
+bool HashTable<K, V, Hash>::bulkLoad(std::vector<std::pair<K, V>> entries) {
+    HashTable loaded;
+    loaded.current = Slots(capacityFor(entries.size()));
+    for (auto& entry : entries) {
+        uint64_t hash = loaded.hasher(entry.first);
+        if (findSlot(loaded.current, entry.first, hash) != NOT_FOUND) {
+            return false;
+        }
+        place(loaded.current, std::move(entry.first), std::move(entry.second), hash);
+    }
+    loaded.count = entries.size();
+    *this = std::move(loaded);
+    return true;
+}
+
+template<typename K, typename V, typename Hash>
+void HashTable<K, V, Hash>::beginResize() {
+    // Growing again before the last resize drained is rare (mostly tombstones), rehash at once
+    if (isResizing()) {
+        rehashAll(capacityFor(count + 1));
+        return;
+    }
+    old = std::move(current);
+    current = Slots(capacityFor(count + 1));
+    migrated = 0;
+    if (old.full == 0) {
+        old = Slots();
+    }
+}
+
+template<typename K, typename V, typename Hash>
+void HashTable<K, V, Hash>::migrateStep() {
+    if (!isResizing()) {
+        return;
+    }
+    // Move enough slots per call that the old table drains before the new one fills up
+    size_t step = std::max(MIGRATE_SLOTS, 4 * old.capacity / current.capacity);
+    size_t end = std::min(migrated + step, old.capacity);
+    for (; migrated < end; ++migrated) {
+        if (old.control[migrated] & FULL) {
+            Entry& entry = old.entries[migrated];
+            uint64_t hash = hasher(entry.key);
+            place(current, std::move(entry.key), std::move(entry.value), hash);
+            entry.~Entry();
+            old.control[migrated] = DELETED; // Keeps the probe chains of the slots not moved yet
+            old.full--;
+        }
+    }
+    if (migrated == old.capacity) {
+        old = Slots();
+        migrated = 0;
+    }
+}
+
+template<typename K, typename V, typename Hash>
+void HashTable<K, V, Hash>::rehashAll(size_t capacity) {
+    Slots rebuilt(capacity);
+    for (Slots* slots : { &current, &old }) {
+        size_t start = slots == &old ? migrated : 0;
+        for (size_t slot = start; slot < slots->capacity; ++slot) {
+            if (slots->control[slot] & FULL) {
+                Entry& entry = slots->entries[slot];
+                uint64_t hash = hasher(entry.key);
+                place(rebuilt, std::move(entry.key), std::move(entry.value), hash);
+            }
+        }
+    }
+    current = std::move(rebuilt);
+    old = Slots();
+    migrated = 0;
+}
@@ -0,0 +1,422 @@
+// Index.h
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "DataTypes.h"
+#include "BTree.h"
+#include "BPlusTree.h"
+#include "HashTable.h"
+
+// Structure backing an index. HASH only answers equality lookups.
+enum class IndexKind {
+    BTREE,
+    BPLUSTREE,
+    HASH
+};
+
+// Index kind named in a statement (BTREE, BPLUSTREE, HASH), nullopt for unknown names
+std::optional<IndexKind> indexKindFromName(const std::string& name) {
+    if (name == "BTREE") {
+        return IndexKind::BTREE;
+    }
+    if (name == "BPLUSTREE") {
+        return IndexKind::BPLUSTREE;
+    }
+    if (name == "HASH") {
+        return IndexKind::HASH;
+    }
+    return std::nullopt;
+}
+
+// Build the structure behind an index, trees take a node degree (0 sizes nodes to one page)
+template<typename Tree, typename K, typename V>
+Tree makeIndexTree(int degree) {
+    if constexpr (std::is_constructible<Tree, int>::value) {
+        return Tree(degree > 0 ? degree : defaultBTreeDegree<K, V>());
+    }
+    else {
+        return Tree();
+    }
+}
+
+// Rows sharing one key in a non-unique index, kept in ascending row id order
+using RowList = std::vector<RowId>;
+
+// Where a range scan stopped: the key it stopped in and how many rows of that key were
+// already handed out. A new cursor starts at the low bound of the range.
+struct RangeCursor {
+    std::optional<Value> key;
+    size_t rows = 0;
+};
+
+// Type-erased index from column values to the rows holding them.
+// Implementations store the concrete key type of the column, so comparisons
+// never go through the variant and nodes only hold the bytes of that type.
+class Index {
+public:
+    virtual ~Index() = default;
+
+    virtual std::unique_ptr<Index> clone() const = 0;
+
+    // Add the entry for a row. Unique indexes expect the key to be new.
+    virtual void insert(const Value& key, RowId row) = 0;
+
+    // Remove the entry of a row, returns false if it was not found.
+    // Unique indexes hold one row per key and drop the key itself.
+    virtual bool remove(const Value& key, RowId row) = 0;
+
+    // Replace the contents with entries in one bottom-up build, entries need not be sorted
+    virtual void bulkLoad(std::vector<std::pair<Value, RowId>> entries) = 0;
+
+    // First row stored for a key, nullopt if the key is absent or of another type
+    virtual std::optional<RowId> find(const Value& key) const = 0;
+
+    // Every row stored for a key in ascending row id order
+    virtual RowList findAll(const Value& key) const = 0;
+
+    // Number of (key, row) entries
+    virtual size_t size() const = 0;
+    virtual void clear() = 0;
+
+    virtual IndexKind getKind() const = 0;
+    virtual int getDegree() const = 0;
+    virtual bool isUnique() const = 0;
+
+    // Append the rows of entries with low <= key <= high to found in key order, a null bound
+    // leaves that end open. At most max rows are added, starting where cursor stopped, and the
+    // cursor is moved past them. Returns false once the range has no rows left.
+    // Only ordered indexes can do this, see isOrdered.
+    virtual bool scanRange(const Value* low, const Value* high, RangeCursor& cursor, size_t max, RowList& found) const = 0;
+
+    bool contains(const Value& key) const {
+        return find(key).has_value();
+    }
+
+    // Hash indexes only answer lookups of a single key
+    bool isOrdered() const {
+        return getKind() != IndexKind::HASH;
+    }
+
+protected:
+    // The key of a range bound, nullptr for an open bound. Bounds of another type than the
+    // keys are a programming error.
+    template<typename K>
+    static const K* boundKey(const Value* bound) {
+        if (!bound) {
+            return nullptr;
+        }
+        const K* typed = std::get_if<K>(bound);
+        if (!typed) {
+            throw std::runtime_error("Index key does not match the column type.");
+        }
+        return typed;
+    }
+};
+
+// Unique index backed by a tree or hash table keyed on one alternative of Value
+template<typename Tree, typename K, IndexKind Kind>
+class TreeIndex : public Index {
+public:
+    // A degree of 0 sizes nodes to one page for the key type
+    explicit TreeIndex(int degree) : tree(makeIndexTree<Tree, K, RowId>(degree)) {}
+
+    std::unique_ptr<Index> clone() const override {
+        return std::make_unique<TreeIndex>(*this);
+    }
+
+    void insert(const Value& key, RowId row) override {
+        const K* typed = std::get_if<K>(&key);
+        if (!typed) {
+            throw std::runtime_error("Index key does not match the column type.");
+        }
+        tree.insert(*typed, row);
+    }
+
+    bool remove(const Value& key, RowId) override {
+        const K* typed = std::get_if<K>(&key);
+        return typed && tree.remove(*typed);
+    }
+
+    void bulkLoad(std::vector<std::pair<Value, RowId>> entries) override {
+        std::vector<std::pair<K, RowId>> typedEntries;
+        typedEntries.reserve(entries.size());
+        for (auto& entry : entries) {
+            K* typed = std::get_if<K>(&entry.first);
+            if (!typed) {
+                throw std::runtime_error("Index key does not match the column type.");
+            }
+            typedEntries.emplace_back(std::move(*typed), entry.second);
+        }
+        if (!tree.bulkLoad(std::move(typedEntries))) {
+            throw std::runtime_error("Duplicate key in index.");
+        }
+    }
+
+    std::optional<RowId> find(const Value& key) const override {
+        const K* typed = std::get_if<K>(&key);
+        if (!typed) {
+            return std::nullopt;
+        }
+        const RowId* row = tree.find(*typed);
+        if (!row) {
+            return std::nullopt;
+        }
+        return *row;
+    }
+
+    RowList findAll(const Value& key) const override {
+        std::optional<RowId> row = find(key);
+        return row ? RowList{ *row } : RowList();
+    }
+
+    size_t size() const override {
+        return tree.size();
+    }
+
+    void clear() override {
+        tree.clear();
+    }
+
+    IndexKind getKind() const override {
+        return Kind;
+    }
+
+    int getDegree() const override {
+        return tree.getDegree();
+    }
+
+    bool isUnique() const override {
+        return true;
+    }
+
+    bool scanRange(const Value* low, const Value* high, RangeCursor& cursor, size_t max, RowList& found) const override {
+        if constexpr (Kind == IndexKind::HASH) {
+            throw std::runtime_error("Hash indexes have no key order.");
+        }
+        else {
+            // One row per key, the key the cursor stopped in was not handed out yet
+            std::optional<K> stop;
+            tree.scanRange(cursor.key ? &std::get<K>(*cursor.key) : boundKey<K>(low), boundKey<K>(high), [&](const K& key, const RowId& row) {
+                if (found.size() == max) {
+                    stop = key;
+                    return false;
+                }
+                found.push_back(row);
+                return true;
+            });
+            if (!stop) {
+                return false;
+            }
+            cursor.key = std::move(*stop);
+            return true;
+        }
+    }
+
+private:
+    Tree tree;
+};
+
+// Non-unique index, every distinct key maps to the sorted list of rows holding it
+template<typename Tree, typename K, IndexKind Kind>
+class MultiTreeIndex : public Index {
+public:
+    // A degree of 0 sizes nodes to one page for the key type
+    explicit MultiTreeIndex(int degree) : tree(makeIndexTree<Tree, K, RowList>(degree)) {}
+
+    std::unique_ptr<Index> clone() const override {
+        return std::make_unique<MultiTreeIndex>(*this);
+    }
+
+    void insert(const Value& key, RowId row) override {
+        const K* typed = std::get_if<K>(&key);
+        if (!typed) {
+            throw std::runtime_error("Index key does not match the column type.");
+        }
+        RowList* rows = tree.find(*typed);
+        if (!rows) {
+            tree.insert(*typed, RowList{ row });
+        }
+        else if (rows->empty() || rows->back() < row) {
+            rows->push_back(row); // New rows get the highest row id, so this is the common case
+        }
+        else {
+            rows->insert(std::lower_bound(rows->begin(), rows->end(), row), row);
+        }
+        entries++;
+    }
+
+    bool remove(const Value& key, RowId row) override {
+        const K* typed = std::get_if<K>(&key);
+        if (!typed) {
+            return false;
+        }
+        RowList* rows = tree.find(*typed);
+        if (!rows) {
+            return false;
+        }
+        auto it = std::lower_bound(rows->begin(), rows->end(), row);
+        if (it == rows->end() || *it != row) {
+            return false;
+        }
+        rows->erase(it);
+        if (rows->empty()) {
+            tree.remove(*typed);
+        }
+        entries--;
+        return true;
+    }
+
+    void bulkLoad(std::vector<std::pair<Value, RowId>> source) override {
+        std::vector<std::pair<K, RowId>> typedEntries;
+        typedEntries.reserve(source.size());
+        for (auto& entry : source) {
+            K* typed = std::get_if<K>(&entry.first);
+            if (!typed) {
+                throw std::runtime_error("Index key does not match the column type.");
+            }
+            typedEntries.emplace_back(std::move(*typed), entry.second);
+        }
+        std::sort(typedEntries.begin(), typedEntries.end());
+
+        // Collapse runs of equal keys into one entry holding their rows
+        std::vector<std::pair<K, RowList>> grouped;
+        for (auto& entry : typedEntries) {
+            if (grouped.empty() || grouped.back().first < entry.first) {
+                grouped.emplace_back(std::move(entry.first), RowList());
+            }
+            grouped.back().second.push_back(entry.second);
+        }
+        tree.bulkLoad(std::move(grouped));
+        entries = typedEntries.size();
+    }
+
+    std::optional<RowId> find(const Value& key) const override {
+        const RowList* rows = findList(key);
+        if (!rows || rows->empty()) {
+            return std::nullopt;
+        }
+        return rows->front();
+    }
+
+    RowList findAll(const Value& key) const override {
+        const RowList* rows = findList(key);
+        return rows ? *rows : RowList();
+    }
+
+    size_t size() const override {
+        return entries;
+    }
+
+    void clear() override {
+        tree.clear();
+        entries = 0;
+    }
+
+    IndexKind getKind() const override {
+        return Kind;
+    }
+
+    int getDegree() const override {
+        return tree.getDegree();
+    }
+
+    bool isUnique() const override {
+        return false;
+    }
+
+    bool scanRange(const Value* low, const Value* high, RangeCursor& cursor, size_t max, RowList& found) const override {
+        if constexpr (Kind == IndexKind::HASH) {
+            throw std::runtime_error("Hash indexes have no key order.");
+        }
+        else {
+            // The scan resumes at the key the cursor stopped in, skipping the rows it handed out
+            const K* from = cursor.key ? &std::get<K>(*cursor.key) : boundKey<K>(low);
+            size_t skip = cursor.key ? cursor.rows : 0;
+            std::optional<K> stop;
+            size_t stopRow = 0;
+            tree.scanRange(from, boundKey<K>(high), [&](const K& key, const RowList& rows) {
+                size_t i = skip && !(*from < key) ? skip : 0;
+                skip = 0;
+                for (; i < rows.size(); ++i) {
+                    if (found.size() == max) {
+                        stop = key;
+                        stopRow = i;
+                        return false;
+                    }
+                    found.push_back(rows[i]);
+                }
+                return true;
+            });
+            if (!stop) {
+                return false;
+            }
+            cursor.key = std::move(*stop);
+            cursor.rows = stopRow;
+            return true;
+        }
+    }
+
+private:
+    Tree tree;
+    size_t entries = 0;
+
+    const RowList* findList(const Value& key) const {
+        const K* typed = std::get_if<K>(&key);
+        return typed ? tree.find(*typed) : nullptr;
+    }
+};
+
+template<typename K>
+using BTreeIndex = TreeIndex<BTree<K, RowId>, K, IndexKind::BTREE>;
+
+template<typename K>
+using BPlusTreeIndex = TreeIndex<BPlusTree<K, RowId>, K, IndexKind::BPLUSTREE>;
+
+template<typename K>
+using HashIndex = TreeIndex<HashTable<K, RowId>, K, IndexKind::HASH>;
+
+template<typename K>
+using BTreeMultiIndex = MultiTreeIndex<BTree<K, RowList>, K, IndexKind::BTREE>;
+
+template<typename K>
+using BPlusTreeMultiIndex = MultiTreeIndex<BPlusTree<K, RowList>, K, IndexKind::BPLUSTREE>;
+
+template<typename K>
+using HashMultiIndex = MultiTreeIndex<HashTable<K, RowList>, K, IndexKind::HASH>;
+
+template<template<typename> class IndexType>
+std::unique_ptr<Index> makeTypedIndex(DataType type, int degree) {
+    switch (type) {
+    case DataType::INT:
+        return std::make_unique<IndexType<int>>(degree);
+    case DataType::STRING:
+        return std::make_unique<IndexType<std::string>>(degree);
+    case DataType::BOOL:
+        return std::make_unique<IndexType<bool>>(degree);
+    case DataType::TIMESTAMP:
+        return std::make_unique<IndexType<std::time_t>>(degree);
+    case DataType::FLOAT:
+        return std::make_unique<IndexType<float>>(degree);
+    case DataType::BLOB:
+        return std::make_unique<IndexType<std::vector<uint8_t>>>(degree);
+    }
+    throw std::runtime_error("Unsupported index key type.");
+}
+
+// Create an index whose key type matches a column type, degree 0 picks a page-sized node.
+// Non-unique indexes accept any number of rows per key.
+std::unique_ptr<Index> makeIndex(DataType type, IndexKind kind = IndexKind::BTREE, int degree = 0, bool unique = true) {
+    if (kind == IndexKind::HASH) {
+        return unique ? makeTypedIndex<HashIndex>(type, degree) : makeTypedIndex<HashMultiIndex>(type, degree);
+    }
+    if (kind == IndexKind::BPLUSTREE) {
+        return unique ? makeTypedIndex<BPlusTreeIndex>(type, degree) : makeTypedIndex<BPlusTreeMultiIndex>(type, degree);
+    }
+    return unique ? makeTypedIndex<BTreeIndex>(type, degree) : makeTypedIndex<BTreeMultiIndex>(type, degree);
+}
@@ -0,0 +1,175 @@
+// Lexer.h
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Kind of a token in a command
+enum class TokenType {
+    IDENTIFIER, // Names and keywords: a letter or '_' followed by letters, digits and '_'
+    NUMBER,     // Digits with an optional fraction and exponent, the sign is a separate symbol
+    STRING,     // Single-quoted literal, a quote inside is written twice
+    SYMBOL,     // Any other single character: ( ) , ; = - and so on
+    END         // End of the command
+};
+
+// A token points into the command text, nothing is copied while scanning
+struct Token {
+    TokenType type = TokenType::END;
+    std::string_view text; // Source text, a string literal keeps its quotes
+    size_t position = 0;   // Byte offset of the token in the command
+
+    size_t end() const {
+        return position + text.size();
+    }
+};
+
+// A command that does not follow the grammar, position is the byte offset of the offending token
+class SyntaxError : public std::runtime_error {
+public:
+    SyntaxError(const std::string& message, size_t position)
+        : std::runtime_error(message + " at position " + std::to_string(position)), position(position) {}
+
+    size_t getPosition() const {
+        return position;
+    }
+
+private:
+    size_t position;
+};
+
+// Keywords are matched without regard to case, names are not
+bool isKeyword(const Token& token, std::string_view keyword) {
+    if (token.type != TokenType::IDENTIFIER || token.text.size() != keyword.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < keyword.size(); ++i) {
+        char c = token.text[i];
+        if (c >= 'a' && c <= 'z') {
+            c = static_cast<char>(c - 'a' + 'A');
+        }
+        if (c != keyword[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The value of a string literal token, without its quotes and with doubled quotes undone
+std::string unquote(const Token& token) {
+    std::string_view body = token.text.substr(1, token.text.size() - 2);
+    std::string value;
+    value.reserve(body.size());
+    for (size_t i = 0; i < body.size(); ++i) {
+        value.push_back(body[i]);
+        if (body[i] == '\'') {
+            ++i; // Skip the second quote of the pair
+        }
+    }
+    return value;
+}
+
+// Lexer class
+// Splits a command into tokens in a single pass, one token at a time as the parser asks for them
+class Lexer {
+public:
+    explicit Lexer(std::string_view source) : source(source) {}
+
+    // Scan the next token, END once the command is used up
+    Token next();
+
+    // Continue scanning at a byte offset, used to skip the rest of a statement after an error
+    void seek(size_t position) {
+        offset = position < source.size() ? position : source.size();
+    }
+
+    std::string_view getSource() const {
+        return source;
+    }
+
+private:
+    std::string_view source;
+    size_t offset = 0;
+
+    static bool isIdentifierStart(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    static bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+    }
+
+    Token make(TokenType type, size_t start) const {
+        return Token{ type, source.substr(start, offset - start), start };
+    }
+};
+
+Token Lexer::next() {
+    while (offset < source.size() && isSpace(source[offset])) {
+        ++offset;
+    }
+    size_t start = offset;
+    if (offset == source.size()) {
+        return make(TokenType::END, start);
+    }
+
+    char c = source[offset];
+    if (isIdentifierStart(c)) {
+        while (offset < source.size() && (isIdentifierStart(source[offset]) || isDigit(source[offset]))) {
+            ++offset;
+        }
+        return make(TokenType::IDENTIFIER, start);
+    }
+
+    if (isDigit(c) || (c == '.' && offset + 1 < source.size() && isDigit(source[offset + 1]))) {
+        while (offset < source.size() && isDigit(source[offset])) {
+            ++offset;
+        }
+        if (offset < source.size() && source[offset] == '.') {
+            ++offset;
+            while (offset < source.size() && isDigit(source[offset])) {
+                ++offset;
+            }
+        }
+        // An exponent only counts if digits follow, otherwise the 'e' starts the next token
+        if (offset < source.size() && (source[offset] == 'e' || source[offset] == 'E')) {
+            size_t exponent = offset + 1;
+            if (exponent < source.size() && (source[exponent] == '+' || source[exponent] == '-')) {
+                ++exponent;
+            }
+            if (exponent < source.size() && isDigit(source[exponent])) {
+                offset = exponent;
+                while (offset < source.size() && isDigit(source[offset])) {
+                    ++offset;
+                }
+            }
+        }
+        return make(TokenType::NUMBER, start);
+    }
+
+    if (c == '\'') {
+        ++offset;
+        while (true) {
+            if (offset == source.size()) {
+                throw SyntaxError("Unterminated string literal", start);
+            }
+            if (source[offset] == '\'') {
+                if (offset + 1 < source.size() && source[offset + 1] == '\'') {
+                    offset += 2;
+                    continue;
+                }
+                ++offset;
+                return make(TokenType::STRING, start);
+            }
+            ++offset;
+        }
+    }
+
+    ++offset;
+    return make(TokenType::SYMBOL, start);
+}
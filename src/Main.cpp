@@ -7,6 +7,7 @@
 #include "UserManagement.h"
 #include "Database.h"
 #include "DataBaseFile.h"
+#include "WriteAheadLog.h"
 #include <iostream>
 #include <iomanip>
 
@@ -23,9 +24,9 @@ void printDatabase(const Database& db) {
         std::cout << std::endl;
 
         // Print rows
-        for (const auto& row : table.rows) {
-            for (const auto& column : table.columns) {
-                const auto& value = row.getData(column.name);
+        table.forEachRow([&](RowId row) {
+            for (size_t c = 0; c < table.columns.size(); ++c) {
+                const auto value = table.getValue(row, c);
                 if (std::holds_alternative<int>(value)) {
                     std::cout << std::get<int>(value) << "\t";
                 }
@@ -54,7 +55,7 @@ void printDatabase(const Database& db) {
                 }
             }
             std::cout << std::endl;
-        }
+        });
     }
 }
 
@@ -108,7 +109,25 @@ void login(UserManagement& userManager) {
 }
 
 
-int main() {
+// Value of a numeric command line option such as --jobs N, fallback if it is not given
+size_t parseSizeOption(int argc, char* argv[], const std::string& option, size_t fallback) {
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (argv[i] == option) {
+            try {
+                return static_cast<size_t>(std::stoull(argv[i + 1]));
+            }
+            catch (const std::exception&) {
+                std::cerr << "Invalid " << option << " value: " << argv[i + 1] << std::endl;
+                exit(1);
+            }
+        }
+    }
+    return fallback;
+}
+
+int main(int argc, char* argv[]) {
+    // Worker threads for loading and saving tables, 0 uses every core
+    const size_t jobs = parseSizeOption(argc, argv, "--jobs", 0);
     UserManagement userManager("users.dat");
 
     if (!userManager.userDataExists()) {
@@ -119,15 +138,45 @@ int main() {
     }
 
     DatabaseManager dbManager;
+    // Megabytes of unchanged tables kept in memory, 0 keeps every table once it is loaded
+    dbManager.memoryBudget = parseSizeOption(argc, argv, "--memory-budget", 0) << 20;
     QueryParser parser(dbManager);
+    parser.setJobs(jobs);
     CommandExecutor executor(parser);
 
-    // Load the database from a file if it exists
+    // Open every database in the catalog, tables are only read when a command uses them.
+    // Without one, load the database from the last checkpoint or from a file saved before checkpoints existed.
+    const std::string catalogDirName = "database.catalog";
     const std::string dbFileName = "database.bin";
-    if (std::filesystem::exists(dbFileName)) {
-        dbManager.databases["TestDB"] = DataBaseFile::loadDatabase(dbFileName,dbManager);
+    const std::string checkpointDirName = "database.ckpt";
+    if (DataBaseFile::hasCatalog(catalogDirName)) {
+        DataBaseFile::openCatalog(catalogDirName, dbManager);
+    }
+    else if (DataBaseFile::hasCheckpoint(checkpointDirName)) {
+        dbManager.databases["TestDB"] = DataBaseFile::loadCheckpoint(checkpointDirName, jobs);
         dbManager.selectDatabase("TestDB");
     }
+    else if (std::filesystem::exists(dbFileName)) {
+        dbManager.databases["TestDB"] = DataBaseFile::loadDatabase(dbFileName, jobs);
+        dbManager.selectDatabase("TestDB");
+    }
+
+    // Redo the statements logged since the last save, then log new ones.
+    // Records the catalog already holds are passed over, the log may outlive a save that was cut short.
+    // Commands run one after another here, so syncs are grouped rather than paid per command.
+    // A record that cannot be redone stops startup, saving now would drop its change for good.
+    const std::string walFileName = "database.wal";
+    WriteAheadLog wal;
+    WriteAheadLog::Options walOptions;
+    walOptions.policy = SyncPolicy::GROUP;
+    try {
+        wal.open(walFileName, walOptions, dbManager.appliedLsn, [&](uint64_t lsn, const std::string& record) { parser.replayLogRecord(lsn, record); });
+    }
+    catch (const std::runtime_error& e) {
+        std::cerr << "Failed to replay the write-ahead log " << walFileName << ": " << e.what() << std::endl;
+        return 1;
+    }
+    parser.setWriteAheadLog(&wal);
 
     // Execute commands from an external file
     const std::string commandsFileName = "commands.txt";
@@ -141,10 +190,11 @@ int main() {
         printDatabase(*dbManager.getCurrentDatabase());
     }
 
-    // Save the database to a file after operations
-    if (dbManager.getCurrentDatabase()) {
-        DataBaseFile::saveDatabase(*dbManager.getCurrentDatabase(), dbFileName,dbManager);
-    }
+    // Checkpoint every database after operations, only the pages changed since the last one are written
+    DataBaseFile::saveCatalog(dbManager, catalogDirName, wal.lastLsn(), jobs);
+
+    // Every change is in the checkpoint now, the log starts over
+    wal.reset();
 
     return 0;
 }
@@ -0,0 +1,109 @@
+// MappedFile.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// MappedFile class
+// A whole file mapped read-only into memory. The pages are shared with the OS page cache
+// and only read from disk when first touched, so opening a large file costs no copying.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        // Others may rename or delete the file while it is mapped, as they can on POSIX systems
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to open file: " + path);
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to read the size of file: " + path);
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+        if (size > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            if (!data) {
+                if (mapping) {
+                    CloseHandle(mapping);
+                }
+                CloseHandle(file);
+                throw std::runtime_error("Failed to map file: " + path);
+            }
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open file: " + path);
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to read the size of file: " + path);
+        }
+        size = static_cast<size_t>(status.st_size);
+        if (size > 0) {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Failed to map file: " + path);
+            }
+            data = static_cast<const uint8_t*>(mapped);
+        }
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+#else
+        if (data) {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+#endif
+    }
+
+    const uint8_t* getData() const {
+        return data;
+    }
+
+    size_t getSize() const {
+        return size;
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
@@ -0,0 +1,154 @@
+// NodePool.h
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Fixed-size block allocator for tree nodes.
+// Blocks are carved out of large cache-line-aligned slabs, freed blocks go on an
+// intrusive free list and are handed out again before the slab grows, and every
+// block is returned at once by releasing the slabs.
+class NodePool {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr size_t SLAB_BYTES = 64 * 1024;
+    static constexpr size_t MIN_BLOCKS_PER_SLAB = 8;
+
+    explicit NodePool(size_t blockSize = ALIGNMENT)
+        : blockSize(alignUp(std::max(blockSize, sizeof(FreeBlock)))),
+          blocksPerSlab(std::max(MIN_BLOCKS_PER_SLAB, SLAB_BYTES / this->blockSize)) {}
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    NodePool(NodePool&& other) noexcept
+        : blockSize(other.blockSize), blocksPerSlab(other.blocksPerSlab), slabs(std::move(other.slabs)),
+          freeList(other.freeList), next(other.next), end(other.end), live(other.live) {
+        other.slabs.clear();
+        other.freeList = nullptr;
+        other.next = other.end = nullptr;
+        other.live = 0;
+    }
+
+    NodePool& operator=(NodePool&& other) noexcept {
+        if (this != &other) {
+            release();
+            blockSize = other.blockSize;
+            blocksPerSlab = other.blocksPerSlab;
+            slabs = std::move(other.slabs);
+            freeList = other.freeList;
+            next = other.next;
+            end = other.end;
+            live = other.live;
+            other.slabs.clear();
+            other.freeList = nullptr;
+            other.next = other.end = nullptr;
+            other.live = 0;
+        }
+        return *this;
+    }
+
+    ~NodePool() {
+        release();
+    }
+
+    // Uninitialized, cache-line-aligned block of blockSize bytes
+    void* allocate() {
+        live++;
+        if (freeList) {
+            FreeBlock* block = freeList;
+            freeList = block->next;
+            return block;
+        }
+        if (next == end) {
+            addSlab(blocksPerSlab);
+        }
+        void* block = next;
+        next += blockSize;
+        return block;
+    }
+
+    // Return a block to the free list, objects in it must already be destroyed
+    void deallocate(void* block) {
+        FreeBlock* freed = static_cast<FreeBlock*>(block);
+        freed->next = freeList;
+        freeList = freed;
+        live--;
+    }
+
+    // Make room for at least blocks more allocations in a single slab
+    void reserve(size_t blocks) {
+        size_t available = static_cast<size_t>(end - next) / blockSize;
+        if (blocks > available) {
+            addSlab(std::max(blocks, blocksPerSlab));
+        }
+    }
+
+    // Free every slab at once, objects in live blocks must already be destroyed
+    void release() {
+        for (const Slab& slab : slabs) {
+            ::operator delete(slab.memory, std::align_val_t(ALIGNMENT));
+        }
+        slabs.clear();
+        freeList = nullptr;
+        next = end = nullptr;
+        live = 0;
+    }
+
+    size_t getBlockSize() const {
+        return blockSize;
+    }
+
+    // Number of blocks handed out and not returned
+    size_t liveBlocks() const {
+        return live;
+    }
+
+    // Bytes held in slabs, including free blocks
+    size_t memoryUsage() const {
+        size_t total = 0;
+        for (const Slab& slab : slabs) {
+            total += slab.size;
+        }
+        return total;
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct Slab {
+        char* memory;
+        size_t size;
+    };
+
+    size_t blockSize;
+    size_t blocksPerSlab;
+    std::vector<Slab> slabs;
+    FreeBlock* freeList = nullptr;
+    char* next = nullptr; // Next never-used block of the newest slab
+    char* end = nullptr;
+    size_t live = 0;
+
+    static size_t alignUp(size_t size) {
+        return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    void addSlab(size_t blocks) {
+        // The unused tail of the previous slab goes on the free list so it is not lost
+        while (next != end) {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(next);
+            block->next = freeList;
+            freeList = block;
+            next += blockSize;
+        }
+        size_t size = blocks * blockSize;
+        slabs.reserve(slabs.size() + 1);
+        char* memory = static_cast<char*>(::operator new(size, std::align_val_t(ALIGNMENT)));
+        slabs.push_back({ memory, size });
+        next = memory;
+        end = memory + size;
+    }
+};
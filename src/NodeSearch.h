@@ -0,0 +1,137 @@
+// NodeSearch.h
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+// Pick the widest compare instructions the build targets, scalar code is the fallback
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NODE_SEARCH_AVX2 1
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define NODE_SEARCH_SSE2 1
+#define NODE_SEARCH_SSE42 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NODE_SEARCH_SSE2 1
+#endif
+
+// Number of keys in keys[0, n) that are less than key, n keys compared with packed 32-bit compares
+int countLessInt32(const int32_t* keys, int n, int32_t key) {
+    int i = 0;
+    int count = 0;
+#if defined(NODE_SEARCH_AVX2)
+    __m256i needle = _mm256_set1_epi32(key);
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(needle, data)); // Each true lane is -1
+    }
+    alignas(32) int32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    for (int lane = 0; lane < 8; ++lane) {
+        count += lanes[lane];
+    }
+#elif defined(NODE_SEARCH_SSE2)
+    __m128i needle = _mm_set1_epi32(key);
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(needle, data)); // Each true lane is -1
+    }
+    alignas(16) int32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    for (int lane = 0; lane < 4; ++lane) {
+        count += lanes[lane];
+    }
+#endif
+    for (; i < n; ++i) {
+        count += keys[i] < key;
+    }
+    return count;
+}
+
+// Number of keys in keys[0, n) that are less than key, n keys compared with packed 64-bit compares
+int countLessInt64(const int64_t* keys, int n, int64_t key) {
+    int i = 0;
+    int count = 0;
+#if defined(NODE_SEARCH_AVX2)
+    __m256i needle = _mm256_set1_epi64x(key);
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 4 <= n; i += 4) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        acc = _mm256_sub_epi64(acc, _mm256_cmpgt_epi64(needle, data));
+    }
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    for (int lane = 0; lane < 4; ++lane) {
+        count += static_cast<int>(lanes[lane]);
+    }
+#elif defined(NODE_SEARCH_SSE42)
+    __m128i needle = _mm_set1_epi64x(key);
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 2 <= n; i += 2) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        acc = _mm_sub_epi64(acc, _mm_cmpgt_epi64(needle, data));
+    }
+    alignas(16) int64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    count += static_cast<int>(lanes[0] + lanes[1]);
+#endif
+    for (; i < n; ++i) {
+        count += keys[i] < key;
+    }
+    return count;
+}
+
+// Position of a key inside the sorted key array of a tree node.
+// The generic version is a plain binary search.
+template<typename K, typename Enable = void>
+struct NodeSearch {
+    static int lowerBound(const K* keys, int n, const K& key) {
+        return static_cast<int>(std::lower_bound(keys, keys + n, key) - keys);
+    }
+
+    static int upperBound(const K* keys, int n, const K& key) {
+        return static_cast<int>(std::upper_bound(keys, keys + n, key) - keys);
+    }
+};
+
+// Signed 32 and 64-bit keys (INT and TIMESTAMP columns) binary search down to a window
+// of a few vectors, then count the smaller keys of the window with packed compares.
+template<typename K>
+struct NodeSearch<K, std::enable_if_t<std::is_integral<K>::value && std::is_signed<K>::value && (sizeof(K) == 4 || sizeof(K) == 8)>> {
+    static constexpr int WINDOW = sizeof(K) == 4 ? 32 : 16;
+
+    static int countLess(const K* keys, int n, K key) {
+        if (sizeof(K) == 4) {
+            return countLessInt32(reinterpret_cast<const int32_t*>(keys), n, static_cast<int32_t>(key));
+        }
+        return countLessInt64(reinterpret_cast<const int64_t*>(keys), n, static_cast<int64_t>(key));
+    }
+
+    static int lowerBound(const K* keys, int n, K key) {
+        int low = 0;
+        int high = n;
+        while (high - low > WINDOW) {
+            int mid = low + (high - low) / 2;
+            if (keys[mid] < key) {
+                low = mid + 1;
+            }
+            else {
+                high = mid;
+            }
+        }
+        return low + countLess(keys + low, high - low, key);
+    }
+
+    static int upperBound(const K* keys, int n, K key) {
+        // Keys are integers, so "less or equal to key" is "less than key + 1"
+        if (key == std::numeric_limits<K>::max()) {
+            return n;
+        }
+        return lowerBound(keys, n, static_cast<K>(key + 1));
+    }
+};
@@ -0,0 +1,64 @@
+// ParallelFor.h
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads used when a caller asks for 0 jobs
+size_t defaultJobs() {
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+// Run task(0) .. task(count - 1) on up to jobs threads, the calling thread being one of them.
+// Tasks are handed out one at a time, so a few large ones do not hold up the rest.
+// The first exception a task throws is rethrown once every thread has stopped, the
+// tasks not started by then are skipped.
+void parallelFor(size_t count, size_t jobs, const std::function<void(size_t)>& task) {
+    if (jobs == 0) {
+        jobs = defaultJobs();
+    }
+    size_t threads = std::min(jobs, count);
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{ 0 };
+    std::atomic<bool> failed{ false };
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto work = [&]() {
+        for (size_t i = next++; i < count && !failed; i = next++) {
+            try {
+                task(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (size_t t = 1; t < threads; ++t) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,101 @@
+// PreparedStatement.h
+#pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Database.h"
+#include "StatementParser.h"
+
+// PreparedStatement struct
+// A statement parsed once and run many times with different parameter values.
+// An INSERT is also bound to its table: the slot each value goes to, the values given in the
+// statement converted once, and the foreign keys to check. The binding is redone when the
+// current database or its tables change (see SchemaVersion).
+struct PreparedStatement {
+    Statement statement;
+    std::string text;                       // Normalized statement text
+    std::vector<size_t> parameterPositions; // Offset of each ? in text
+
+    // Binding of an INSERT
+    const Database* boundDatabase = nullptr;
+    uint64_t boundVersion = 0;
+    Table* table = nullptr;
+    std::vector<Value> rowTemplate;           // Constants and defaults in column order, row after row
+    std::vector<size_t> parameterColumns;     // Slot in rowTemplate each parameter fills
+    std::vector<DataType> parameterTypes;
+    std::vector<ForeignKeyTarget> foreignKeys;
+
+    size_t parameterCount() const {
+        return parameterPositions.size();
+    }
+
+    // The statement text with each ? replaced by its value, as the write-ahead log records it
+    std::string boundText(const std::vector<Value>& parameters) const {
+        std::string bound;
+        bound.reserve(text.size() + parameters.size() * 8);
+        size_t last = 0;
+        for (size_t i = 0; i < parameterPositions.size(); ++i) {
+            bound.append(text, last, parameterPositions[i] - last);
+            bound.append(literalText(parameters[i]));
+            last = parameterPositions[i] + 1;
+        }
+        bound.append(text, last, std::string::npos);
+        return bound;
+    }
+};
+
+// PlanCache class
+// Prepared statements by normalized text. Once full, the least recently used plan is dropped;
+// a plan still held elsewhere (a named statement, a caller) stays alive.
+class PlanCache {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+
+    explicit PlanCache(size_t capacity = DEFAULT_CAPACITY) : capacity(capacity) {}
+
+    // The plan cached for a normalized statement, nullptr if there is none.
+    // A hit becomes the most recently used.
+    std::shared_ptr<PreparedStatement> find(const std::string& text) {
+        auto it = byText.find(text);
+        if (it == byText.end()) {
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->plan;
+    }
+
+    void insert(const std::string& text, std::shared_ptr<PreparedStatement> plan) {
+        if (capacity == 0 || byText.count(text)) {
+            return;
+        }
+        if (entries.size() == capacity) {
+            byText.erase(entries.back().text);
+            entries.pop_back();
+        }
+        entries.push_front(Entry{ text, std::move(plan) });
+        byText.emplace(entries.front().text, entries.begin());
+    }
+
+    void clear() {
+        byText.clear();
+        entries.clear();
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+private:
+    struct Entry {
+        std::string text;
+        std::shared_ptr<PreparedStatement> plan;
+    };
+
+    size_t capacity;
+    std::list<Entry> entries; // Most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> byText; // Keys point into the entries
+};
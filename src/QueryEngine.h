@@ -0,0 +1,557 @@
+// QueryEngine.h
+#pragma once
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Database.h"
+#include "FilterKernels.h"
+#include "StatementParser.h"
+
+// A WHERE condition resolved against a table: the column it reads and its value converted
+// to the column type
+struct Predicate {
+    size_t column;
+    CompareOp op;
+    Value value;
+};
+
+// Order of the value stored at a row against a value of the column type: negative, 0 or
+// positive. Stored values are read in place, nothing is materialized.
+int compareStored(const ColumnVector& data, RowId row, const Value& value) {
+    auto order = [](const auto& a, const auto& b) {
+        return a < b ? -1 : (b < a ? 1 : 0);
+    };
+    switch (data.getType()) {
+    case DataType::INT:
+        return order(data.getInt(row), std::get<int>(value));
+    case DataType::TIMESTAMP:
+        return order(data.getTimestamp(row), std::get<std::time_t>(value));
+    case DataType::FLOAT:
+        return order(data.getFloat(row), std::get<float>(value));
+    case DataType::BOOL:
+        return order(data.getBool(row), std::get<bool>(value));
+    case DataType::STRING:
+        return data.getBytes(row).compare(std::get<std::string>(value));
+    case DataType::BLOB: {
+        const auto& blob = std::get<std::vector<uint8_t>>(value);
+        return data.getBytes(row).compare(std::string_view(reinterpret_cast<const char*>(blob.data()), blob.size()));
+    }
+    }
+    return 0;
+}
+
+bool satisfies(const Predicate& predicate, const ColumnVector& data, RowId row) {
+    int order = compareStored(data, row, predicate.value);
+    switch (predicate.op) {
+    case CompareOp::EQUAL:
+        return order == 0;
+    case CompareOp::NOT_EQUAL:
+        return order != 0;
+    case CompareOp::LESS:
+        return order < 0;
+    case CompareOp::LESS_EQUAL:
+        return order <= 0;
+    case CompareOp::GREATER:
+        return order > 0;
+    case CompareOp::GREATER_EQUAL:
+        return order >= 0;
+    }
+    return false;
+}
+
+// RowBatch struct
+// Rows passed between the operators of a pipeline, up to CAPACITY at a time. rows is the
+// selection vector: the ids of the rows still selected, in order. A batch read straight off
+// the table was cut from the contiguous row ids [first, first + span), which lets a filter
+// compare whole slices of the column arrays at once.
+struct RowBatch {
+    // A multiple of 64 so scanned batches start on a word of a BOOL bitmap
+    static constexpr size_t CAPACITY = 2048;
+
+    std::vector<RowId> rows;
+    RowId first = 0;
+    size_t span = 0;
+    bool contiguous = false;
+};
+
+// RowOperator class
+// One step of a pull-based query pipeline. Each call to next produces the next batch of
+// rows, operators ask their input for batches only as they need them, so a LIMIT stops the
+// scan below it as soon as it has enough rows.
+class RowOperator {
+public:
+    virtual ~RowOperator() = default;
+
+    // Fill batch with the next rows, false once there are no more. A batch may come back
+    // empty when a filter dropped all of its rows.
+    virtual bool next(RowBatch& batch) = 0;
+
+    // What the operator does, for the query plan printed with the results
+    virtual std::string describe() const = 0;
+};
+
+// Every live row in row id order, or those of the row ids [begin, end).
+// begin must be a multiple of RowBatch::CAPACITY.
+class TableScan : public RowOperator {
+public:
+    explicit TableScan(const Table& table) : table(table), position(0), end(table.slotCount()) {}
+
+    TableScan(const Table& table, RowId begin, RowId end) : table(table), position(begin), end(std::min(end, table.slotCount())) {}
+
+    bool next(RowBatch& batch) override {
+        if (position >= end) {
+            return false;
+        }
+        batch.first = position;
+        batch.span = std::min(RowBatch::CAPACITY, end - position);
+        batch.contiguous = true;
+        batch.rows.resize(batch.span);
+        if (table.rowCount() == table.slotCount()) {
+            // No row was ever deleted, every id is selected
+            for (size_t i = 0; i < batch.span; ++i) {
+                batch.rows[i] = position + i;
+            }
+        }
+        else {
+            size_t selected = 0;
+            for (size_t i = 0; i < batch.span; ++i) {
+                batch.rows[selected] = position + i;
+                selected += table.live[position + i];
+            }
+            batch.rows.resize(selected);
+        }
+        position += batch.span;
+        return true;
+    }
+
+    std::string describe() const override {
+        return "TableScan(" + table.name + ")";
+    }
+
+private:
+    const Table& table;
+    RowId position;
+    RowId end;
+};
+
+// Rows found through an index, handed on in batches. Each batch is fetched from the index
+// when it is asked for, so a LIMIT stops the index walk early.
+class IndexScan : public RowOperator {
+public:
+    bool next(RowBatch& batch) override {
+        if (done) {
+            return false;
+        }
+        batch.rows.clear();
+        batch.contiguous = false;
+        done = !fetch(batch.rows, RowBatch::CAPACITY);
+        return !batch.rows.empty();
+    }
+
+protected:
+    // Append at most max of the next matching rows, returns false once none are left
+    virtual bool fetch(RowList& found, size_t max) = 0;
+
+private:
+    bool done = false;
+};
+
+// The rows of an index holding one key
+class IndexLookup : public IndexScan {
+public:
+    IndexLookup(const Index& index, Value key, std::string column) : index(index), key(std::move(key)), column(std::move(column)) {}
+
+    std::string describe() const override {
+        return "IndexLookup(" + column + ")";
+    }
+
+protected:
+    // The rows of one key are few next to a range, they are looked up at once
+    bool fetch(RowList& found, size_t max) override {
+        if (!fetched) {
+            rows = index.findAll(key);
+            fetched = true;
+        }
+        size_t count = std::min(max, rows.size() - position);
+        found.insert(found.end(), rows.begin() + position, rows.begin() + position + count);
+        position += count;
+        return position < rows.size();
+    }
+
+private:
+    const Index& index;
+    Value key;
+    std::string column;
+    RowList rows;
+    size_t position = 0;
+    bool fetched = false;
+};
+
+// The rows of an ordered index with keys between two bounds, in key order. A missing bound
+// leaves that end open.
+class IndexRangeScan : public IndexScan {
+public:
+    IndexRangeScan(const Index& index, std::optional<Value> low, std::optional<Value> high, std::string column)
+        : index(index), low(std::move(low)), high(std::move(high)), column(std::move(column)) {}
+
+    std::string describe() const override {
+        return "IndexRangeScan(" + column + ")";
+    }
+
+protected:
+    bool fetch(RowList& found, size_t max) override {
+        return index.scanRange(low ? &*low : nullptr, high ? &*high : nullptr, cursor, max, found);
+    }
+
+private:
+    const Index& index;
+    std::optional<Value> low;
+    std::optional<Value> high;
+    std::string column;
+    RangeCursor cursor;
+};
+
+// The mask bits of a comparison operator (see FilterKernels.h)
+CompareBits compareBits(CompareOp op) {
+    switch (op) {
+    case CompareOp::EQUAL:
+        return { true, true, true };
+    case CompareOp::NOT_EQUAL:
+        return { true, true, false };
+    case CompareOp::LESS:
+        return { true, false, false };
+    case CompareOp::LESS_EQUAL:
+        return { false, true, true };
+    case CompareOp::GREATER:
+        return { false, true, false };
+    case CompareOp::GREATER_EQUAL:
+        return { true, false, true };
+    }
+    return { false, false, true };
+}
+
+// The input rows for which every predicate holds. Batches cut from contiguous row ids are
+// filtered a column slice at a time: each predicate ANDs its result into a bitmask of the
+// batch with the packed kernels of FilterKernels.h, and the selection vector is rebuilt from
+// the mask once. Other batches, and STRING and BLOB columns, are compared row by row.
+class Filter : public RowOperator {
+public:
+    Filter(std::unique_ptr<RowOperator> input, const Table& table, std::vector<Predicate> predicates)
+        : input(std::move(input)), table(table), predicates(std::move(predicates)) {}
+
+    bool next(RowBatch& batch) override {
+        if (!input->next(batch)) {
+            return false;
+        }
+        if (batch.contiguous) {
+            filterSlice(batch);
+        }
+        else {
+            filterRows(batch);
+        }
+        return true;
+    }
+
+    std::string describe() const override {
+        return "Filter(" + std::to_string(predicates.size()) + ") <- " + input->describe();
+    }
+
+private:
+    std::unique_ptr<RowOperator> input;
+    const Table& table;
+    std::vector<Predicate> predicates;
+    uint64_t mask[RowBatch::CAPACITY / 64];
+
+    void filterRows(RowBatch& batch) const {
+        size_t kept = 0;
+        for (RowId row : batch.rows) {
+            bool passes = true;
+            for (const Predicate& predicate : predicates) {
+                if (!satisfies(predicate, table.columnData[predicate.column], row)) {
+                    passes = false;
+                    break;
+                }
+            }
+            batch.rows[kept] = row;
+            kept += passes;
+        }
+        batch.rows.resize(kept);
+    }
+
+    void filterSlice(RowBatch& batch) {
+        size_t words = (batch.span + 63) / 64;
+        if (batch.rows.size() == batch.span) {
+            std::fill(mask, mask + words, ~uint64_t(0));
+            // No bits past the end of the slice, they would stand for rows that do not exist
+            if (batch.span % 64 != 0) {
+                mask[words - 1] &= (uint64_t(1) << (batch.span % 64)) - 1;
+            }
+        }
+        else {
+            std::fill(mask, mask + words, uint64_t(0));
+            for (RowId row : batch.rows) {
+                size_t bit = row - batch.first;
+                mask[bit / 64] |= uint64_t(1) << (bit % 64);
+            }
+        }
+
+        for (const Predicate& predicate : predicates) {
+            const ColumnVector& data = table.columnData[predicate.column];
+            CompareBits compare = compareBits(predicate.op);
+            const void* values = data.getArrays().values;
+            switch (data.getType()) {
+            case DataType::INT:
+                filterValues(static_cast<const int32_t*>(values) + batch.first, batch.span, compare,
+                    static_cast<int32_t>(std::get<int>(predicate.value)), mask);
+                break;
+            case DataType::TIMESTAMP:
+                filterValues(static_cast<const int64_t*>(values) + batch.first, batch.span, compare,
+                    static_cast<int64_t>(std::get<std::time_t>(predicate.value)), mask);
+                break;
+            case DataType::FLOAT:
+                filterValues(static_cast<const float*>(values) + batch.first, batch.span, compare,
+                    std::get<float>(predicate.value), mask);
+                break;
+            case DataType::BOOL:
+                filterBits(static_cast<const uint64_t*>(values) + batch.first / 64, batch.span, compare,
+                    std::get<bool>(predicate.value), mask);
+                break;
+            case DataType::STRING:
+            case DataType::BLOB:
+                for (size_t word = 0; word < words; ++word) {
+                    for (uint64_t bits = mask[word]; bits != 0; bits &= bits - 1) {
+                        unsigned bit = lowestBit(bits);
+                        if (!satisfies(predicate, data, batch.first + word * 64 + bit)) {
+                            mask[word] &= ~(uint64_t(1) << bit);
+                        }
+                    }
+                }
+                break;
+            }
+        }
+
+        batch.rows.resize(batch.span);
+        batch.rows.resize(maskToSelection(mask, batch.span, batch.first, batch.rows.data()));
+    }
+};
+
+// The first count input rows
+class Limit : public RowOperator {
+public:
+    Limit(std::unique_ptr<RowOperator> input, size_t count) : input(std::move(input)), remaining(count), count(count) {}
+
+    bool next(RowBatch& batch) override {
+        if (remaining == 0 || !input->next(batch)) {
+            return false;
+        }
+        if (batch.rows.size() > remaining) {
+            batch.rows.resize(remaining);
+        }
+        remaining -= batch.rows.size();
+        return true;
+    }
+
+    std::string describe() const override {
+        return "Limit(" + std::to_string(count) + ") <- " + input->describe();
+    }
+
+private:
+    std::unique_ptr<RowOperator> input;
+    size_t remaining;
+    size_t count;
+};
+
+// Projection class
+// The end of a pipeline: the values of the selected columns of each row it pulls
+class Projection {
+public:
+    Projection(std::unique_ptr<RowOperator> input, const Table& table, std::vector<size_t> columns)
+        : input(std::move(input)), table(table), columns(std::move(columns)) {}
+
+    // Values of the next row in the order of getColumns, false once there are no more
+    bool next(std::vector<Value>& values) {
+        while (position == batch.rows.size()) {
+            if (!input->next(batch)) {
+                return false;
+            }
+            position = 0;
+        }
+        RowId row = batch.rows[position++];
+        values.clear();
+        for (size_t column : columns) {
+            values.push_back(table.columnData[column].get(row));
+        }
+        return true;
+    }
+
+    const std::vector<size_t>& getColumns() const {
+        return columns;
+    }
+
+    std::string describe() const {
+        return "Project(" + std::to_string(columns.size()) + ") <- " + input->describe();
+    }
+
+private:
+    std::unique_ptr<RowOperator> input;
+    const Table& table;
+    std::vector<size_t> columns;
+    RowBatch batch;
+    size_t position = 0;
+};
+
+// Index answering lookups on a column, the primary key index or a secondary one
+const Index* columnIndex(const Table& table, size_t column) {
+    if (table.columns[column].isPrimaryKey && table.primaryKeyIndex) {
+        return table.primaryKeyIndex.get();
+    }
+    return table.columns[column].index.get();
+}
+
+// Pick an index to find the rows of a query with. An equality on an indexed column is one
+// lookup, bounds on a column with an ordered index walk that part of the index. The primary
+// key is preferred over secondary indexes. nullptr when no index helps and the table has to
+// be scanned. The predicates are all checked again above the access path, so the index only
+// has to narrow the rows down.
+std::unique_ptr<RowOperator> planIndexAccess(const Table& table, const std::vector<Predicate>& predicates) {
+    // Primary key columns first, then the others in column order
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < table.columns.size(); ++i) {
+        if (columnIndex(table, i) && table.columns[i].isPrimaryKey) {
+            candidates.push_back(i);
+        }
+    }
+    for (size_t i = 0; i < table.columns.size(); ++i) {
+        if (columnIndex(table, i) && !table.columns[i].isPrimaryKey) {
+            candidates.push_back(i);
+        }
+    }
+
+    for (size_t column : candidates) {
+        for (const Predicate& predicate : predicates) {
+            if (predicate.column == column && predicate.op == CompareOp::EQUAL) {
+                return std::make_unique<IndexLookup>(*columnIndex(table, column), predicate.value, table.columns[column].name);
+            }
+        }
+    }
+
+    for (size_t column : candidates) {
+        const Index& index = *columnIndex(table, column);
+        if (!index.isOrdered()) {
+            continue;
+        }
+        // The tightest bounds of the column, strict ones are left to the filter
+        std::optional<Value> low;
+        std::optional<Value> high;
+        for (const Predicate& predicate : predicates) {
+            if (predicate.column != column) {
+                continue;
+            }
+            if ((predicate.op == CompareOp::GREATER || predicate.op == CompareOp::GREATER_EQUAL) && (!low || *low < predicate.value)) {
+                low = predicate.value;
+            }
+            if ((predicate.op == CompareOp::LESS || predicate.op == CompareOp::LESS_EQUAL) && (!high || predicate.value < *high)) {
+                high = predicate.value;
+            }
+        }
+        if (low || high) {
+            return std::make_unique<IndexRangeScan>(index, std::move(low), std::move(high), table.columns[column].name);
+        }
+    }
+    return nullptr;
+}
+
+// How the rows of a query are found: through an index if one helps, else a table scan
+std::unique_ptr<RowOperator> planAccess(const Table& table, const std::vector<Predicate>& predicates) {
+    std::unique_ptr<RowOperator> access = planIndexAccess(table, predicates);
+    if (!access) {
+        access = std::make_unique<TableScan>(table);
+    }
+    return access;
+}
+
+// Resolve a column name, throws if the table has no such column
+size_t resolveColumn(const Table& table, const std::string& name) {
+    int column = table.getColumnIndex(name);
+    if (column < 0) {
+        throw std::runtime_error("Column not found: " + name);
+    }
+    return static_cast<size_t>(column);
+}
+
+// Convert the WHERE conditions of a query to predicates on the table's columns
+std::vector<Predicate> resolvePredicates(const Table& table, const std::vector<Condition>& where) {
+    std::vector<Predicate> predicates;
+    for (const Condition& condition : where) {
+        size_t column = resolveColumn(table, condition.column);
+        predicates.push_back({ column, condition.op, literalValue(condition.value, table.columns[column].type) });
+    }
+    return predicates;
+}
+
+// Build the pipeline of a SELECT: access path, filter, limit and projection.
+// Throws for unknown columns and for values that do not convert to their column type.
+// Aggregating queries are planned by planAggregate (Aggregation.h).
+std::unique_ptr<Projection> planSelect(const Table& table, const SelectStatement& statement) {
+    if (statement.isAggregate()) {
+        throw std::runtime_error("Aggregating query planned as a plain SELECT");
+    }
+    std::vector<Predicate> predicates = resolvePredicates(table, statement.where);
+    std::vector<size_t> columns;
+    for (const SelectItem& item : statement.items) {
+        columns.push_back(resolveColumn(table, item.column));
+    }
+    if (statement.items.empty()) {
+        for (size_t i = 0; i < table.columns.size(); ++i) {
+            columns.push_back(i);
+        }
+    }
+
+    std::unique_ptr<RowOperator> rows = planAccess(table, predicates);
+    if (!predicates.empty()) {
+        rows = std::make_unique<Filter>(std::move(rows), table, std::move(predicates));
+    }
+    if (statement.limit) {
+        rows = std::make_unique<Limit>(std::move(rows), *statement.limit);
+    }
+    return std::make_unique<Projection>(std::move(rows), table, std::move(columns));
+}
+
+// Write a value as query results show it
+void printValue(std::ostream& out, const Value& value) {
+    if (const auto* number = std::get_if<int>(&value)) {
+        out << *number;
+    }
+    else if (const auto* text = std::get_if<std::string>(&value)) {
+        out << *text;
+    }
+    else if (const auto* flag = std::get_if<bool>(&value)) {
+        out << (*flag ? "true" : "false");
+    }
+    else if (const auto* timestamp = std::get_if<std::time_t>(&value)) {
+        std::tm tm;
+#ifdef _WIN32
+        localtime_s(&tm, timestamp);
+#else
+        localtime_r(timestamp, &tm);
+#endif
+        out << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
+    }
+    else if (const auto* real = std::get_if<float>(&value)) {
+        out << *real;
+    }
+    else if (const auto* blob = std::get_if<std::vector<uint8_t>>(&value)) {
+        static const char digits[] = "0123456789abcdef";
+        out << "0x";
+        for (uint8_t byte : *blob) {
+            out << digits[byte >> 4] << digits[byte & 15];
+        }
+    }
+}
@@ -1,12 +1,55 @@
 // Query_Parser.h
 #pragma once
+#include "Aggregation.h"
 #include "Database.h"
+#include "PreparedStatement.h"
+#include "QueryEngine.h"
+#include "StatementParser.h"
+#include "WriteAheadLog.h"
 #include <string>
-#include <regex>
-#include <sstream>
+#include <string_view>
 #include <iostream> // Include for debugging
-#include <sstream>
 
+// Kind of statement recorded in the write-ahead log
+enum class LogRecordType : uint8_t {
+    CREATE_DATABASE,
+    ADD_TABLE,
+    INSERT,
+    UPDATE,
+    REMOVE,
+    CREATE_INDEX,
+    DROP_INDEX,
+    COPY,     // COPY FROM statement, only in logs of older versions: replay reads the file again
+    COPY_ROWS // Part of the rows a COPY FROM loaded, see QueryParser::logCopiedRows
+};
+
+// Log record type of a statement that changes the database, nullopt for the others.
+// EXECUTE logs the prepared statement it runs instead of itself.
+std::optional<LogRecordType> logRecordType(const Statement& statement) {
+    if (std::holds_alternative<CreateDatabaseStatement>(statement)) {
+        return LogRecordType::CREATE_DATABASE;
+    }
+    if (std::holds_alternative<AddTableStatement>(statement)) {
+        return LogRecordType::ADD_TABLE;
+    }
+    if (std::holds_alternative<InsertStatement>(statement)) {
+        return LogRecordType::INSERT;
+    }
+    if (std::holds_alternative<UpdateStatement>(statement)) {
+        return LogRecordType::UPDATE;
+    }
+    if (std::holds_alternative<RemoveStatement>(statement)) {
+        return LogRecordType::REMOVE;
+    }
+    if (std::holds_alternative<CreateIndexStatement>(statement)) {
+        return LogRecordType::CREATE_INDEX;
+    }
+    if (std::holds_alternative<DropIndexStatement>(statement)) {
+        return LogRecordType::DROP_INDEX;
+    }
+    // COPY FROM logs the rows it loaded instead (see QueryParser::logCopiedRows), COPY TO changes nothing
+    return std::nullopt;
+}
 
 class QueryParser {
 public:
@@ -14,47 +57,105 @@ public:
 
     bool executeCommand(const std::string& command);
 
+    // Parse a single statement once for repeated runs, each ? in it stands for a parameter.
+    // Plans are cached by normalized text, preparing the same statement again returns the
+    // cached plan. Throws SyntaxError.
+    std::shared_ptr<PreparedStatement> prepare(const std::string& statement);
+
+    // Run a prepared statement with one value per parameter, in order. An INSERT takes values
+    // typed as its columns and skips parsing and converting them.
+    bool executePrepared(PreparedStatement& prepared, const std::vector<Value>& parameters);
+
+    // Record every statement that changes the database in log, nullptr stops logging
+    void setWriteAheadLog(WriteAheadLog* log) {
+        wal = log;
+    }
+
+    // Worker threads COPY parses files with, 0 for one per hardware thread
+    void setJobs(size_t count) {
+        jobs = count;
+    }
+
+    // Redo a statement read back from the write-ahead log
+    void replayLogRecord(uint64_t lsn, const std::string& record);
+
 private:
     DatabaseManager& dbManager;
-
-    bool parseCreateDatabase(const std::string& command);
-    bool parseUseDatabase(const std::string& command);
-    bool parseAddTable(const std::string& command);
-    bool parseInsertInto(const std::string& command);
-    bool parseRemoveRow(const std::string& command);
-    bool parseUpdateRow(const std::string& command);
+    WriteAheadLog* wal = nullptr;
+    uint64_t pendingLsn = 0; // Last record appended by the current call to executeCommand
+    size_t jobs = 0;
+    std::vector<ColumnVector> copiedRows; // Replay: parts of a COPY whose last part is not read yet
+
+    PlanCache planCache;
+    std::map<std::string, std::shared_ptr<PreparedStatement>> namedStatements; // PREPARE name
+
+    // Commit the statements of a command to the log and apply the memory budget
+    void finishCommand();
+
+    // Run a prepared statement and log it with its parameters filled in
+    bool runPrepared(PreparedStatement& prepared, const std::vector<Value>& parameters);
+
+    // Resolve the table, columns and constants of a prepared INSERT for the current database
+    void bindInsert(PreparedStatement& prepared);
+
+    // Run one parsed statement and log it if it changed the database, text is its source
+    bool executeStatement(const Statement& statement, std::string_view text);
+
+    // Append a successful statement to the log, returns succeeded
+    bool logged(LogRecordType type, std::string_view statement, bool succeeded);
+
+    // Type and database every log record starts with
+    std::string logRecordHeader(LogRecordType type) const;
+
+    // Log the rows COPY FROM appended to a table, so replay does not depend on the file
+    void logCopiedRows(const std::string& tableName, const std::vector<ColumnVector>& rows);
+
+    // Redo one part of the rows of a COPY, the rows are appended once its last part is read
+    void redoCopiedRows(std::string_view body);
+
+    bool execute(const CreateDatabaseStatement& statement);
+    bool execute(const UseDatabaseStatement& statement);
+    bool execute(const AddTableStatement& statement);
+    bool execute(const InsertStatement& statement);
+    bool execute(const RemoveStatement& statement);
+    bool execute(const UpdateStatement& statement);
+    bool execute(const CreateIndexStatement& statement);
+    bool execute(const DropIndexStatement& statement);
+    bool execute(const PrepareStatement& statement);
+    bool execute(const ExecuteStatement& statement);
+    bool execute(const DeallocateStatement& statement);
+    bool execute(const CopyStatement& statement);
+    bool execute(const SelectStatement& statement);
 };
 
+// Statements are parsed and run one at a time, a statement that fails to parse or run
+// does not stop the ones after it
 bool QueryParser::executeCommand(const std::string& command) {
-    std::istringstream commandStream(command);
-    std::string singleCommand;
+    StatementParser statements(command);
+    Statement statement;
+    std::string_view text;
     bool allCommandsSuccessful = true;
 
-    while (std::getline(commandStream, singleCommand, ';')) {
-        std::smatch match;
-        std::string trimmedCommand = std::regex_replace(singleCommand, std::regex("^ +| +$|( ) +"), "$1"); // Trim spaces
-
-
+    while (true) {
         try {
-            if (std::regex_match(trimmedCommand, match, std::regex(R"(CREATE DATABASE (\w+))"))) {
-                allCommandsSuccessful &= parseCreateDatabase(trimmedCommand);
-            }
-            else if (std::regex_match(trimmedCommand, match, std::regex(R"(USE (\w+))"))) {
-                allCommandsSuccessful &= parseUseDatabase(trimmedCommand);
+            if (!statements.next(statement, text)) {
+                break;
             }
-            else if (std::regex_match(trimmedCommand, match, std::regex(R"(ADD TABLE (\w+) \((.*)\))"))) {
-                allCommandsSuccessful &= parseAddTable(trimmedCommand);
-            }
-            else if (std::regex_match(trimmedCommand, match, std::regex(R"(INSERT INTO (\w+) \(([^)]+)\) VALUES \(([^)]+)\))"))) {
-                allCommandsSuccessful &= parseInsertInto(trimmedCommand);
-            }
-            else if (std::regex_match(trimmedCommand, match, std::regex(R"(REMOVE FROM (\w+) WHERE (\w+) = (.+))"))) {
-                allCommandsSuccessful &= parseRemoveRow(trimmedCommand);
-            }
-            else {
-                std::cerr << "Command not recognized: " << trimmedCommand << std::endl; // Debugging
-                allCommandsSuccessful = false;
+        }
+        catch (const SyntaxError& e) {
+            std::cerr << "Syntax error: " << e.what() << std::endl;
+            allCommandsSuccessful = false;
+            statements.skipStatement();
+            continue;
+        }
+
+        try {
+            bool hasParameters = false;
+            forEachLiteral(statement, [&](const Literal& value) { hasParameters |= value.parameter >= 0; });
+            if (hasParameters) {
+                throw std::runtime_error("Parameters (?) are only allowed in prepared statements.");
             }
+            allCommandsSuccessful &= executeStatement(statement, text);
         }
         catch (const std::exception& e) {
             std::cerr << "Error executing command: " << e.what() << std::endl;
@@ -62,126 +163,390 @@ bool QueryParser::executeCommand(const std::string& command) {
         }
     }
 
+    finishCommand();
     return allCommandsSuccessful;
 }
 
+void QueryParser::finishCommand() {
+    // One commit covers every statement of the command, they share a single sync
+    if (wal && pendingLsn != 0) {
+        wal->commit(pendingLsn);
+        pendingLsn = 0;
+    }
 
+    // No statement holds a table any more, stored tables can be dropped from memory
+    dbManager.enforceMemoryBudget();
+}
 
+std::shared_ptr<PreparedStatement> QueryParser::prepare(const std::string& statement) {
+    std::string normalized = normalizeStatement(statement);
+    if (std::shared_ptr<PreparedStatement> cached = planCache.find(normalized)) {
+        return cached;
+    }
 
-bool QueryParser::parseCreateDatabase(const std::string& command) {
-    std::smatch match;
-    std::regex_match(command, match, std::regex(R"(CREATE DATABASE (\w+))"));
-    std::string dbName = match[1];
-  
-    dbManager.createDatabase(dbName);
+    auto prepared = std::make_shared<PreparedStatement>();
+    StatementParser parser(normalized);
+    std::string_view text;
+    if (!parser.next(prepared->statement, text)) {
+        throw SyntaxError("Expected a statement to prepare", 0);
+    }
+    size_t start = static_cast<size_t>(text.data() - normalized.data());
+    Statement extra;
+    std::string_view extraText;
+    if (parser.next(extra, extraText)) {
+        throw SyntaxError("Only one statement can be prepared", static_cast<size_t>(extraText.data() - normalized.data()));
+    }
+    if (std::holds_alternative<PrepareStatement>(prepared->statement) || std::holds_alternative<ExecuteStatement>(prepared->statement) ||
+        std::holds_alternative<DeallocateStatement>(prepared->statement)) {
+        throw SyntaxError("PREPARE, EXECUTE and DEALLOCATE cannot be prepared", start);
+    }
+
+    prepared->text = std::string(text);
+    forEachLiteral(prepared->statement, [&](const Literal& value) {
+        if (value.parameter >= 0) {
+            prepared->parameterPositions.push_back(value.position - start);
+        }
+    });
+    planCache.insert(normalized, prepared);
+    return prepared;
+}
+
+bool QueryParser::executePrepared(PreparedStatement& prepared, const std::vector<Value>& parameters) {
+    bool succeeded = false;
+    try {
+        succeeded = runPrepared(prepared, parameters);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error executing command: " << e.what() << std::endl;
+    }
+    finishCommand();
+    return succeeded;
+}
+
+bool QueryParser::runPrepared(PreparedStatement& prepared, const std::vector<Value>& parameters) {
+    if (parameters.size() != prepared.parameterCount()) {
+        throw std::runtime_error("Prepared statement takes " + std::to_string(prepared.parameterCount()) + " parameters, " +
+                                 std::to_string(parameters.size()) + " given.");
+    }
+
+    bool succeeded = false;
+    if (std::holds_alternative<InsertStatement>(prepared.statement)) {
+        bindInsert(prepared);
+        std::vector<Value> values = prepared.rowTemplate;
+        for (size_t i = 0; i < parameters.size(); ++i) {
+            if (!matchesType(parameters[i], prepared.parameterTypes[i])) {
+                throw std::runtime_error("Parameter " + std::to_string(i + 1) + " does not match the type of its column.");
+            }
+            values[prepared.parameterColumns[i]] = parameters[i];
+        }
+        try {
+            prepared.table->insertValues(values, prepared.foreignKeys);
+            succeeded = true;
+        }
+        catch (const std::runtime_error& e) {
+            std::cout << "Error inserting row: " << e.what() << std::endl;
+        }
+    }
+    else if (parameters.empty()) {
+        succeeded = std::visit([this](const auto& parsed) { return execute(parsed); }, prepared.statement);
+    }
+    else {
+        // Other statements take their parameters as literals, converted when the statement runs
+        Statement bound = prepared.statement;
+        forEachLiteral(bound, [&](Literal& value) {
+            if (value.parameter >= 0) {
+                const Value& parameter = parameters[value.parameter];
+                value.quoted = std::holds_alternative<std::string>(parameter) || std::holds_alternative<std::vector<uint8_t>>(parameter);
+                if (const auto* text = std::get_if<std::string>(&parameter)) {
+                    value.text = *text;
+                }
+                else if (const auto* blob = std::get_if<std::vector<uint8_t>>(&parameter)) {
+                    value.text.assign(blob->begin(), blob->end());
+                }
+                else {
+                    value.text = literalText(parameter);
+                }
+                value.parameter = -1;
+            }
+        });
+        succeeded = std::visit([this](const auto& parsed) { return execute(parsed); }, bound);
+    }
+
+    // The log records the statement written out with its values, replay parses it as usual
+    std::optional<LogRecordType> type = logRecordType(prepared.statement);
+    if (!wal || !succeeded || !type) {
+        return succeeded;
+    }
+    return logged(*type, prepared.boundText(parameters), succeeded);
+}
+
+void QueryParser::bindInsert(PreparedStatement& prepared) {
+    Database* db = dbManager.getCurrentDatabase();
+    if (!db) {
+        throw std::runtime_error("No database selected");
+    }
+    if (prepared.boundDatabase == db && prepared.boundVersion == db->schemaVersion.get()) {
+        return;
+    }
+
+    const InsertStatement& insert = std::get<InsertStatement>(prepared.statement);
+    Table* table = db->getTable(insert.tableName);
+    if (!table) {
+        throw std::runtime_error("Table not found: " + insert.tableName);
+    }
+    std::vector<size_t> columns;
+    for (const auto& name : insert.columns) {
+        int column = table->getColumnIndex(name);
+        if (column < 0) {
+            throw std::runtime_error("Column not found: " + name);
+        }
+        columns.push_back(static_cast<size_t>(column));
+    }
+    size_t width = table->columns.size();
+    std::vector<Value> rowTemplate;
+    rowTemplate.reserve(insert.rowCount() * width);
+    for (size_t row = 0; row < insert.rowCount(); ++row) {
+        for (const auto& column : table->columns) {
+            rowTemplate.push_back(defaultValue(column.type));
+        }
+    }
+    std::vector<size_t> parameterColumns;
+    std::vector<DataType> parameterTypes;
+    for (size_t i = 0; i < insert.values.size(); ++i) {
+        size_t column = columns[i % columns.size()];
+        size_t slot = (i / columns.size()) * width + column;
+        DataType type = table->columns[column].type;
+        if (insert.values[i].parameter >= 0) {
+            parameterColumns.push_back(slot);
+            parameterTypes.push_back(type);
+        }
+        else {
+            rowTemplate[slot] = literalValue(insert.values[i], type);
+        }
+    }
+    std::vector<ForeignKeyTarget> foreignKeys = table->resolveForeignKeys(dbManager);
+
+    // Loading a referenced table above keeps pointers valid, the stamp is read after it
+    prepared.table = table;
+    prepared.rowTemplate = std::move(rowTemplate);
+    prepared.parameterColumns = std::move(parameterColumns);
+    prepared.parameterTypes = std::move(parameterTypes);
+    prepared.foreignKeys = std::move(foreignKeys);
+    prepared.boundDatabase = db;
+    prepared.boundVersion = db->schemaVersion.get();
+}
+
+bool QueryParser::executeStatement(const Statement& statement, std::string_view text) {
+    bool succeeded = std::visit([this](const auto& parsed) { return execute(parsed); }, statement);
+    std::optional<LogRecordType> type = logRecordType(statement);
+    return type ? logged(*type, text, succeeded) : succeeded;
+}
+
+// Records are the statement type, the database it ran in and the statement text:
+//   uint8 type | uint32 database name size | database name | statement
+bool QueryParser::logged(LogRecordType type, std::string_view statement, bool succeeded) {
+    if (!wal || !succeeded) {
+        return succeeded;
+    }
+    std::string record = logRecordHeader(type);
+    record.append(statement);
+    pendingLsn = wal->append(record);
     return true;
 }
 
-bool QueryParser::parseUseDatabase(const std::string& command) {
-    std::smatch match;
-    std::regex_match(command, match, std::regex(R"(USE (\w+))"));
-    std::string dbName = match[1];
+std::string QueryParser::logRecordHeader(LogRecordType type) const {
+    // CREATE DATABASE does not depend on the selected database
+    std::string database = type == LogRecordType::CREATE_DATABASE ? std::string() : dbManager.currentDatabaseName;
+    uint32_t databaseSize = static_cast<uint32_t>(database.size());
+    std::string header;
+    header.push_back(static_cast<char>(type));
+    header.append(reinterpret_cast<const char*>(&databaseSize), sizeof(databaseSize));
+    header.append(database);
+    return header;
+}
+
+// A COPY is logged as COPY_ROWS records of about COPY_LOG_PART_BYTES each, appended back to back:
+//   header | uint32 table name size | table name | uint8 part flags | rows in the binary COPY format
+// Replay appends the rows only with the last part, so a log cut off inside a COPY redoes none of it.
+enum : uint8_t { COPY_FIRST_PART = 1, COPY_LAST_PART = 2 };
+
+void QueryParser::logCopiedRows(const std::string& tableName, const std::vector<ColumnVector>& rows) {
+    constexpr size_t COPY_LOG_PART_BYTES = size_t(16) << 20;
+    size_t count = rows.empty() ? 0 : rows[0].size();
+    if (!wal || count == 0) {
+        return;
+    }
+    std::vector<const ColumnVector*> columns;
+    for (const auto& data : rows) {
+        columns.push_back(&data);
+    }
+    uint32_t tableNameSize = static_cast<uint32_t>(tableName.size());
+
+    std::vector<std::string> parts;
+    std::vector<RowId> partRows;
+    size_t partBytes = 0;
+    for (RowId row = 0; row < count; ++row) {
+        partRows.push_back(row);
+        for (const auto& data : rows) {
+            bool bytes = data.getType() == DataType::STRING || data.getType() == DataType::BLOB;
+            partBytes += bytes ? 4 + data.getBytes(row).size() : 8;
+        }
+        if (partBytes < COPY_LOG_PART_BYTES && row + 1 < count) {
+            continue;
+        }
+        std::ostringstream part;
+        part << logRecordHeader(LogRecordType::COPY_ROWS);
+        part.write(reinterpret_cast<const char*>(&tableNameSize), sizeof(tableNameSize));
+        part << tableName;
+        part.put(static_cast<char>((parts.empty() ? COPY_FIRST_PART : 0) | (row + 1 == count ? COPY_LAST_PART : 0)));
+        writeBinaryCopy(part, columns, partRows);
+        parts.push_back(part.str());
+        partRows.clear();
+        partBytes = 0;
+    }
+    pendingLsn = wal->append(parts);
+}
+
+void QueryParser::redoCopiedRows(std::string_view body) {
+    uint32_t tableNameSize;
+    if (body.size() < sizeof(tableNameSize)) {
+        throw std::runtime_error("Malformed log record.");
+    }
+    std::memcpy(&tableNameSize, body.data(), sizeof(tableNameSize));
+    if (body.size() < sizeof(tableNameSize) + tableNameSize + 1) {
+        throw std::runtime_error("Malformed log record.");
+    }
+    std::string tableName(body.substr(sizeof(tableNameSize), tableNameSize));
+    uint8_t flags = static_cast<uint8_t>(body[sizeof(tableNameSize) + tableNameSize]);
+    std::string_view data = body.substr(sizeof(tableNameSize) + tableNameSize + 1);
 
-    return dbManager.selectDatabase(dbName);
+    Table* table = dbManager.getCurrentDatabase()->getTable(tableName);
+    if (!table) {
+        throw std::runtime_error("Log record for unknown table: " + tableName);
+    }
+    CopyOptions options;
+    options.format = CopyFormat::BINARY;
+    options.jobs = jobs;
+    std::vector<ColumnVector> part = parseCopyData(reinterpret_cast<const uint8_t*>(data.data()), data.size(), table->columns, options);
+    // Parts of a COPY the log lost the end of are dropped when the next COPY starts
+    if (flags & COPY_FIRST_PART) {
+        copiedRows = std::move(part);
+    }
+    else if (copiedRows.size() != part.size()) {
+        throw std::runtime_error("Log record continues a COPY that did not start.");
+    }
+    else {
+        for (size_t c = 0; c < part.size(); ++c) {
+            copiedRows[c].appendColumn(part[c]);
+        }
+    }
+    if (flags & COPY_LAST_PART) {
+        std::vector<ColumnVector> batch = std::move(copiedRows);
+        copiedRows.clear();
+        table->bulkAppend(batch, table->resolveForeignKeys(dbManager));
+    }
 }
 
+// Records a checkpoint already holds are passed over, so replaying a log that was not reset
+// after its changes were saved leaves the databases as they were. A record that cannot be
+// redone throws, startup must not go on and save the databases without its change.
+void QueryParser::replayLogRecord(uint64_t lsn, const std::string& record) {
+    uint32_t databaseSize;
+    if (record.size() < 1 + sizeof(databaseSize)) {
+        throw std::runtime_error("Malformed log record.");
+    }
+    std::memcpy(&databaseSize, record.data() + 1, sizeof(databaseSize));
+    size_t statementStart = 1 + sizeof(databaseSize) + databaseSize;
+    if (record.size() < statementStart) {
+        throw std::runtime_error("Malformed log record.");
+    }
 
-bool QueryParser::parseAddTable(const std::string& command) {
-    std::smatch match;
-    // Regex to match the ADD TABLE command and capture table name and columns
-    std::regex addTableRegex(R"(ADD TABLE (\w+) \((.*)\))");
+    std::string database = record.substr(1 + sizeof(databaseSize), databaseSize);
+    if (database.empty()) {
+        if (lsn <= dbManager.appliedLsn) {
+            return;
+        }
+    }
+    else if (!dbManager.selectDatabase(database)) {
+        throw std::runtime_error("Log record " + std::to_string(lsn) + " is for unknown database " + database + ".");
+    }
+    else if (lsn <= dbManager.getCurrentDatabase()->appliedLsn) {
+        return;
+    }
 
-    // Match the command against the regex
-    if (!std::regex_match(command, match, addTableRegex)) {
-        std::cerr << "Failed to parse ADD TABLE command: " << command << std::endl;
-        return false;
+    if (static_cast<LogRecordType>(record[0]) == LogRecordType::COPY_ROWS) {
+        redoCopiedRows(std::string_view(record).substr(statementStart));
+        return;
     }
 
-    // Extract table name and column definitions
-    std::string tableName = match[1].str();
-    std::string columnsStr = match[2].str();
+    // Replayed statements are already in the log
+    WriteAheadLog* log = wal;
+    wal = nullptr;
+    bool redone = executeCommand(record.substr(statementStart));
+    wal = log;
+    if (!redone) {
+        throw std::runtime_error("Failed to redo log record " + std::to_string(lsn) + ": " + record.substr(statementStart));
+    }
+}
 
 
-    Table table(tableName);
-    std::istringstream columnsStream(columnsStr);
-    std::string columnDef;
 
-    // Process each column definition
-    while (std::getline(columnsStream, columnDef, ',')) {
-        columnDef = std::regex_replace(columnDef, std::regex("^ +| +$|( ) +"), "$1"); // Trim spaces
 
-        std::smatch columnMatch;
-        // Regex to handle column definitions with possible attributes
-        std::regex columnRegex(R"((\w+)\s+(\w+)(.*))");
+bool QueryParser::execute(const CreateDatabaseStatement& statement) {
+    dbManager.createDatabase(statement.databaseName);
+    return true;
+}
 
-        // Match the column definition to extract column name, type, and attributes
-        if (std::regex_match(columnDef, columnMatch, columnRegex)) {
-            std::string columnName = columnMatch[1].str();
-            std::string columnTypeStr = columnMatch[2].str();
-            std::string attributes = columnMatch[3].str();
+bool QueryParser::execute(const UseDatabaseStatement& statement) {
+    return dbManager.selectDatabase(statement.databaseName);
+}
 
-          
-            // Identify the column type
-            DataType columnType;
-            if (columnTypeStr == "INT") {
-                columnType = DataType::INT;
-            }
-            else if (columnTypeStr == "STRING") {
-                columnType = DataType::STRING;
-            }
-            else if (columnTypeStr == "BOOL") {
-                columnType = DataType::BOOL;
-            }
-            else if (columnTypeStr == "TIMESTAMP") {
-                columnType = DataType::TIMESTAMP;
-            }
-            else if (columnTypeStr == "FLOAT") {
-                columnType = DataType::FLOAT;
-            }
-            else if (columnTypeStr == "BLOB") {
-                columnType = DataType::BLOB;
-            }
-            else {
-                std::cerr << "Unknown column type: " << columnTypeStr << std::endl;
-                return false;
-            }
 
-            Column column(columnName, columnType);
+bool QueryParser::execute(const AddTableStatement& statement) {
+    if (!dbManager.getCurrentDatabase()) {
+        std::cout << "No database selected" << std::endl; // Debugging
+        return false;
+    }
 
-            // Check for PRIMARY_KEY attribute
-            std::smatch primaryKeyMatch;
-            std::regex primaryKeyRegex(R"(PRIMARY_KEY)");
-            if (std::regex_search(attributes, primaryKeyMatch, primaryKeyRegex)) {
-                column.setPrimaryKey(true);
-                std::cout << "Column " << columnName << " is a primary key." << std::endl;
+    Table table(statement.tableName);
+    for (const ColumnDefinition& definition : statement.columns) {
+        Column column(definition.name, definition.type);
 
-                // Initialize BTree for the primary key (assuming only one primary key)
-                table.setPrimaryKeyBTree(new BTree<std::variant<int, std::string, bool, time_t, float, std::vector<uint8_t>>>(3));
+        // Maximum children per index node
+        if (definition.fanout != 0) {
+            if (definition.fanout < 4) {
+                std::cerr << "FANOUT must be at least 4: " << definition.name << std::endl;
+                return false;
             }
+            column.setIndexFanout(definition.fanout);
+        }
 
-            // Check for REFERENCES attribute (foreign key)
-            std::smatch referenceMatch;
-            std::regex referenceRegex(R"(REFERENCES\s+(\w+)\((\w+)\))");
-            if (std::regex_search(attributes, referenceMatch, referenceRegex)) {
-                std::string referencedTable = referenceMatch[1].str();
-                std::string referencedColumn = referenceMatch[2].str();
-                column.setForeignKey(referencedTable, referencedColumn);
-                std::cout << "Column " << columnName << " references "
-                    << referencedTable << "(" << referencedColumn << ")." << std::endl;
-            }
+        // Structure of the primary key index
+        if (definition.indexKind) {
+            column.setIndexKind(*definition.indexKind);
+        }
+
+        if (definition.primaryKey) {
+            column.setPrimaryKey(true);
+            std::cout << "Column " << definition.name << " is a primary key." << std::endl;
 
-            table.addColumn(column); // Add column to the table
+            // Initialize an index keyed on the column type (assuming only one primary key)
+            table.setPrimaryKeyIndex(makeIndex(definition.type, column.indexKind, column.getIndexDegree()));
         }
-        else {
-            std::cerr << "Failed to parse column definition: " << columnDef << std::endl;
-            return false;
+
+        if (!definition.referencedTable.empty()) {
+            column.setForeignKey(definition.referencedTable, definition.referencedColumn);
+            std::cout << "Column " << definition.name << " references "
+                << definition.referencedTable << "(" << definition.referencedColumn << ")." << std::endl;
         }
+
+        table.addColumn(column); // Add column to the table
     }
 
     // Attempt to add the table to the database
     try {
         dbManager.getCurrentDatabase()->addTable(table);
-        std::cout << "Table " << tableName << " successfully added to the database." << std::endl;
+        std::cout << "Table " << statement.tableName << " successfully added to the database." << std::endl;
     }
     catch (const std::exception& e) {
         std::cerr << "Error adding table: " << e.what() << std::endl;
@@ -191,82 +556,74 @@ bool QueryParser::parseAddTable(const std::string& command) {
     return true;
 }
 
-bool QueryParser::parseInsertInto(const std::string& command) {
+bool QueryParser::execute(const InsertStatement& statement) {
     if (!dbManager.getCurrentDatabase()) {
         std::cout << "No database selected" << std::endl; // Debugging
         return false;
     }
 
-    std::smatch match;
-    std::regex_match(command, match, std::regex(R"(INSERT INTO (\w+) \(([^)]+)\) VALUES \(([^)]+)\))"));
-    std::string tableName = match[1];
-    std::string columnNames = match[2];
-    std::string values = match[3];
-    std::cout << "Inserting into table: " << tableName << " columns: " << columnNames << " values: " << values << std::endl; // Debugging
+    std::cout << "Inserting into table: " << statement.tableName << " columns: "; // Debugging
+    for (size_t i = 0; i < statement.columns.size(); ++i) {
+        std::cout << (i > 0 ? ", " : "") << statement.columns[i];
+    }
+    size_t rowCount = statement.rowCount();
+    if (rowCount == 1) {
+        std::cout << " values: ";
+        for (size_t i = 0; i < statement.values.size(); ++i) {
+            std::cout << (i > 0 ? ", " : "") << statement.values[i].text;
+        }
+    }
+    else {
+        std::cout << " rows: " << rowCount;
+    }
+    std::cout << std::endl;
 
-    Table* table = dbManager.getCurrentDatabase()->getTable(tableName);
+    Table* table = dbManager.getCurrentDatabase()->getTable(statement.tableName);
     if (!table) {
-        std::cout << "Table not found: " << tableName << std::endl; // Debugging
+        std::cout << "Table not found: " << statement.tableName << std::endl; // Debugging
         return false;
     }
 
-    Row row;
-    std::istringstream colStream(columnNames);
-    std::istringstream valStream(values);
-    std::string colName, value;
-
-    while (std::getline(colStream, colName, ',') && std::getline(valStream, value, ',')) {
-        colName.erase(0, colName.find_first_not_of(" \t")); // Trim leading spaces
-        colName.erase(colName.find_last_not_of(" \t") + 1); // Trim trailing spaces
-        value.erase(0, value.find_first_not_of(" \t")); // Trim leading spaces
-        value.erase(value.find_last_not_of(" \t") + 1); // Trim trailing spaces
-
-        auto* column = table->getColumn(colName);
-        if (!column) {
-            std::cout << "Column not found: " << colName << std::endl;
+    // Map the listed columns once for every row, a column listed twice takes the later value
+    std::vector<int> sources(table->columns.size(), -1);
+    for (size_t i = 0; i < statement.columns.size(); ++i) {
+        int column = table->getColumnIndex(statement.columns[i]);
+        if (column < 0) {
+            std::cout << "Column not found: " << statement.columns[i] << std::endl;
             return false;
         }
-
-        std::variant<int, std::string, bool, time_t, float, std::vector<uint8_t>> key;
-
-        if (column->type == DataType::INT) {
-            int intValue = std::stoi(value);
-            row.addData(colName, intValue);
-            key = intValue;
-        }
-        else if (column->type == DataType::STRING) {
-            row.addData(colName, value);
-            key = value;
-        }
-        else if (column->type == DataType::BOOL) {
-            bool boolValue = (value == "true");
-            row.addData(colName, boolValue);
-            key = boolValue;
-        }
-        else if (column->type == DataType::TIMESTAMP) {
-            time_t timestamp = std::stoll(value);
-            row.addData(colName, timestamp);
-            key = timestamp;
-        }
-        else if (column->type == DataType::FLOAT) {
-            float floatValue = std::stof(value);
-            row.addData(colName, floatValue);
-            key = floatValue;
-        }
-        else if (column->type == DataType::BLOB) {
-            std::vector<uint8_t> blob(value.begin(), value.end());
-            row.addData(colName, blob);
-            key = blob;
+        sources[column] = static_cast<int>(i);
+    }
+
+    // Values are converted a column at a time, unlisted columns get their default
+    size_t width = statement.columns.size();
+    std::vector<std::vector<Value>> columnValues(table->columns.size());
+    for (size_t column = 0; column < table->columns.size(); ++column) {
+        DataType type = table->columns[column].type;
+        std::vector<Value>& values = columnValues[column];
+        values.reserve(rowCount);
+        if (sources[column] < 0) {
+            values.assign(rowCount, defaultValue(type));
+            continue;
         }
-
-        
-        if (column->isPrimaryKey) {
-            table->getPrimaryKeyBTree()->insert(key);
+        for (size_t row = 0; row < rowCount; ++row) {
+            values.push_back(literalValue(statement.values[row * width + sources[column]], type));
         }
     }
 
     try {
-        table->addRow(row, dbManager);
+        std::vector<ForeignKeyTarget> foreignKeys = table->resolveForeignKeys(dbManager);
+        if (rowCount == 1) {
+            std::vector<Value> row;
+            row.reserve(columnValues.size());
+            for (auto& values : columnValues) {
+                row.push_back(std::move(values[0]));
+            }
+            table->insertValues(row, foreignKeys);
+        }
+        else {
+            table->insertColumns(columnValues, foreignKeys);
+        }
     }
     catch (const std::runtime_error& e) {
         std::cout << "Error inserting row: " << e.what() << std::endl;
@@ -277,24 +634,15 @@ bool QueryParser::parseInsertInto(const std::string& command) {
 }
 
 //using Table::deleteRow
-bool QueryParser::parseRemoveRow(const std::string& command) {
+bool QueryParser::execute(const RemoveStatement& statement) {
     if (!dbManager.getCurrentDatabase()) {
         std::cout << "No database selected" << std::endl; // Debugging
         return false;
     }
 
-    std::smatch match;
-    std::regex removeRegex(R"(REMOVE FROM (\w+) WHERE (\w+) = (.+))");
-    if (!std::regex_match(command, match, removeRegex)) {
-        std::cerr << "Failed to parse REMOVE command: " << command << std::endl;
-        return false;
-    }
-
-    std::string tableName = match[1];
-    std::string primaryKeyColumn = match[2];
-    std::string value = match[3];
-
-    std::cout << "Removing from table: " << tableName << " where " << primaryKeyColumn << " = " << value << std::endl; // Debugging
+    const std::string& tableName = statement.tableName;
+    const std::string& primaryKeyColumn = statement.where.column;
+    std::cout << "Removing from table: " << tableName << " where " << primaryKeyColumn << " = " << statement.where.value.text << std::endl; // Debugging
 
     Table* table = dbManager.getCurrentDatabase()->getTable(tableName);
     if (!table) {
@@ -315,25 +663,7 @@ bool QueryParser::parseRemoveRow(const std::string& command) {
         return false;
     }
 
-    std::variant<int, std::string, bool, time_t, float, std::vector<uint8_t>> key;
-    if (column->type == DataType::INT) {
-        key = std::stoi(value);
-    }
-    else if (column->type == DataType::STRING) {
-        key = value;
-    }
-    else if (column->type == DataType::BOOL) {
-        key = (value == "true");
-    }
-    else if (column->type == DataType::TIMESTAMP) {
-        key = std::stoll(value);
-    }
-    else if (column->type == DataType::FLOAT) {
-        key = std::stof(value);
-    }
-    else if (column->type == DataType::BLOB) {
-        key = std::vector<uint8_t>(value.begin(), value.end());
-    }
+    Value key = literalValue(statement.where.value, column->type);
 
     try {
         table->deleteRow(key);
@@ -347,103 +677,233 @@ bool QueryParser::parseRemoveRow(const std::string& command) {
 }
 
 //using Table::updateRow
-bool QueryParser::parseUpdateRow(const std::string& command) {
+bool QueryParser::execute(const UpdateStatement& statement) {
     if (!dbManager.getCurrentDatabase()) {
         std::cout << "No database selected" << std::endl; // Debugging
         return false;
     }
 
-    std::smatch match;
-    std::regex updateRegex(R"(UPDATE (\w+) SET (.+) WHERE (\w+) = (.+))");
-    if (!std::regex_match(command, match, updateRegex)) {
-        std::cerr << "Failed to parse UPDATE command: " << command << std::endl;
+    Table* table = dbManager.getCurrentDatabase()->getTable(statement.tableName);
+    if (!table) {
+        std::cerr << "Table not found: " << statement.tableName << std::endl;
+        return false;
+    }
+
+    const Column* column = table->getColumn(statement.where.column);
+    if (!column || !column->isPrimaryKey) {
+        std::cerr << "Primary key column not found: " << statement.where.column << std::endl;
         return false;
     }
 
-    std::string tableName = match[1];
-    std::string setClause = match[2];
-    std::string primaryKeyColumn = match[3];
-    std::string primaryKeyValue = match[4];
+    Value oldPrimaryKey = literalValue(statement.where.value, column->type);
 
-    Table* table = dbManager.getCurrentDatabase()->getTable(tableName);
-    if (!table) {
-        std::cerr << "Table not found: " << tableName << std::endl;
+    Row newRow;
+    for (const Assignment& assignment : statement.assignments) {
+        const Column* col = table->getColumn(assignment.column);
+        if (!col) {
+            std::cerr << "Column not found: " << assignment.column << std::endl;
+            return false;
+        }
+        newRow.addData(assignment.column, literalValue(assignment.value, col->type));
+    }
+
+    try {
+        table->updateRow(oldPrimaryKey, newRow);
+    }
+    catch (const std::runtime_error& e) {
+        std::cerr << "Error updating row: " << e.what() << std::endl;
         return false;
     }
 
-    const Column* column = table->getColumn(primaryKeyColumn);
-    if (!column || !column->isPrimaryKey) {
-        std::cerr << "Primary key column not found: " << primaryKeyColumn << std::endl;
+    return true;
+}
+
+bool QueryParser::execute(const CreateIndexStatement& statement) {
+    Database* db = dbManager.getCurrentDatabase();
+    if (!db) {
+        std::cout << "No database selected" << std::endl; // Debugging
         return false;
     }
 
-    std::variant<int, std::string, bool, time_t, float, std::vector<uint8_t>> oldPrimaryKey;
-    if (column->type == DataType::INT) {
-        oldPrimaryKey = std::stoi(primaryKeyValue);
+    // Secondary indexes are B-trees unless USING names another kind
+    IndexKind kind = statement.indexKind.value_or(IndexKind::BTREE);
+
+    Table* table = db->getTable(statement.tableName);
+    if (!table) {
+        std::cerr << "Table not found: " << statement.tableName << std::endl;
+        return false;
     }
-    else if (column->type == DataType::STRING) {
-        oldPrimaryKey = primaryKeyValue;
+
+    if (db->findIndexOwner(statement.indexName)) {
+        std::cerr << "Index already exists: " << statement.indexName << std::endl;
+        return false;
     }
-    else if (column->type == DataType::BOOL) {
-        oldPrimaryKey = (primaryKeyValue == "true");
+
+    try {
+        table->createIndex(statement.indexName, statement.columnName, kind);
     }
-    else if (column->type == DataType::TIMESTAMP) {
-        oldPrimaryKey = std::stoll(primaryKeyValue);
+    catch (const std::runtime_error& e) {
+        std::cerr << "Error creating index: " << e.what() << std::endl;
+        return false;
     }
-    else if (column->type == DataType::FLOAT) {
-        oldPrimaryKey = std::stof(primaryKeyValue);
+
+    std::cout << "Index " << statement.indexName << " created on " << statement.tableName << "(" << statement.columnName << ")." << std::endl;
+    return true;
+}
+
+bool QueryParser::execute(const DropIndexStatement& statement) {
+    Database* db = dbManager.getCurrentDatabase();
+    if (!db) {
+        std::cout << "No database selected" << std::endl; // Debugging
+        return false;
     }
-    else if (column->type == DataType::BLOB) {
-        oldPrimaryKey = std::vector<uint8_t>(primaryKeyValue.begin(), primaryKeyValue.end());
+
+    Table* table = db->findIndexOwner(statement.indexName);
+    if (!table) {
+        std::cerr << "Index not found: " << statement.indexName << std::endl;
+        return false;
     }
 
-    Row newRow;
-    std::istringstream setStream(setClause);
-    std::string setPart;
-    while (std::getline(setStream, setPart, ',')) {
-        std::smatch setMatch;
-        std::regex setRegex(R"((\w+) = (.+))");
-        if (!std::regex_match(setPart, setMatch, setRegex)) {
-            std::cerr << "Failed to parse SET clause: " << setPart << std::endl;
-            return false;
-        }
+    table->dropIndex(statement.indexName);
+    std::cout << "Index " << statement.indexName << " dropped." << std::endl;
+    return true;
+}
 
-        std::string colName = setMatch[1];
-        std::string value = setMatch[2];
+bool QueryParser::execute(const PrepareStatement& statement) {
+    namedStatements[statement.name] = prepare(statement.body);
+    std::cout << "Statement " << statement.name << " prepared." << std::endl;
+    return true;
+}
 
-        const Column* col = table->getColumn(colName);
-        if (!col) {
-            std::cerr << "Column not found: " << colName << std::endl;
-            return false;
-        }
+bool QueryParser::execute(const ExecuteStatement& statement) {
+    auto named = namedStatements.find(statement.name);
+    if (named == namedStatements.end()) {
+        std::cerr << "Prepared statement not found: " << statement.name << std::endl;
+        return false;
+    }
+    PreparedStatement& prepared = *named->second;
+    if (statement.values.size() != prepared.parameterCount()) {
+        std::cerr << "Prepared statement " << statement.name << " takes " << prepared.parameterCount() << " parameters." << std::endl;
+        return false;
+    }
 
-        if (col->type == DataType::INT) {
-            newRow.addData(colName, std::stoi(value));
-        }
-        else if (col->type == DataType::STRING) {
-            newRow.addData(colName, value);
+    // INSERT parameters are converted to their column types, the others are passed on as text
+    std::vector<Value> parameters;
+    parameters.reserve(statement.values.size());
+    if (std::holds_alternative<InsertStatement>(prepared.statement)) {
+        bindInsert(prepared);
+        for (size_t i = 0; i < statement.values.size(); ++i) {
+            parameters.push_back(literalValue(statement.values[i], prepared.parameterTypes[i]));
         }
-        else if (col->type == DataType::BOOL) {
-            newRow.addData(colName, (value == "true"));
-        }
-        else if (col->type == DataType::TIMESTAMP) {
-            newRow.addData(colName, std::stoll(value));
+    }
+    else {
+        for (const Literal& value : statement.values) {
+            parameters.push_back(value.text);
         }
-        else if (col->type == DataType::FLOAT) {
-            newRow.addData(colName, std::stof(value));
+    }
+    return runPrepared(prepared, parameters);
+}
+
+bool QueryParser::execute(const DeallocateStatement& statement) {
+    if (!namedStatements.erase(statement.name)) {
+        std::cerr << "Prepared statement not found: " << statement.name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool QueryParser::execute(const CopyStatement& statement) {
+    if (!dbManager.getCurrentDatabase()) {
+        std::cout << "No database selected" << std::endl; // Debugging
+        return false;
+    }
+    Table* table = dbManager.getCurrentDatabase()->getTable(statement.tableName);
+    if (!table) {
+        std::cout << "Table not found: " << statement.tableName << std::endl; // Debugging
+        return false;
+    }
+
+    CopyOptions options = statement.options;
+    options.jobs = jobs;
+    std::vector<ColumnVector> imported;
+    try {
+        if (statement.toFile) {
+            size_t rows = exportTable(*table, statement.fileName, options);
+            std::cout << "Copied " << rows << " rows from " << statement.tableName << " to " << statement.fileName << std::endl;
         }
-        else if (col->type == DataType::BLOB) {
-            newRow.addData(colName, std::vector<uint8_t>(value.begin(), value.end()));
+        else {
+            size_t rows = importTable(*table, statement.fileName, options, table->resolveForeignKeys(dbManager), wal ? &imported : nullptr);
+            std::cout << "Copied " << rows << " rows from " << statement.fileName << " into " << statement.tableName << std::endl;
         }
     }
+    catch (const std::runtime_error& e) {
+        std::cerr << "Error copying " << statement.fileName << ": " << e.what() << std::endl;
+        return false;
+    }
+    logCopiedRows(statement.tableName, imported);
+    return true;
+}
+
+bool QueryParser::execute(const SelectStatement& statement) {
+    if (!dbManager.getCurrentDatabase()) {
+        std::cout << "No database selected" << std::endl; // Debugging
+        return false;
+    }
+    const Table* table = dbManager.getCurrentDatabase()->getTable(statement.tableName);
+    if (!table) {
+        std::cout << "Table not found: " << statement.tableName << std::endl; // Debugging
+        return false;
+    }
 
+    std::unique_ptr<Projection> plan;
+    std::unique_ptr<HashAggregate> aggregate;
     try {
-        table->updateRow(oldPrimaryKey, newRow);
+        if (statement.isAggregate()) {
+            aggregate = planAggregate(*table, statement, jobs);
+        }
+        else {
+            plan = planSelect(*table, statement);
+        }
     }
     catch (const std::runtime_error& e) {
-        std::cerr << "Error updating row: " << e.what() << std::endl;
+        std::cerr << "Error selecting from " << statement.tableName << ": " << e.what() << std::endl;
         return false;
     }
+    std::cout << "Plan: " << (aggregate ? aggregate->describe() : plan->describe()) << std::endl; // Debugging
 
+    // Rows are printed as the pipeline produces them
+    size_t rows = 0;
+    if (aggregate) {
+        for (size_t i = 0; i < aggregate->getNames().size(); ++i) {
+            std::cout << (i > 0 ? "\t" : "") << aggregate->getNames()[i];
+        }
+        std::cout << std::endl;
+        std::vector<std::string> cells;
+        while (aggregate->next(cells)) {
+            for (size_t i = 0; i < cells.size(); ++i) {
+                std::cout << (i > 0 ? "\t" : "") << cells[i];
+            }
+            std::cout << '\n';
+            ++rows;
+        }
+    }
+    else {
+        for (size_t i = 0; i < plan->getColumns().size(); ++i) {
+            std::cout << (i > 0 ? "\t" : "") << table->columns[plan->getColumns()[i]].name;
+        }
+        std::cout << std::endl;
+        std::vector<Value> values;
+        while (plan->next(values)) {
+            for (size_t i = 0; i < values.size(); ++i) {
+                if (i > 0) {
+                    std::cout << '\t';
+                }
+                printValue(std::cout, values[i]);
+            }
+            std::cout << '\n';
+            ++rows;
+        }
+    }
+    std::cout << rows << (rows == 1 ? " row" : " rows") << std::endl;
     return true;
 }
@@ -0,0 +1,917 @@
+// StatementParser.h
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+#include "BulkCopy.h"
+#include "DataTypes.h"
+#include "Index.h"
+#include "Lexer.h"
+
+// A value written in a statement. Quoted literals hold their unquoted text, bare values the
+// source text of their tokens. Both are converted once the column type is known.
+// A lone ? is a parameter of a prepared statement, its value is bound when it runs.
+struct Literal {
+    std::string text;
+    bool quoted = false;
+    size_t position = 0; // Byte offset in the command
+    int parameter = -1;  // Index of the parameter, -1 for a value given in the statement
+};
+
+// column = value
+struct Assignment {
+    std::string column;
+    Literal value;
+};
+
+struct ColumnDefinition {
+    std::string name;
+    DataType type = DataType::INT;
+    bool primaryKey = false;
+    int fanout = 0;                     // FANOUT n, 0 if not given
+    std::optional<IndexKind> indexKind; // USING kind
+    std::string referencedTable;        // REFERENCES table(column), empty if not given
+    std::string referencedColumn;
+};
+
+// CREATE DATABASE name
+struct CreateDatabaseStatement {
+    std::string databaseName;
+};
+
+// USE name
+struct UseDatabaseStatement {
+    std::string databaseName;
+};
+
+// ADD TABLE name (column type [attributes], ...)
+struct AddTableStatement {
+    std::string tableName;
+    std::vector<ColumnDefinition> columns;
+};
+
+// INSERT INTO table (column, ...) VALUES (value, ...), ...
+struct InsertStatement {
+    std::string tableName;
+    std::vector<std::string> columns;
+    std::vector<Literal> values; // Row after row, one value per column
+
+    size_t rowCount() const {
+        return columns.empty() ? 0 : values.size() / columns.size();
+    }
+};
+
+// REMOVE FROM table WHERE column = value
+struct RemoveStatement {
+    std::string tableName;
+    Assignment where;
+};
+
+// UPDATE table SET column = value, ... WHERE column = value
+struct UpdateStatement {
+    std::string tableName;
+    std::vector<Assignment> assignments;
+    Assignment where;
+};
+
+// CREATE INDEX name ON table(column) [USING kind]
+struct CreateIndexStatement {
+    std::string indexName;
+    std::string tableName;
+    std::string columnName;
+    std::optional<IndexKind> indexKind;
+};
+
+// DROP INDEX name
+struct DropIndexStatement {
+    std::string indexName;
+};
+
+// PREPARE name AS statement
+struct PrepareStatement {
+    std::string name;
+    std::string body; // Source text of the statement, parsed when it is prepared
+};
+
+// EXECUTE name [(value, ...)], one value per parameter
+struct ExecuteStatement {
+    std::string name;
+    std::vector<Literal> values;
+};
+
+// DEALLOCATE name
+struct DeallocateStatement {
+    std::string name;
+};
+
+// Comparison of a WHERE condition
+enum class CompareOp {
+    EQUAL,        // =
+    NOT_EQUAL,    // != or <>
+    LESS,         // <
+    LESS_EQUAL,   // <=
+    GREATER,      // >
+    GREATER_EQUAL // >=
+};
+
+// column op value
+struct Condition {
+    std::string column;
+    CompareOp op = CompareOp::EQUAL;
+    Literal value;
+};
+
+// Aggregate of a select list item, NONE for a plain column
+enum class AggregateFunction {
+    NONE,
+    COUNT,
+    SUM,
+    MIN,
+    MAX,
+    AVG
+};
+
+// Aggregate function named in a statement (COUNT, SUM, ...), nullopt for unknown names
+std::optional<AggregateFunction> aggregateFromName(const std::string& name) {
+    if (name == "COUNT") {
+        return AggregateFunction::COUNT;
+    }
+    if (name == "SUM") {
+        return AggregateFunction::SUM;
+    }
+    if (name == "MIN") {
+        return AggregateFunction::MIN;
+    }
+    if (name == "MAX") {
+        return AggregateFunction::MAX;
+    }
+    if (name == "AVG") {
+        return AggregateFunction::AVG;
+    }
+    return std::nullopt;
+}
+
+// column or function(column), COUNT(*) has no column
+struct SelectItem {
+    AggregateFunction function = AggregateFunction::NONE;
+    std::string column;
+};
+
+// SELECT * | item, ... FROM table [WHERE condition [AND condition ...]] [GROUP BY column, ...] [LIMIT n]
+struct SelectStatement {
+    std::vector<SelectItem> items;    // Empty for *
+    std::string tableName;
+    std::vector<Condition> where;     // Every condition must hold
+    std::vector<std::string> groupBy;
+    std::optional<size_t> limit;
+
+    // Whether the rows are aggregated into groups rather than returned one by one
+    bool isAggregate() const {
+        if (!groupBy.empty()) {
+            return true;
+        }
+        for (const SelectItem& item : items) {
+            if (item.function != AggregateFunction::NONE) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// COPY table FROM|TO 'file' [(FORMAT CSV|BINARY [, HEADER])]
+struct CopyStatement {
+    std::string tableName;
+    std::string fileName;
+    bool toFile = false; // TO writes the table out, FROM loads the file into it
+    CopyOptions options;
+};
+
+using Statement = std::variant<CreateDatabaseStatement, UseDatabaseStatement, AddTableStatement, InsertStatement,
+                               RemoveStatement, UpdateStatement, CreateIndexStatement, DropIndexStatement,
+                               PrepareStatement, ExecuteStatement, DeallocateStatement, CopyStatement, SelectStatement>;
+
+// Call fn on every value a statement writes to a table, in source order
+template<typename Fn>
+void forEachLiteral(Statement& statement, Fn fn) {
+    if (auto* insert = std::get_if<InsertStatement>(&statement)) {
+        for (Literal& value : insert->values) {
+            fn(value);
+        }
+    }
+    else if (auto* update = std::get_if<UpdateStatement>(&statement)) {
+        for (Assignment& assignment : update->assignments) {
+            fn(assignment.value);
+        }
+        fn(update->where.value);
+    }
+    else if (auto* remove = std::get_if<RemoveStatement>(&statement)) {
+        fn(remove->where.value);
+    }
+    else if (auto* select = std::get_if<SelectStatement>(&statement)) {
+        for (Condition& condition : select->where) {
+            fn(condition.value);
+        }
+    }
+}
+
+// The statement with every run of whitespace between tokens made a single space and none at
+// either end, so statements that differ only in spacing share a prepared plan. Bare values
+// are read the same way (see StatementParser::parseLiteral), the meaning does not change.
+std::string normalizeStatement(std::string_view command) {
+    Lexer lexer(command);
+    std::string normalized;
+    normalized.reserve(command.size());
+    size_t previousEnd = 0;
+    for (Token token = lexer.next(); token.type != TokenType::END; token = lexer.next()) {
+        if (!normalized.empty() && token.position > previousEnd) {
+            normalized.push_back(' ');
+        }
+        normalized.append(token.text);
+        previousEnd = token.end();
+    }
+    return normalized;
+}
+
+// Convert a literal to the value a column of type holds, throws std::runtime_error if it does not fit
+Value literalValue(const Literal& literal, DataType type) {
+    const std::string& text = literal.text;
+    const char* first = text.data();
+    const char* last = text.data() + text.size();
+    switch (type) {
+    case DataType::INT: {
+        int value = 0;
+        auto result = std::from_chars(first, last, value);
+        if (result.ec != std::errc() || result.ptr != last) {
+            throw std::runtime_error("Invalid INT value: " + text);
+        }
+        return value;
+    }
+    case DataType::STRING:
+        return text;
+    case DataType::BOOL:
+        if (text == "true" || text == "TRUE") {
+            return true;
+        }
+        if (text == "false" || text == "FALSE") {
+            return false;
+        }
+        throw std::runtime_error("Invalid BOOL value: " + text);
+    case DataType::TIMESTAMP: {
+        long long value = 0;
+        auto result = std::from_chars(first, last, value);
+        if (result.ec != std::errc() || result.ptr != last) {
+            throw std::runtime_error("Invalid TIMESTAMP value: " + text);
+        }
+        return static_cast<std::time_t>(value);
+    }
+    case DataType::FLOAT: {
+        char* end = nullptr;
+        float value = std::strtof(first, &end);
+        if (text.empty() || end != last) {
+            throw std::runtime_error("Invalid FLOAT value: " + text);
+        }
+        return value;
+    }
+    case DataType::BLOB:
+        return std::vector<uint8_t>(text.begin(), text.end());
+    }
+    return defaultValue(type);
+}
+
+// A value written as a literal that literalValue reads back to the same value
+std::string literalText(const Value& value) {
+    auto quote = [](const char* data, size_t size) {
+        std::string text = "'";
+        for (size_t i = 0; i < size; ++i) {
+            text.push_back(data[i]);
+            if (data[i] == '\'') {
+                text.push_back('\'');
+            }
+        }
+        text.push_back('\'');
+        return text;
+    };
+    char buffer[64];
+    switch (static_cast<DataType>(value.index())) {
+    case DataType::INT:
+        return std::to_string(std::get<int>(value));
+    case DataType::STRING: {
+        const std::string& text = std::get<std::string>(value);
+        return quote(text.data(), text.size());
+    }
+    case DataType::BOOL:
+        return std::get<bool>(value) ? "true" : "false";
+    case DataType::TIMESTAMP:
+        return std::to_string(static_cast<long long>(std::get<std::time_t>(value)));
+    case DataType::FLOAT: {
+        // Shortest text that reads back as the same float
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), std::get<float>(value));
+        return std::string(buffer, result.ptr);
+    }
+    case DataType::BLOB: {
+        const auto& blob = std::get<std::vector<uint8_t>>(value);
+        return quote(reinterpret_cast<const char*>(blob.data()), blob.size());
+    }
+    }
+    return std::string();
+}
+
+// StatementParser class
+// Recursive-descent parser for the statements of a command, separated by ';'.
+// Tokens are pulled from the lexer as the grammar needs them, so a command is scanned once.
+class StatementParser {
+public:
+    explicit StatementParser(std::string_view command) : lexer(command) {}
+
+    // Parse the next statement, false once only separators are left.
+    // text is set to the source of the statement. Throws SyntaxError.
+    bool next(Statement& statement, std::string_view& text);
+
+    // Skip the rest of a statement that failed to parse, the next call continues after it
+    void skipStatement();
+
+private:
+    Lexer lexer;
+    Token current;
+    size_t previousEnd = 0; // End of the last token consumed
+    bool started = false;
+    int parameters = 0;     // Parameters of the statement being parsed
+
+    void advance() {
+        previousEnd = current.end();
+        current = lexer.next();
+    }
+
+    bool atSymbol(char symbol) const {
+        return current.type == TokenType::SYMBOL && current.text[0] == symbol;
+    }
+
+    bool atKeyword(std::string_view keyword) const {
+        return isKeyword(current, keyword);
+    }
+
+    [[noreturn]] void fail(const std::string& expected) const;
+
+    void expectSymbol(char symbol);
+    void expectKeyword(std::string_view keyword);
+    std::string expectName(const char* what);
+    int expectInteger(const char* what);
+
+    Statement parseStatement();
+    AddTableStatement parseAddTable();
+    ColumnDefinition parseColumnDefinition();
+    InsertStatement parseInsert();
+    RemoveStatement parseRemove();
+    UpdateStatement parseUpdate();
+    CreateIndexStatement parseCreateIndex();
+    PrepareStatement parsePrepare();
+    CopyStatement parseCopy();
+    SelectStatement parseSelect();
+    SelectItem parseSelectItem();
+    Condition parseCondition();
+    ExecuteStatement parseExecute();
+    Assignment parseAssignment(bool inSetList);
+    Literal parseLiteral(bool inList, bool inSetList, bool inCondition = false);
+    DataType parseDataType();
+    IndexKind parseIndexKind();
+};
+
+bool StatementParser::next(Statement& statement, std::string_view& text) {
+    if (!started) {
+        started = true;
+        advance();
+    }
+    while (atSymbol(';')) {
+        advance();
+    }
+    if (current.type == TokenType::END) {
+        return false;
+    }
+    size_t start = current.position;
+    parameters = 0;
+    statement = parseStatement();
+    text = lexer.getSource().substr(start, previousEnd - start);
+    if (current.type != TokenType::END && !atSymbol(';')) {
+        fail("';' or end of command");
+    }
+    return true;
+}
+
+void StatementParser::skipStatement() {
+    try {
+        while (current.type != TokenType::END && !atSymbol(';')) {
+            advance();
+        }
+    }
+    catch (const SyntaxError&) {
+        // Only an unterminated string fails to scan, and it runs to the end of the command
+        lexer.seek(lexer.getSource().size());
+        current = lexer.next();
+    }
+}
+
+void StatementParser::fail(const std::string& expected) const {
+    std::string found = current.type == TokenType::END ? "end of command" : "'" + std::string(current.text) + "'";
+    throw SyntaxError("Expected " + expected + " but found " + found, current.position);
+}
+
+void StatementParser::expectSymbol(char symbol) {
+    if (!atSymbol(symbol)) {
+        fail(std::string("'") + symbol + "'");
+    }
+    advance();
+}
+
+void StatementParser::expectKeyword(std::string_view keyword) {
+    if (!atKeyword(keyword)) {
+        fail(std::string(keyword));
+    }
+    advance();
+}
+
+std::string StatementParser::expectName(const char* what) {
+    if (current.type != TokenType::IDENTIFIER) {
+        fail(what);
+    }
+    std::string name(current.text);
+    advance();
+    return name;
+}
+
+int StatementParser::expectInteger(const char* what) {
+    int value = 0;
+    auto result = std::from_chars(current.text.data(), current.text.data() + current.text.size(), value);
+    if (current.type != TokenType::NUMBER || result.ec != std::errc() || result.ptr != current.text.data() + current.text.size()) {
+        fail(what);
+    }
+    advance();
+    return value;
+}
+
+Statement StatementParser::parseStatement() {
+    if (atKeyword("CREATE")) {
+        advance();
+        if (atKeyword("DATABASE")) {
+            advance();
+            return CreateDatabaseStatement{ expectName("database name") };
+        }
+        if (atKeyword("INDEX")) {
+            return parseCreateIndex();
+        }
+        fail("DATABASE or INDEX");
+    }
+    if (atKeyword("USE")) {
+        advance();
+        return UseDatabaseStatement{ expectName("database name") };
+    }
+    if (atKeyword("ADD")) {
+        return parseAddTable();
+    }
+    if (atKeyword("INSERT")) {
+        return parseInsert();
+    }
+    if (atKeyword("REMOVE")) {
+        return parseRemove();
+    }
+    if (atKeyword("UPDATE")) {
+        return parseUpdate();
+    }
+    if (atKeyword("DROP")) {
+        advance();
+        expectKeyword("INDEX");
+        return DropIndexStatement{ expectName("index name") };
+    }
+    if (atKeyword("PREPARE")) {
+        return parsePrepare();
+    }
+    if (atKeyword("EXECUTE")) {
+        return parseExecute();
+    }
+    if (atKeyword("DEALLOCATE")) {
+        advance();
+        return DeallocateStatement{ expectName("statement name") };
+    }
+    if (atKeyword("COPY")) {
+        return parseCopy();
+    }
+    if (atKeyword("SELECT")) {
+        return parseSelect();
+    }
+    fail("a statement");
+}
+
+AddTableStatement StatementParser::parseAddTable() {
+    AddTableStatement statement;
+    expectKeyword("ADD");
+    expectKeyword("TABLE");
+    statement.tableName = expectName("table name");
+    expectSymbol('(');
+    if (!atSymbol(')')) {
+        statement.columns.push_back(parseColumnDefinition());
+        while (atSymbol(',')) {
+            advance();
+            statement.columns.push_back(parseColumnDefinition());
+        }
+    }
+    expectSymbol(')');
+    return statement;
+}
+
+ColumnDefinition StatementParser::parseColumnDefinition() {
+    ColumnDefinition column;
+    column.name = expectName("column name");
+    column.type = parseDataType();
+
+    // Attributes may come in any order
+    while (current.type == TokenType::IDENTIFIER) {
+        if (atKeyword("PRIMARY_KEY")) {
+            advance();
+            column.primaryKey = true;
+        }
+        else if (atKeyword("PRIMARY")) {
+            advance();
+            expectKeyword("KEY");
+            column.primaryKey = true;
+        }
+        else if (atKeyword("FANOUT")) {
+            advance();
+            column.fanout = expectInteger("node fanout");
+        }
+        else if (atKeyword("USING")) {
+            advance();
+            column.indexKind = parseIndexKind();
+        }
+        else if (atKeyword("REFERENCES")) {
+            advance();
+            column.referencedTable = expectName("referenced table name");
+            expectSymbol('(');
+            column.referencedColumn = expectName("referenced column name");
+            expectSymbol(')');
+        }
+        else {
+            fail("a column attribute");
+        }
+    }
+    return column;
+}
+
+InsertStatement StatementParser::parseInsert() {
+    InsertStatement statement;
+    expectKeyword("INSERT");
+    expectKeyword("INTO");
+    statement.tableName = expectName("table name");
+    // Room for the usual handful of columns, so the lists are not regrown value by value
+    statement.columns.reserve(8);
+    statement.values.reserve(8);
+    expectSymbol('(');
+    statement.columns.push_back(expectName("column name"));
+    while (atSymbol(',')) {
+        advance();
+        statement.columns.push_back(expectName("column name"));
+    }
+    expectSymbol(')');
+
+    expectKeyword("VALUES");
+    while (true) {
+        size_t rowPosition = current.position;
+        size_t rowStart = statement.values.size();
+        expectSymbol('(');
+        statement.values.push_back(parseLiteral(true, false));
+        while (atSymbol(',')) {
+            advance();
+            statement.values.push_back(parseLiteral(true, false));
+        }
+        expectSymbol(')');
+        size_t rowValues = statement.values.size() - rowStart;
+        if (rowValues != statement.columns.size()) {
+            throw SyntaxError("INSERT has " + std::to_string(statement.columns.size()) + " columns but " +
+                              std::to_string(rowValues) + " values", rowPosition);
+        }
+        if (!atSymbol(',')) {
+            break;
+        }
+        advance();
+    }
+    return statement;
+}
+
+RemoveStatement StatementParser::parseRemove() {
+    RemoveStatement statement;
+    expectKeyword("REMOVE");
+    expectKeyword("FROM");
+    statement.tableName = expectName("table name");
+    expectKeyword("WHERE");
+    statement.where = parseAssignment(false);
+    return statement;
+}
+
+UpdateStatement StatementParser::parseUpdate() {
+    UpdateStatement statement;
+    expectKeyword("UPDATE");
+    statement.tableName = expectName("table name");
+    expectKeyword("SET");
+    statement.assignments.push_back(parseAssignment(true));
+    while (atSymbol(',')) {
+        advance();
+        statement.assignments.push_back(parseAssignment(true));
+    }
+    expectKeyword("WHERE");
+    statement.where = parseAssignment(false);
+    return statement;
+}
+
+CreateIndexStatement StatementParser::parseCreateIndex() {
+    CreateIndexStatement statement;
+    expectKeyword("INDEX");
+    statement.indexName = expectName("index name");
+    expectKeyword("ON");
+    statement.tableName = expectName("table name");
+    expectSymbol('(');
+    statement.columnName = expectName("column name");
+    expectSymbol(')');
+    if (atKeyword("USING")) {
+        advance();
+        statement.indexKind = parseIndexKind();
+    }
+    return statement;
+}
+
+// The statement after AS is only scanned here, it is parsed when it is prepared
+PrepareStatement StatementParser::parsePrepare() {
+    PrepareStatement statement;
+    expectKeyword("PREPARE");
+    statement.name = expectName("statement name");
+    expectKeyword("AS");
+    if (current.type == TokenType::END || atSymbol(';')) {
+        fail("a statement");
+    }
+    size_t start = current.position;
+    while (current.type != TokenType::END && !atSymbol(';')) {
+        advance();
+    }
+    statement.body = std::string(lexer.getSource().substr(start, previousEnd - start));
+    return statement;
+}
+
+SelectStatement StatementParser::parseSelect() {
+    SelectStatement statement;
+    expectKeyword("SELECT");
+    if (atSymbol('*')) {
+        advance();
+    }
+    else {
+        statement.items.push_back(parseSelectItem());
+        while (atSymbol(',')) {
+            advance();
+            statement.items.push_back(parseSelectItem());
+        }
+    }
+    expectKeyword("FROM");
+    statement.tableName = expectName("table name");
+    if (atKeyword("WHERE")) {
+        advance();
+        statement.where.push_back(parseCondition());
+        while (atKeyword("AND")) {
+            advance();
+            statement.where.push_back(parseCondition());
+        }
+    }
+    if (atKeyword("GROUP")) {
+        advance();
+        expectKeyword("BY");
+        statement.groupBy.push_back(expectName("column name"));
+        while (atSymbol(',')) {
+            advance();
+            statement.groupBy.push_back(expectName("column name"));
+        }
+    }
+    if (atKeyword("LIMIT")) {
+        advance();
+        statement.limit = static_cast<size_t>(expectInteger("row limit"));
+    }
+    return statement;
+}
+
+SelectItem StatementParser::parseSelectItem() {
+    SelectItem item;
+    size_t position = current.position;
+    item.column = expectName("column name");
+    if (!atSymbol('(')) {
+        return item;
+    }
+    std::string name = item.column;
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    std::optional<AggregateFunction> function = aggregateFromName(name);
+    if (!function) {
+        throw SyntaxError("Unknown aggregate function: " + item.column, position);
+    }
+    item.function = *function;
+    advance();
+    if (item.function == AggregateFunction::COUNT && atSymbol('*')) {
+        advance();
+        item.column.clear();
+    }
+    else {
+        item.column = expectName("column name");
+    }
+    expectSymbol(')');
+    return item;
+}
+
+Condition StatementParser::parseCondition() {
+    Condition condition;
+    condition.column = expectName("column name");
+    // Two-character operators are two symbols with nothing between them
+    auto followedBy = [&](char symbol) {
+        if (atSymbol(symbol) && current.position == previousEnd) {
+            advance();
+            return true;
+        }
+        return false;
+    };
+    if (atSymbol('=')) {
+        advance();
+        condition.op = CompareOp::EQUAL;
+    }
+    else if (atSymbol('<')) {
+        advance();
+        condition.op = followedBy('=') ? CompareOp::LESS_EQUAL : followedBy('>') ? CompareOp::NOT_EQUAL : CompareOp::LESS;
+    }
+    else if (atSymbol('>')) {
+        advance();
+        condition.op = followedBy('=') ? CompareOp::GREATER_EQUAL : CompareOp::GREATER;
+    }
+    else if (atSymbol('!')) {
+        advance();
+        if (!followedBy('=')) {
+            fail("'='");
+        }
+        condition.op = CompareOp::NOT_EQUAL;
+    }
+    else {
+        fail("a comparison operator");
+    }
+    condition.value = parseLiteral(false, false, true);
+    return condition;
+}
+
+CopyStatement StatementParser::parseCopy() {
+    CopyStatement statement;
+    expectKeyword("COPY");
+    statement.tableName = expectName("table name");
+    if (atKeyword("TO")) {
+        statement.toFile = true;
+        advance();
+    }
+    else {
+        expectKeyword("FROM");
+    }
+    if (current.type != TokenType::STRING) {
+        fail("a quoted file name");
+    }
+    statement.fileName = unquote(current);
+    advance();
+
+    if (atSymbol('(')) {
+        advance();
+        while (true) {
+            if (atKeyword("FORMAT")) {
+                advance();
+                if (atKeyword("CSV")) {
+                    statement.options.format = CopyFormat::CSV;
+                }
+                else if (atKeyword("BINARY")) {
+                    statement.options.format = CopyFormat::BINARY;
+                }
+                else {
+                    fail("CSV or BINARY");
+                }
+                advance();
+            }
+            else if (atKeyword("HEADER")) {
+                statement.options.header = true;
+                advance();
+            }
+            else {
+                fail("FORMAT or HEADER");
+            }
+            if (!atSymbol(',')) {
+                break;
+            }
+            advance();
+        }
+        expectSymbol(')');
+    }
+    return statement;
+}
+
+ExecuteStatement StatementParser::parseExecute() {
+    ExecuteStatement statement;
+    expectKeyword("EXECUTE");
+    statement.name = expectName("statement name");
+    if (atSymbol('(')) {
+        advance();
+        statement.values.push_back(parseLiteral(true, false));
+        while (atSymbol(',')) {
+            advance();
+            statement.values.push_back(parseLiteral(true, false));
+        }
+        expectSymbol(')');
+    }
+    for (const Literal& value : statement.values) {
+        if (value.parameter >= 0) {
+            throw SyntaxError("EXECUTE takes values, not parameters", value.position);
+        }
+    }
+    return statement;
+}
+
+Assignment StatementParser::parseAssignment(bool inSetList) {
+    Assignment assignment;
+    assignment.column = expectName("column name");
+    expectSymbol('=');
+    assignment.value = parseLiteral(false, inSetList);
+    return assignment;
+}
+
+// A quoted literal, or a bare value running up to the next separator. Bare values keep their
+// source text with each run of spaces between tokens written as one space, so 'Alice Smith'
+// and Alice Smith give the same value. In a condition the value ends at AND or LIMIT.
+Literal StatementParser::parseLiteral(bool inList, bool inSetList, bool inCondition) {
+    auto atEnd = [&]() {
+        return current.type == TokenType::END || atSymbol(';') || ((inList || inSetList) && atSymbol(',')) ||
+               (inList && atSymbol(')')) || (inSetList && atKeyword("WHERE")) ||
+               (inCondition && (atKeyword("AND") || atKeyword("GROUP") || atKeyword("LIMIT")));
+    };
+    if (atEnd()) {
+        fail("a value");
+    }
+
+    Literal literal;
+    literal.position = current.position;
+    Token first = current;
+    advance();
+    if (atEnd()) {
+        // A single token, the usual case, is taken as it is
+        if (first.type == TokenType::STRING) {
+            literal.text = unquote(first);
+            literal.quoted = true;
+        }
+        else {
+            literal.text.assign(first.text);
+            if (first.type == TokenType::SYMBOL && first.text[0] == '?') {
+                literal.parameter = parameters++;
+            }
+        }
+        return literal;
+    }
+
+    literal.text.assign(first.text);
+    while (!atEnd()) {
+        if (current.position > previousEnd) {
+            literal.text.push_back(' ');
+        }
+        literal.text.append(current.text);
+        advance();
+    }
+    return literal;
+}
+
+DataType StatementParser::parseDataType() {
+    if (current.type != TokenType::IDENTIFIER) {
+        fail("column type");
+    }
+    static const std::pair<const char*, DataType> types[] = {
+        { "INT", DataType::INT }, { "STRING", DataType::STRING }, { "BOOL", DataType::BOOL },
+        { "TIMESTAMP", DataType::TIMESTAMP }, { "FLOAT", DataType::FLOAT }, { "BLOB", DataType::BLOB },
+    };
+    for (const auto& type : types) {
+        if (atKeyword(type.first)) {
+            advance();
+            return type.second;
+        }
+    }
+    throw SyntaxError("Unknown column type: " + std::string(current.text), current.position);
+}
+
+IndexKind StatementParser::parseIndexKind() {
+    if (current.type != TokenType::IDENTIFIER) {
+        fail("index type");
+    }
+    std::string name(current.text);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    std::optional<IndexKind> kind = indexKindFromName(name);
+    if (kind) {
+        advance();
+        return *kind;
+    }
+    throw SyntaxError("Unknown index type: " + std::string(current.text), current.position);
+}
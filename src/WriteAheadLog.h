@@ -0,0 +1,402 @@
+// WriteAheadLog.h
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "Checksum.h"
+
+// Append-only file with an explicit flush to stable storage
+class LogFile {
+public:
+    LogFile() = default;
+    LogFile(const LogFile&) = delete;
+    LogFile& operator=(const LogFile&) = delete;
+
+    ~LogFile() {
+        close();
+    }
+
+    void open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        _sopen_s(&fd, path.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE);
+#else
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+#endif
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open log file: " + path);
+        }
+    }
+
+    void write(const char* data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            int written = _write(fd, data, static_cast<unsigned int>(std::min<size_t>(size, 1 << 30)));
+#else
+            ssize_t written = ::write(fd, data, size);
+#endif
+            if (written < 0) {
+                throw std::runtime_error("Failed to write to log file.");
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    // Force written data to disk
+    void sync() {
+#ifdef _WIN32
+        int result = _commit(fd);
+#else
+        int result = ::fsync(fd);
+#endif
+        if (result != 0) {
+            throw std::runtime_error("Failed to sync log file.");
+        }
+    }
+
+    void close() {
+        if (fd >= 0) {
+#ifdef _WIN32
+            _close(fd);
+#else
+            ::close(fd);
+#endif
+            fd = -1;
+        }
+    }
+
+    bool isOpen() const {
+        return fd >= 0;
+    }
+
+private:
+    int fd = -1;
+};
+
+// When committed records reach the disk
+enum class SyncPolicy {
+    ALWAYS, // Every commit waits for its records to be synced, concurrent commits share one sync
+    GROUP,  // Every commit is written to the OS and syncs are shared by groups, an OS crash loses at most the last group
+    NONE    // Records are handed to the OS and never explicitly synced
+};
+
+// WriteAheadLog class
+// An append-only file of checksummed records. Each record is framed as
+//   uint32 payload size | uint32 CRC-32 of the payload | uint64 sequence number | payload
+// and a torn or corrupt tail is cut off when the log is replayed. Sequence numbers keep rising
+// across resets, so whatever saves the logged changes can record how far it got and replay
+// can pass over the records it already holds.
+// Appends are buffered in memory. A commit writes everything buffered with one write and
+// one sync, so commands that commit back to back or from several threads share the cost.
+// A write or sync that fails leaves the file in an unknown state, so the log refuses every
+// later append and commit until it is reset.
+class WriteAheadLog {
+public:
+    struct Options {
+        SyncPolicy policy = SyncPolicy::ALWAYS;
+        size_t groupCommits = 32;                              // GROUP: sync after this many commits
+        std::chrono::milliseconds groupWindow{ 10 };           // GROUP: or once the oldest unsynced commit is this old
+    };
+
+    WriteAheadLog() = default;
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    ~WriteAheadLog() {
+        try {
+            close();
+        }
+        catch (...) {
+        }
+    }
+
+    // Open the log at path, replaying every intact record and its sequence number through apply first.
+    // New records are numbered after both the replayed ones and savedLsn, the last record saved elsewhere.
+    void open(const std::string& path, const Options& options, uint64_t savedLsn,
+              const std::function<void(uint64_t, const std::string&)>& apply);
+
+    // Buffer a record, returns its sequence number
+    uint64_t append(const std::string& payload);
+
+    // Buffer records with consecutive sequence numbers, no other record comes between them.
+    // Returns the sequence number of the last.
+    uint64_t append(const std::vector<std::string>& payloads);
+
+    // Make records up to lsn durable as the sync policy allows
+    void commit(uint64_t lsn);
+
+    // Write and sync everything appended so far
+    void sync();
+
+    // Drop every record, called once their changes are saved elsewhere. Numbering carries on.
+    void reset();
+
+    void close();
+
+    bool isOpen() const {
+        return file.isOpen();
+    }
+
+    // Sequence number of the last appended record
+    uint64_t lastLsn() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return appendedLsn;
+    }
+
+private:
+    static constexpr size_t HEADER_SIZE = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+    static constexpr uint32_t MAX_RECORD_SIZE = 1u << 30;
+
+    std::string path;
+    Options options;
+    LogFile file;
+
+    mutable std::mutex mutex;
+    std::condition_variable synced;
+    std::string buffer;       // Framed records not written yet
+    uint64_t appendedLsn = 0; // Last record appended
+    uint64_t writtenLsn = 0;  // Last record handed to the OS
+    uint64_t durableLsn = 0;  // Last record synced (written if the policy is NONE)
+    bool flushing = false;    // A committer is writing the buffer, others wait for it
+    bool failed = false;      // A write or sync failed, records past durableLsn may be lost
+
+    size_t pendingCommits = 0;
+    std::chrono::steady_clock::time_point oldestPending;
+
+    // Replay the records in the file, returns the size of the intact prefix
+    uint64_t replay(const std::function<void(uint64_t, const std::string&)>& apply);
+
+    // Frame a record into the buffer, the mutex is held
+    uint64_t appendLocked(const std::string& payload);
+
+    void checkFailed() const {
+        if (failed) {
+            throw std::runtime_error("Write-ahead log failed, changes can no longer be logged: " + path);
+        }
+    }
+
+    // Write the buffer as the leader of a group, the lock is released during I/O
+    void flush(std::unique_lock<std::mutex>& lock, bool syncToDisk);
+};
+
+void WriteAheadLog::open(const std::string& logPath, const Options& logOptions, uint64_t savedLsn,
+                         const std::function<void(uint64_t, const std::string&)>& apply) {
+    close();
+    path = logPath;
+    options = logOptions;
+    buffer.clear();
+    appendedLsn = writtenLsn = durableLsn = 0;
+    failed = false;
+    pendingCommits = 0;
+
+    if (std::filesystem::exists(path)) {
+        uint64_t intact = replay(apply);
+        if (intact < std::filesystem::file_size(path)) {
+            std::filesystem::resize_file(path, intact);
+        }
+    }
+    appendedLsn = std::max(appendedLsn, savedLsn);
+    writtenLsn = durableLsn = appendedLsn;
+    file.open(path);
+}
+
+// The first record may have any sequence number, a log that was reset starts past zero
+uint64_t WriteAheadLog::replay(const std::function<void(uint64_t, const std::string&)>& apply) {
+    std::ifstream in(path, std::ios::binary);
+    uint64_t intact = 0;
+    std::string payload;
+    while (true) {
+        char header[HEADER_SIZE];
+        if (!in.read(header, HEADER_SIZE)) {
+            break;
+        }
+        uint32_t size;
+        uint32_t checksum;
+        uint64_t lsn;
+        std::memcpy(&size, header, sizeof(size));
+        std::memcpy(&checksum, header + sizeof(size), sizeof(checksum));
+        std::memcpy(&lsn, header + sizeof(size) + sizeof(checksum), sizeof(lsn));
+        if (size > MAX_RECORD_SIZE) {
+            break;
+        }
+        payload.resize(size);
+        if (!in.read(&payload[0], size) || crc32(payload.data(), size) != checksum || lsn == 0
+            || (intact != 0 && lsn != appendedLsn + 1)) {
+            break;
+        }
+        apply(lsn, payload);
+        appendedLsn = lsn;
+        intact += HEADER_SIZE + size;
+    }
+    return intact;
+}
+
+uint64_t WriteAheadLog::append(const std::string& payload) {
+    std::lock_guard<std::mutex> lock(mutex);
+    checkFailed();
+    return appendLocked(payload);
+}
+
+uint64_t WriteAheadLog::append(const std::vector<std::string>& payloads) {
+    std::lock_guard<std::mutex> lock(mutex);
+    checkFailed();
+    for (const std::string& payload : payloads) {
+        if (payload.size() > MAX_RECORD_SIZE) {
+            throw std::runtime_error("Log record too large.");
+        }
+    }
+    for (const std::string& payload : payloads) {
+        appendLocked(payload);
+    }
+    return appendedLsn;
+}
+
+uint64_t WriteAheadLog::appendLocked(const std::string& payload) {
+    if (payload.size() > MAX_RECORD_SIZE) {
+        throw std::runtime_error("Log record too large.");
+    }
+    uint64_t lsn = ++appendedLsn;
+    uint32_t size = static_cast<uint32_t>(payload.size());
+    uint32_t checksum = crc32(payload.data(), payload.size());
+    buffer.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    buffer.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    buffer.append(reinterpret_cast<const char*>(&lsn), sizeof(lsn));
+    buffer.append(payload);
+    return lsn;
+}
+
+void WriteAheadLog::commit(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(mutex);
+    checkFailed();
+    switch (options.policy) {
+    case SyncPolicy::ALWAYS:
+        // The first committer to find no write in progress writes for everyone queued behind it
+        while (durableLsn < lsn) {
+            if (flushing) {
+                synced.wait(lock);
+            }
+            else {
+                flush(lock, true);
+            }
+            checkFailed();
+        }
+        break;
+    case SyncPolicy::GROUP: {
+        // The records reach the OS now, so a crash of the process alone loses nothing.
+        // Only the sync waits for a group of commits or for the window to pass.
+        auto now = std::chrono::steady_clock::now();
+        if (pendingCommits++ == 0) {
+            oldestPending = now;
+        }
+        bool groupDone = pendingCommits >= options.groupCommits || now - oldestPending >= options.groupWindow;
+        while (writtenLsn < lsn || (groupDone && durableLsn < lsn)) {
+            if (flushing) {
+                synced.wait(lock);
+            }
+            else {
+                flush(lock, groupDone);
+            }
+            checkFailed();
+        }
+        break;
+    }
+    case SyncPolicy::NONE:
+        while (writtenLsn < lsn) {
+            if (flushing) {
+                synced.wait(lock);
+            }
+            else {
+                flush(lock, false);
+            }
+            checkFailed();
+        }
+        break;
+    }
+}
+
+void WriteAheadLog::sync() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (flushing) {
+        synced.wait(lock);
+    }
+    checkFailed();
+    flush(lock, true);
+}
+
+void WriteAheadLog::flush(std::unique_lock<std::mutex>& lock, bool syncToDisk) {
+    flushing = true;
+    std::string pending;
+    pending.swap(buffer);
+    uint64_t target = appendedLsn;
+    if (syncToDisk) {
+        pendingCommits = 0;
+    }
+    lock.unlock();
+
+    try {
+        file.write(pending.data(), pending.size());
+        if (syncToDisk) {
+            file.sync();
+        }
+    }
+    catch (...) {
+        // Part of pending may be on disk and a failed sync may have dropped written pages,
+        // so neither is retried and nothing past durableLsn is reported durable
+        lock.lock();
+        failed = true;
+        flushing = false;
+        synced.notify_all();
+        throw;
+    }
+
+    lock.lock();
+    writtenLsn = target;
+    if (syncToDisk || options.policy == SyncPolicy::NONE) {
+        durableLsn = target;
+    }
+    flushing = false;
+    synced.notify_all();
+}
+
+void WriteAheadLog::reset() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (flushing) {
+        synced.wait(lock);
+    }
+    file.close();
+    std::filesystem::resize_file(path, 0);
+    file.open(path);
+    buffer.clear();
+    writtenLsn = durableLsn = appendedLsn;
+    failed = false;
+    pendingCommits = 0;
+}
+
+void WriteAheadLog::close() {
+    if (!file.isOpen()) {
+        return;
+    }
+    if (!failed) {
+        sync();
+    }
+    file.close();
+}
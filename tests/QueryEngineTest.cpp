@@ -0,0 +1,93 @@
+// QueryEngineTest.cpp
+// Standalone checks of the SELECT pipeline, build with the headers of src on the include path:
+//   g++ -std=c++17 -Isrc tests/QueryEngineTest.cpp -o QueryEngineTest -lpthread
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Query_Parser.h"
+
+// Rows a SELECT returns, as the values of its columns
+std::vector<std::vector<Value>> select(const Table& table, const std::string& sql) {
+    StatementParser parser(sql);
+    Statement statement;
+    std::string_view text;
+    parser.next(statement, text);
+    std::unique_ptr<Projection> plan = planSelect(table, std::get<SelectStatement>(statement));
+    std::vector<std::vector<Value>> rows;
+    std::vector<Value> values;
+    while (plan->next(values)) {
+        rows.push_back(values);
+    }
+    return rows;
+}
+
+// A STRING or BLOB predicate on a scanned slice whose length is not a multiple of 64 must not
+// look at the row ids past its end
+void testStringFilterOnPartialWord() {
+    Table table;
+    table.name = "T";
+    table.columns.push_back(Column("id", DataType::INT));
+    table.columns.push_back(Column("s", DataType::STRING));
+    table.columns.push_back(Column("b", DataType::BLOB));
+    for (const Column& column : table.columns) {
+        table.columnData.emplace_back(column.type);
+    }
+    const int rowCount = 100;
+    for (int i = 0; i < rowCount; ++i) {
+        std::string text(1, static_cast<char>('a' + i % 5));
+        table.appendRowValues({ i, text, std::vector<uint8_t>(text.begin(), text.end()) });
+    }
+
+    std::vector<std::vector<Value>> rows = select(table, "SELECT id FROM T WHERE s = 'c'");
+    assert(rows.size() == rowCount / 5);
+    for (const std::vector<Value>& row : rows) {
+        assert(std::get<int>(row[0]) % 5 == 2);
+    }
+    assert(select(table, "SELECT id FROM T WHERE s != 'c'").size() == rowCount - rowCount / 5);
+    assert(select(table, "SELECT * FROM T WHERE s >= 'a'").size() == rowCount);
+    assert(select(table, "SELECT id FROM T WHERE b = 'd'").size() == rowCount / 5);
+    assert(select(table, "SELECT id FROM T WHERE id >= 0 AND s < 'z'").size() == rowCount);
+
+    // With a deleted row the selection is rebuilt from the live rows instead
+    table.live[7] = false;
+    table.liveRows--;
+    assert(select(table, "SELECT id FROM T WHERE s = 'c'").size() == rowCount / 5 - 1);
+}
+
+// A range scan hands on one batch per call and picks up inside a key whose rows span batches
+void testIndexRangeScanInBatches() {
+    Table table;
+    table.name = "T";
+    table.columns.push_back(Column("v", DataType::INT));
+    table.columnData.emplace_back(DataType::INT);
+    const int rowCount = 3 * static_cast<int>(RowBatch::CAPACITY) + 100;
+    for (int i = 0; i < rowCount; ++i) {
+        table.appendRowValues({ i % 3 });
+    }
+    for (IndexKind kind : { IndexKind::BTREE, IndexKind::BPLUSTREE }) {
+        table.createIndex("T_v", "v", kind);
+        const Column* column = table.getIndexedColumn("T_v");
+        IndexRangeScan scan(*column->index, Value(1), std::nullopt, "v");
+        RowBatch batch;
+        std::vector<RowId> rows;
+        while (scan.next(batch)) {
+            assert(!batch.rows.empty() && batch.rows.size() <= RowBatch::CAPACITY);
+            rows.insert(rows.end(), batch.rows.begin(), batch.rows.end());
+        }
+        assert(rows.size() == static_cast<size_t>(rowCount - (rowCount + 2) / 3));
+        for (size_t i = 0; i < rows.size(); ++i) {
+            assert(rows[i] % 3 == (i < rows.size() / 2 ? 1u : 2u));
+            assert(i == 0 || rows[i - 1] % 3 < rows[i] % 3 || rows[i - 1] < rows[i]);
+        }
+        assert(select(table, "SELECT v FROM T WHERE v >= 1 LIMIT 5").size() == 5);
+        table.dropIndex("T_v");
+    }
+}
+
+int main() {
+    testStringFilterOnPartialWord();
+    testIndexRangeScanInBatches();
+    std::cout << "QueryEngineTest passed" << std::endl;
+    return 0;
+}